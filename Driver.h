@@ -58,6 +58,7 @@ public:
     };
 
     std::vector<std::string> m_args;
+    std::vector<std::string> m_contracts;
 
     lldb::LanguageType m_repl_lang = lldb::eLanguageTypeUnknown;
     lldb::pid_t m_process_pid = LLDB_INVALID_PROCESS_ID;
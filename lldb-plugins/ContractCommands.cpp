@@ -1,20 +1,82 @@
 #include "ContractCommands.h"
+#include "FunctionCallTrace.h"
+#include "HostHooks.h"
 #include <lldb/API/SBDebugger.h>
 #include <lldb/API/SBTarget.h>
 #include <lldb/API/SBModule.h>
 #include <lldb/API/SBBreakpoint.h>
 #include <lldb/API/SBBreakpointLocation.h>
 #include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBData.h>
 #include <lldb/API/SBFileSpec.h>
 #include <lldb/API/SBFileSpecList.h>
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBModuleSpec.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBSection.h>
+#include <lldb/API/SBSymbol.h>
+#include <lldb/API/SBThread.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <regex>
+#include <set>
+#include <shared_mutex>
 #include <sstream>
 #include <iostream>
+#include <thread>
+#include <unordered_set>
 
 // Global contract registry
-std::map<std::string, ContractInfo> g_contract_registry;
+std::unordered_map<ContractAddress, ContractInfo, ContractAddressHash>
+    g_contract_registry;
+// LookupContractByPC also runs on the trace workers and the fast-trace drain
+// thread. Commands mutate the registry under the exclusive lock (inserting
+// may rehash it, and the index rebuild reads the modules) and the lookup
+// reads it under the shared one; the commands' own reads need no lock.
+static std::shared_mutex g_contract_registry_mutex;
 std::vector<std::string> g_call_stack;
 std::string g_current_context;
 
+bool ParseContractAddress(const std::string &text, ContractAddress &out) {
+  size_t start = (text.size() >= 2 && text[0] == '0' &&
+                  (text[1] == 'x' || text[1] == 'X'))
+                     ? 2
+                     : 0;
+  size_t digits = text.size() - start;
+  if (digits == 0 || digits > 40)
+    return false;
+
+  out.bytes.fill(0);
+  // Fill from the least significant nibble so short input is left-padded
+  for (size_t i = 0; i < digits; ++i) {
+    char c = text[text.size() - 1 - i];
+    uint8_t nibble;
+    if (c >= '0' && c <= '9')
+      nibble = c - '0';
+    else if (c >= 'a' && c <= 'f')
+      nibble = c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F')
+      nibble = c - 'A' + 10;
+    else
+      return false;
+    out.bytes[19 - i / 2] |= (i % 2) ? (nibble << 4) : nibble;
+  }
+  return true;
+}
+
+std::string FormatContractAddress(const ContractAddress &addr) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string hex = "0x";
+  for (uint8_t b : addr.bytes) {
+    hex += kHex[b >> 4];
+    hex += kHex[b & 0xf];
+  }
+  return hex;
+}
+
 // Helper functions for debugger integration
 void UpdateCallStack(const std::string& stack_str) {
   g_call_stack.clear();
@@ -44,11 +106,388 @@ void PopContext() {
   }
 }
 
+// -----------------------------------------------------------------------------
+// Automatic context tracking.
+//
+// The cross-contract host calls (call/delegatecall/staticcall) take a pointer
+// to the 20-byte callee address as their first argument. Their entry pushes the
+// callee onto g_call_stack and their return pops it, so the stack follows the
+// execution without anyone feeding UpdateCallStack.
+
+static int g_context_listener = -1;
+
+static void ContextHostCallHandler(lldb::SBProcess &process,
+                                   lldb::SBThread &thread,
+                                   const HostCallEvent &event) {
+  if (event.is_return) {
+    PopContext();
+    return;
+  }
+
+  uint8_t callee[20];
+  lldb::SBError err;
+  size_t read = process.ReadMemory(event.args[0], callee, sizeof(callee), err);
+  // Push even on failure so the matching return keeps the stack balanced
+  if (err.Fail() || read != sizeof(callee)) {
+    PushContext("<unknown>");
+    return;
+  }
+
+  ContractAddress key;
+  std::memcpy(key.bytes.data(), callee, key.bytes.size());
+  auto it = g_contract_registry.find(key);
+  if (it == g_contract_registry.end()) {
+    PushContext(FormatContractAddress(key));
+    return;
+  }
+  // A lazy callee is activated when its user_entrypoint is reached
+  PushContext(it->second.address);
+}
+
+static void EnableContractContextTracking(lldb::SBTarget &target) {
+  if (g_context_listener >= 0)
+    return;
+  g_context_listener = AddHostCallListener(target, kHostCategoryCall,
+                                           /*want_returns=*/true,
+                                           ContextHostCallHandler);
+}
+
+// Lazy contracts are activated when the user_entrypoint of their library is
+// reached, whether as the root of the transaction or through a cross-contract
+// call. Loading a module and creating breakpoints is not safe from a
+// breakpoint callback, so the callback only records the contract and stops;
+// "stylus-contract activate", run by a stop hook, does the loading. The
+// breakpoint is re-created whenever a lazy contract is registered and
+// disabled once none is left.
+
+static lldb::SBBreakpoint g_lazy_entry_bp;
+static bool g_activation_stop_hook = false;
+static std::mutex g_pending_activations_mutex;
+static std::vector<ContractAddress> g_pending_activations;
+
+static std::string FileSpecPath(const lldb::SBFileSpec &file) {
+  char path[4096];
+  if (!file.IsValid() || file.GetPath(path, sizeof(path)) == 0)
+    return std::string();
+  return path;
+}
+
+// LLDB prints UUIDs as upper-case hex with dashes between some byte groups
+static bool ModuleHasBuildId(const lldb::SBModule &module,
+                             const std::vector<uint8_t> &build_id) {
+  const char *uuid = module.GetUUIDString();
+  if (!uuid)
+    return false;
+  std::string hex;
+  for (const char *c = uuid; *c; ++c)
+    if (*c != '-')
+      hex += *c;
+  std::string expected;
+  char byte[3];
+  for (uint8_t b : build_id) {
+    std::snprintf(byte, sizeof(byte), "%02X", b);
+    expected += byte;
+  }
+  return hex == expected;
+}
+
+static bool ModuleIsLibrary(const lldb::SBModule &module,
+                            const ContractInfo &info) {
+  if (!info.build_id.empty() && module.GetUUIDString())
+    return ModuleHasBuildId(module, info.build_id);
+  return FileSpecPath(module.GetFileSpec()) ==
+         FileSpecPath(lldb::SBFileSpec(info.library_path.c_str(), true));
+}
+
+static bool LazyEntryCallback(void *baton, lldb::SBProcess &process,
+                              lldb::SBThread &thread,
+                              lldb::SBBreakpointLocation &location) {
+  lldb::SBModule module = thread.GetFrameAtIndex(0).GetModule();
+  if (!module.IsValid())
+    return false;
+
+  std::vector<ContractAddress> matched;
+  {
+    std::shared_lock<std::shared_mutex> lk(g_contract_registry_mutex);
+    for (const auto &[addr, info] : g_contract_registry)
+      if (info.lazy && ModuleIsLibrary(module, info))
+        matched.push_back(addr);
+  }
+  if (matched.empty())
+    return false;
+
+  std::lock_guard<std::mutex> lk(g_pending_activations_mutex);
+  g_pending_activations.insert(g_pending_activations.end(), matched.begin(),
+                               matched.end());
+  // Stopped at the entrypoint, so breakpoints resolved by the stop hook are in
+  // place before the contract body runs
+  return true;
+}
+
+static void UpdateLazyEntryBreakpoint(lldb::SBTarget &target) {
+  if (g_lazy_entry_bp.IsValid()) {
+    target.BreakpointDelete(g_lazy_entry_bp.GetID());
+    g_lazy_entry_bp = lldb::SBBreakpoint();
+  }
+
+  lldb::SBFileSpecList modules;
+  for (const auto &[addr, info] : g_contract_registry)
+    if (info.lazy)
+      modules.Append(lldb::SBFileSpec(info.library_path.c_str(), true));
+  if (modules.GetSize() == 0)
+    return;
+
+  // Resolves as each library is loaded
+  g_lazy_entry_bp = target.BreakpointCreateByName("user_entrypoint", modules,
+                                                  lldb::SBFileSpecList());
+  if (!g_lazy_entry_bp.IsValid())
+    return;
+  g_lazy_entry_bp.SetCallback(LazyEntryCallback, nullptr);
+
+  if (!g_activation_stop_hook) {
+    lldb::SBCommandReturnObject ignored;
+    target.GetDebugger().GetCommandInterpreter().HandleCommand(
+        "target stop-hook add -o \"stylus-contract activate\"", ignored);
+    g_activation_stop_hook = ignored.Succeeded();
+  }
+}
+
+// -----------------------------------------------------------------------------
+// PC-range interval index.
+//
+// Sorted, non-overlapping [begin, end) load ranges of every registered
+// module's sections, each pointing back at its registry key. Rebuilt when the
+// registry changes, and re-tried on the next stop while some registered module
+// has no load address yet (it only gets one once the process loads it).
+
+struct ContractRange {
+  lldb::addr_t begin;
+  lldb::addr_t end;
+  const std::string *address; // ContractInfo::address in g_contract_registry
+};
+
+static std::mutex g_contract_index_mutex;
+static std::vector<ContractRange> g_contract_ranges;
+static bool g_contract_index_dirty = true;
+static bool g_contract_index_partial = false;
+static uint32_t g_contract_index_stop_id = 0;
+
+void InvalidateContractIndex() {
+  std::lock_guard<std::mutex> lk(g_contract_index_mutex);
+  g_contract_index_dirty = true;
+}
+
+static void RebuildContractIndex(lldb::SBTarget &target) {
+  g_contract_ranges.clear();
+  g_contract_index_partial = false;
+
+  for (const auto &[addr, info] : g_contract_registry) {
+    lldb::SBModule module = info.module;
+    if (!module.IsValid())
+      continue;
+
+    bool loaded = false;
+    for (size_t i = 0; i < module.GetNumSections(); ++i) {
+      lldb::SBSection section = module.GetSectionAtIndex(i);
+      lldb::addr_t size = section.GetByteSize();
+      lldb::addr_t load = section.GetLoadAddress(target);
+      // Debug info and other non-allocated sections never get a load address
+      if (size == 0 || load == LLDB_INVALID_ADDRESS)
+        continue;
+      g_contract_ranges.push_back({load, load + size, &info.address});
+      loaded = true;
+    }
+    if (!loaded)
+      g_contract_index_partial = true;
+  }
+
+  std::sort(g_contract_ranges.begin(), g_contract_ranges.end(),
+            [](const ContractRange &a, const ContractRange &b) {
+              return a.begin < b.begin;
+            });
+
+  // The lookup needs non-overlapping ranges. An overlap means one library is
+  // registered under two addresses; the first range wins and the clash is
+  // reported, since PCs in it cannot be told apart.
+  size_t kept = 0;
+  for (size_t i = 0; i < g_contract_ranges.size(); ++i) {
+    const ContractRange &r = g_contract_ranges[i];
+    if (kept && r.begin < g_contract_ranges[kept - 1].end) {
+      const ContractRange &prev = g_contract_ranges[kept - 1];
+      if (*r.address != *prev.address)
+        std::fprintf(stderr,
+                     "stylus-contract: %s and %s share load range "
+                     "[0x%llx, 0x%llx); attributing it to %s\n",
+                     prev.address->c_str(), r.address->c_str(),
+                     static_cast<unsigned long long>(r.begin),
+                     static_cast<unsigned long long>(std::min(r.end, prev.end)),
+                     prev.address->c_str());
+      continue;
+    }
+    g_contract_ranges[kept++] = r;
+  }
+  g_contract_ranges.resize(kept);
+  g_contract_index_dirty = false;
+}
+
+const std::string *LookupContractByPC(lldb::SBTarget &target, lldb::addr_t pc) {
+  if (pc == LLDB_INVALID_ADDRESS)
+    return nullptr;
+
+  std::lock_guard<std::mutex> lk(g_contract_index_mutex);
+  std::shared_lock<std::shared_mutex> registry_lk(g_contract_registry_mutex);
+  if (g_contract_registry.empty())
+    return nullptr;
+  uint32_t stop_id = 0;
+  if (lldb::SBProcess process = target.GetProcess(); process.IsValid())
+    stop_id = process.GetStopID();
+  if (g_contract_index_dirty ||
+      (g_contract_index_partial && stop_id != g_contract_index_stop_id)) {
+    RebuildContractIndex(target);
+    g_contract_index_stop_id = stop_id;
+  }
+
+  // Last range starting at or before pc
+  auto it = std::upper_bound(
+      g_contract_ranges.begin(), g_contract_ranges.end(), pc,
+      [](lldb::addr_t value, const ContractRange &r) { return value < r.begin; });
+  if (it == g_contract_ranges.begin())
+    return nullptr;
+  --it;
+  return pc < it->end ? it->address : nullptr;
+}
+
+// Key of ContractFunctionIndex::by_base_name: the function's own name, which
+// every request naming it ends with
+static std::string BaseName(const std::string &name) {
+  return std::string(LastPathComponent(ExtractBaseName(name)));
+}
+
+void BuildContractFunctionIndex(lldb::SBModule &module,
+                                ContractFunctionIndex &index) {
+  index.functions.clear();
+  index.by_base_name.clear();
+
+  size_t num_symbols = module.GetNumSymbols();
+  for (size_t i = 0; i < num_symbols; ++i) {
+    lldb::SBSymbol symbol = module.GetSymbolAtIndex(i);
+    if (!symbol.IsValid() || symbol.GetType() != lldb::eSymbolTypeCode)
+      continue;
+    const char *name = symbol.GetName();
+    if (!name || !*name)
+      continue;
+    const char *mangled = symbol.GetMangledName();
+
+    ContractFunction fn;
+    fn.name = std::string(StripRustHash(name));
+    fn.symbol = mangled ? mangled : name;
+    index.by_base_name.emplace(BaseName(fn.name), index.functions.size());
+    index.functions.push_back(std::move(fn));
+  }
+}
+
+static std::vector<std::regex>
+CompileRequestPatterns(const ContractBreakpointRequest &request);
+static lldb::SBBreakpoint
+CreateContractBreakpoint(lldb::SBTarget &target, ContractInfo &info,
+                         const ContractBreakpointRequest &request,
+                         const std::vector<std::regex> &regexes,
+                         std::vector<bool> &function_found,
+                         std::vector<const std::string *> &matched_names);
+
+// An address registered again keeps its breakpoints: the ones already created
+// are deleted from the target and their requests returned, together with the
+// requests still pending, to be resolved against the new library.
+static std::vector<ContractBreakpointRequest>
+TakeBreakpointRequests(lldb::SBTarget &target, ContractInfo &info) {
+  std::vector<ContractBreakpointRequest> requests;
+  requests.swap(info.pending_breakpoints);
+  for (ContractBreakpoint &cb : info.breakpoints) {
+    target.BreakpointDelete(cb.bp.GetID());
+    requests.push_back(std::move(cb.request));
+  }
+  info.breakpoints.clear();
+  return requests;
+}
+
+static void RegisterContract(lldb::SBTarget &target, const ContractAddress &key,
+                             const std::string &library_path,
+                             lldb::SBModule module,
+                             ContractFunctionIndex functions) {
+  std::unique_lock<std::shared_mutex> registry_lk(g_contract_registry_mutex);
+  ContractInfo &info = g_contract_registry[key];
+  // Set once: trace records keep views of the address, so an entry that is
+  // registered again must not reallocate it
+  if (info.address.empty())
+    info.address = FormatContractAddress(key);
+  info.library_path = library_path;
+  info.module = module;
+  info.functions = std::move(functions);
+  info.lazy = false;
+  info.build_id.clear();
+  registry_lk.unlock();
+  InvalidateContractIndex();
+
+  std::vector<ContractBreakpointRequest> requests =
+      TakeBreakpointRequests(target, info);
+
+  for (const auto &request : requests) {
+    std::vector<bool> function_found(request.functions.size(), false);
+    std::vector<const std::string *> matched_names;
+    CreateContractBreakpoint(target, info, request,
+                             CompileRequestPatterns(request), function_found,
+                             matched_names);
+  }
+  EnableContractContextTracking(target);
+}
+
+// Reads the build-id from the library's headers without parsing its symbols
+static bool ReadLibraryBuildId(const std::string &library_path,
+                               std::vector<uint8_t> &build_id) {
+  lldb::SBModuleSpecList specs =
+      lldb::SBModuleSpecList::GetModuleSpecifications(library_path.c_str());
+  if (specs.GetSize() == 0)
+    return false;
+  lldb::SBModuleSpec spec = specs.GetSpecAtIndex(0);
+  const uint8_t *bytes = spec.GetUUIDBytes();
+  size_t len = spec.GetUUIDLength();
+  build_id.assign(bytes, bytes + (bytes ? len : 0));
+  return true;
+}
+
+static void RegisterLazyContract(lldb::SBTarget &target,
+                                 const ContractAddress &key,
+                                 const std::string &library_path,
+                                 std::vector<uint8_t> build_id) {
+  std::unique_lock<std::shared_mutex> registry_lk(g_contract_registry_mutex);
+  ContractInfo &info = g_contract_registry[key];
+  if (info.address.empty())
+    info.address = FormatContractAddress(key);
+  info.library_path = library_path;
+  info.module = lldb::SBModule();
+  info.functions = ContractFunctionIndex();
+  info.lazy = true;
+  info.build_id = std::move(build_id);
+  registry_lk.unlock();
+  InvalidateContractIndex();
+
+  // Resolved with the rest once the new library is loaded
+  info.pending_breakpoints = TakeBreakpointRequests(target, info);
+  // Entry into the contract is what triggers loading it, either through a
+  // cross-contract call or, once the caller updates the lazy entry
+  // breakpoint, as the transaction's root
+  EnableContractContextTracking(target);
+}
+
 // Command: "stylus-contract add <address> <library_path>"
 bool WalnutContractAddCommand::DoExecute(lldb::SBDebugger debugger, char **command,
                                          lldb::SBCommandReturnObject &result) {
+  bool lazy = command && command[0] && std::strcmp(command[0], "--lazy") == 0;
+  if (lazy)
+    ++command;
+
   if (!command || !command[0] || !command[1]) {
-    result.Printf("Usage: stylus-contract add <address> <library_path>\n");
+    result.Printf("Usage: stylus-contract add [--lazy] <address> <library_path>\n");
     result.SetStatus(lldb::eReturnStatusFailed);
     return false;
   }
@@ -56,6 +495,13 @@ bool WalnutContractAddCommand::DoExecute(lldb::SBDebugger debugger, char **comma
   std::string address = command[0];
   std::string library_path = command[1];
 
+  ContractAddress key;
+  if (!ParseContractAddress(address, key)) {
+    result.Printf("Invalid contract address: %s\n", address.c_str());
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
   lldb::SBTarget target = debugger.GetSelectedTarget();
   if (!target.IsValid()) {
     result.Printf("No valid target\n");
@@ -63,6 +509,21 @@ bool WalnutContractAddCommand::DoExecute(lldb::SBDebugger debugger, char **comma
     return false;
   }
 
+  if (lazy) {
+    std::vector<uint8_t> build_id;
+    if (!ReadLibraryBuildId(library_path, build_id)) {
+      result.Printf("Failed to read module from: %s\n", library_path.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    RegisterLazyContract(target, key, library_path, std::move(build_id));
+    UpdateLazyEntryBreakpoint(target);
+    result.Printf("Added contract %s with library %s (lazy)\n",
+                  FormatContractAddress(key).c_str(), library_path.c_str());
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
   // Add the module to the target
   lldb::SBModule module = target.AddModule(library_path.c_str(), nullptr, nullptr);
   if (!module.IsValid()) {
@@ -71,32 +532,145 @@ bool WalnutContractAddCommand::DoExecute(lldb::SBDebugger debugger, char **comma
     return false;
   }
 
-  // Store in registry
-  ContractInfo info;
-  info.library_path = library_path;
-  info.module = module;
-  g_contract_registry[address] = info;
+  ContractFunctionIndex functions;
+  BuildContractFunctionIndex(module, functions);
+  RegisterContract(target, key, library_path, module, std::move(functions));
 
-  result.Printf("Added contract %s with library %s\n", address.c_str(), library_path.c_str());
+  result.Printf("Added contract %s with library %s\n",
+                FormatContractAddress(key).c_str(), library_path.c_str());
   result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
   return true;
 }
 
-// Command: "stylus-contract breakpoint <address> <function>"
-bool WalnutContractBreakpointCommand::DoExecute(lldb::SBDebugger debugger, char **command,
-                                                lldb::SBCommandReturnObject &result) {
-  if (!command || !command[0] || !command[1]) {
-    result.Printf("Usage: stylus-contract breakpoint <address> <function>\n");
-    result.SetStatus(lldb::eReturnStatusFailed);
+// Command: "stylus-contract add-many [--lazy] <manifest | address=library_path>..."
+//
+// Each argument is either an inline "address=library_path" pair or a manifest
+// file with one "address library_path" (or "address=library_path") per line;
+// blank lines and lines starting with '#' are ignored. The libraries are
+// opened and their symbol tables and debug info indexed on worker threads,
+// then attached to the target in order. With --lazy nothing is loaded until
+// each contract is first entered.
+struct ContractManifestEntry {
+  std::string address_text;
+  std::string library_path;
+  ContractAddress key;
+  bool has_build_id = false;
+  std::vector<uint8_t> build_id;
+  lldb::SBModule module;
+  ContractFunctionIndex functions;
+};
+
+// "<address>=<library>" on the command line, as opposed to a manifest path,
+// which may contain '=' itself
+static bool IsInlineContractSpec(const char *arg) {
+  const char *sep = std::strchr(arg, '=');
+  ContractAddress key;
+  return sep && ParseContractAddress(std::string(arg, sep), key);
+}
+
+static bool SplitManifestEntry(const std::string &line,
+                               ContractManifestEntry &entry) {
+  size_t sep = line.find('=');
+  if (sep == std::string::npos)
+    sep = line.find_first_of(" \t");
+  if (sep == std::string::npos)
+    return false;
+
+  entry.address_text = line.substr(0, sep);
+  entry.library_path = line.substr(sep + 1);
+  entry.library_path.erase(0, entry.library_path.find_first_not_of(" \t"));
+  entry.library_path.erase(entry.library_path.find_last_not_of(" \t\r") + 1);
+  return !entry.address_text.empty() && !entry.library_path.empty();
+}
+
+static bool ReadContractManifest(const char *path,
+                                 std::vector<ContractManifestEntry> &entries,
+                                 lldb::SBCommandReturnObject &result) {
+  std::ifstream in(path);
+  if (!in) {
+    result.Printf("Failed to open manifest: %s\n", path);
     return false;
   }
 
-  std::string address = command[0];
-  std::string function = command[1];
+  std::string line;
+  unsigned line_num = 0;
+  while (std::getline(in, line)) {
+    ++line_num;
+    line.erase(0, line.find_first_not_of(" \t"));
+    if (line.empty() || line[0] == '#' || line[0] == '\r')
+      continue;
+    ContractManifestEntry entry;
+    if (!SplitManifestEntry(line, entry)) {
+      result.Printf("%s:%u: expected '<address> <library_path>'\n", path,
+                    line_num);
+      return false;
+    }
+    entries.push_back(std::move(entry));
+  }
+  return true;
+}
 
-  auto it = g_contract_registry.find(address);
-  if (it == g_contract_registry.end()) {
-    result.Printf("Contract %s not found. Use 'stylus-contract add' first.\n", address.c_str());
+// Runs fn(entry) for every entry on up to hardware_concurrency threads
+template <typename Fn>
+static void ForEachEntryInParallel(std::vector<ContractManifestEntry> &entries,
+                                   Fn fn) {
+  unsigned num_workers = std::max(1u, std::thread::hardware_concurrency());
+  num_workers = std::min<unsigned>(num_workers, entries.size());
+
+  std::atomic<size_t> next{0};
+  auto worker = [&]() {
+    for (size_t i = next++; i < entries.size(); i = next++)
+      fn(entries[i]);
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 1; i < num_workers; ++i)
+    threads.emplace_back(worker);
+  worker();
+  for (auto &t : threads)
+    t.join();
+}
+
+static void ReadBuildIdsInParallel(std::vector<ContractManifestEntry> &entries) {
+  ForEachEntryInParallel(entries, [](ContractManifestEntry &entry) {
+    entry.has_build_id = ReadLibraryBuildId(entry.library_path, entry.build_id);
+  });
+}
+
+// Reads every library's build-id in parallel, attaches the modules to the
+// target from the command thread (its module list is not safe to mutate
+// concurrently), then parses their compile units and builds their function
+// indexes in parallel, each worker on its own module.
+static void LoadContractModulesInParallel(
+    lldb::SBTarget &target, std::vector<ContractManifestEntry> &entries) {
+  ReadBuildIdsInParallel(entries);
+
+  for (auto &entry : entries) {
+    if (!entry.has_build_id)
+      continue;
+    lldb::SBModuleSpec spec;
+    spec.SetFileSpec(lldb::SBFileSpec(entry.library_path.c_str(), true));
+    if (!entry.build_id.empty())
+      spec.SetUUIDBytes(entry.build_id.data(), entry.build_id.size());
+    entry.module = target.AddModule(spec);
+  }
+
+  ForEachEntryInParallel(entries, [](ContractManifestEntry &entry) {
+    if (!entry.module.IsValid())
+      return;
+    entry.module.GetNumCompileUnits();
+    BuildContractFunctionIndex(entry.module, entry.functions);
+  });
+}
+
+bool WalnutContractAddManyCommand::DoExecute(lldb::SBDebugger debugger, char **command,
+                                             lldb::SBCommandReturnObject &result) {
+  bool lazy = command && command[0] && std::strcmp(command[0], "--lazy") == 0;
+  if (lazy)
+    ++command;
+
+  if (!command || !command[0]) {
+    result.Printf("Usage: stylus-contract add-many [--lazy] <manifest | address=library_path>...\n");
     result.SetStatus(lldb::eReturnStatusFailed);
     return false;
   }
@@ -108,37 +682,530 @@ bool WalnutContractBreakpointCommand::DoExecute(lldb::SBDebugger debugger, char
     return false;
   }
 
-  // Create breakpoint specific to the module
+  std::vector<ContractManifestEntry> entries;
+  for (int i = 0; command[i]; ++i) {
+    if (IsInlineContractSpec(command[i])) {
+      ContractManifestEntry entry;
+      if (!SplitManifestEntry(command[i], entry)) {
+        result.Printf("Invalid contract spec: %s\n", command[i]);
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+      entries.push_back(std::move(entry));
+    } else if (!ReadContractManifest(command[i], entries, result)) {
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+  }
+
+  for (auto &entry : entries) {
+    if (!ParseContractAddress(entry.address_text, entry.key)) {
+      result.Printf("Invalid contract address: %s\n", entry.address_text.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+  }
+
+  if (lazy)
+    ReadBuildIdsInParallel(entries);
+  else
+    LoadContractModulesInParallel(target, entries);
+
+  size_t added = 0;
+  for (auto &entry : entries) {
+    std::string address = FormatContractAddress(entry.key);
+    if (lazy) {
+      if (!entry.has_build_id) {
+        result.Printf("Failed to read module for %s from: %s\n", address.c_str(),
+                      entry.library_path.c_str());
+        continue;
+      }
+      RegisterLazyContract(target, entry.key, entry.library_path,
+                           std::move(entry.build_id));
+      result.Printf("Added contract %s with library %s (lazy)\n",
+                    address.c_str(), entry.library_path.c_str());
+      ++added;
+      continue;
+    }
+    if (!entry.module.IsValid()) {
+      result.Printf("Failed to load module for %s from: %s\n", address.c_str(),
+                    entry.library_path.c_str());
+      continue;
+    }
+    RegisterContract(target, entry.key, entry.library_path, entry.module,
+                     std::move(entry.functions));
+    result.Printf("Added contract %s with library %s\n", address.c_str(),
+                  entry.library_path.c_str());
+    ++added;
+  }
+  if (lazy)
+    UpdateLazyEntryBreakpoint(target);
+
+  result.Printf("Registered %zu of %zu contracts\n", added, entries.size());
+  result.SetStatus(added == entries.size() ? lldb::eReturnStatusSuccessFinishResult
+                                           : lldb::eReturnStatusFailed);
+  return added == entries.size();
+}
+
+// Command: "stylus-contract breakpoint <address[,address...]|all> <function>... | -r <regex>"
+//
+// Function names are resolved against each contract's function index: a name
+// matches a function whose demangled name equals it or ends in "::<name>".
+// Every contract gets a single breakpoint, restricted to its own module, that
+// covers all of its matched functions.
+static void SplitList(const char *arg, std::vector<std::string> &out) {
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ','))
+    if (!item.empty())
+      out.push_back(item);
+}
+
+static bool NameMatches(const std::string &name, const std::string &request) {
+  if (name.size() == request.size())
+    return name == request;
+  return name.size() > request.size() + 2 &&
+         name.compare(name.size() - request.size(), request.size(), request) == 0 &&
+         name.compare(name.size() - request.size() - 2, 2, "::") == 0;
+}
+
+// Patterns are validated when the request is made, so this cannot throw for
+// a stored request
+static std::vector<std::regex>
+CompileRequestPatterns(const ContractBreakpointRequest &request) {
+  std::vector<std::regex> regexes;
+  for (const auto &pattern : request.patterns)
+    regexes.emplace_back(pattern);
+  return regexes;
+}
+
+// One breakpoint on every function of `info` matching the request; `regexes`
+// are its compiled patterns. matched_names lists the functions covered; when
+// it is empty no breakpoint was created.
+static lldb::SBBreakpoint
+CreateContractBreakpoint(lldb::SBTarget &target, ContractInfo &info,
+                         const ContractBreakpointRequest &request,
+                         const std::vector<std::regex> &regexes,
+                         std::vector<bool> &function_found,
+                         std::vector<const std::string *> &matched_names) {
+  const std::vector<std::string> &functions = request.functions;
+  const ContractFunctionIndex &index = info.functions;
+  // Ordered so the breakpoint's name list is stable across runs
+  std::set<std::string> symbols;
+
+  for (size_t f = 0; f < functions.size(); ++f) {
+    auto range = index.by_base_name.equal_range(BaseName(functions[f]));
+    for (auto it = range.first; it != range.second; ++it) {
+      const ContractFunction &fn = index.functions[it->second];
+      if (!NameMatches(fn.name, functions[f]))
+        continue;
+      function_found[f] = true;
+      if (symbols.insert(fn.symbol).second)
+        matched_names.push_back(&fn.name);
+    }
+  }
+  for (const auto &re : regexes) {
+    for (const ContractFunction &fn : index.functions) {
+      if (std::regex_search(fn.name, re) && symbols.insert(fn.symbol).second)
+        matched_names.push_back(&fn.name);
+    }
+  }
+
+  if (symbols.empty())
+    return lldb::SBBreakpoint();
+
+  std::vector<const char *> names;
+  names.reserve(symbols.size());
+  for (const auto &symbol : symbols)
+    names.push_back(symbol.c_str());
+
   lldb::SBFileSpecList module_list;
-  module_list.Append(it->second.module.GetFileSpec());
-  
-  lldb::SBBreakpoint bp = target.BreakpointCreateByName(
-      function.c_str(),
-      module_list,
-      lldb::SBFileSpecList() // comp_unit_list
-  );
-
-  if (!bp.IsValid() || bp.GetNumLocations() == 0) {
-    // Try setting a pending breakpoint without module restriction
-    bp = target.BreakpointCreateByName(function.c_str());
-    
+  module_list.Append(info.module.GetFileSpec());
+  lldb::SBBreakpoint bp = target.BreakpointCreateByNames(
+      names.data(), names.size(), lldb::eFunctionNameTypeFull, module_list,
+      lldb::SBFileSpecList());
+  if (bp.IsValid())
+    info.breakpoints.push_back(
+        {bp, request, std::vector<std::string>(symbols.begin(), symbols.end())});
+  return bp;
+}
+
+// Loads a lazily registered contract: attaches its module (or picks up the
+// copy the process already loaded), builds its function index and resolves
+// the breakpoints requested while it was pending. Runs at most once.
+static void ActivateLazyContract(lldb::SBTarget &target, ContractInfo &info) {
+  info.lazy = false;
+
+  lldb::SBFileSpec file(info.library_path.c_str(), true);
+  lldb::SBModule module = target.FindModule(file);
+  if (!module.IsValid()) {
+    lldb::SBModuleSpec spec;
+    spec.SetFileSpec(file);
+    // Refuse a library rebuilt since registration
+    if (!info.build_id.empty())
+      spec.SetUUIDBytes(info.build_id.data(), info.build_id.size());
+    module = target.AddModule(spec);
+  }
+  if (!module.IsValid()) {
+    std::fprintf(stderr, "stylus-contract: failed to load %s for contract %s\n",
+                 info.library_path.c_str(), info.address.c_str());
+    info.pending_breakpoints.clear();
+    return;
+  }
+
+  {
+    std::unique_lock<std::shared_mutex> registry_lk(g_contract_registry_mutex);
+    info.module = module;
+  }
+  BuildContractFunctionIndex(module, info.functions);
+  InvalidateContractIndex();
+
+  for (const auto &pending : info.pending_breakpoints) {
+    std::vector<bool> function_found(pending.functions.size(), false);
+    std::vector<const std::string *> matched_names;
+    CreateContractBreakpoint(target, info, pending,
+                             CompileRequestPatterns(pending), function_found,
+                             matched_names);
+  }
+  info.pending_breakpoints.clear();
+}
+
+bool WalnutContractBreakpointCommand::DoExecute(lldb::SBDebugger debugger, char **command,
+                                                lldb::SBCommandReturnObject &result) {
+  std::vector<std::string> addresses;
+  std::vector<std::string> functions;
+  std::vector<std::string> patterns;
+  for (int i = 0; command && command[i]; ++i) {
+    std::string arg = command[i];
+    if (arg == "-r" || arg == "--regex") {
+      if (!command[i + 1]) {
+        result.Printf("Missing pattern after %s\n", arg.c_str());
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+      patterns.push_back(command[++i]);
+    } else if (addresses.empty()) {
+      SplitList(command[i], addresses);
+    } else {
+      functions.push_back(arg);
+    }
+  }
+
+  if (addresses.empty() || (functions.empty() && patterns.empty())) {
+    result.Printf("Usage: stylus-contract breakpoint <address[,address...]|all> <function>...\n");
+    result.Printf("       stylus-contract breakpoint <address[,address...]|all> -r <regex>\n");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  lldb::SBTarget target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No valid target\n");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  std::vector<std::regex> regexes;
+  for (const auto &pattern : patterns) {
+    try {
+      regexes.emplace_back(pattern);
+    } catch (const std::regex_error &e) {
+      result.Printf("Invalid regex '%s': %s\n", pattern.c_str(), e.what());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+  }
+
+  std::vector<ContractInfo *> contracts;
+  if (addresses.size() == 1 && addresses[0] == "all") {
+    for (auto &[key, info] : g_contract_registry)
+      contracts.push_back(&info);
+    std::sort(contracts.begin(), contracts.end(),
+              [](const ContractInfo *a, const ContractInfo *b) {
+                return a->address < b->address;
+              });
+  } else {
+    for (const auto &address : addresses) {
+      ContractAddress key;
+      if (!ParseContractAddress(address, key)) {
+        result.Printf("Invalid contract address: %s\n", address.c_str());
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+      auto it = g_contract_registry.find(key);
+      if (it == g_contract_registry.end()) {
+        result.Printf("Contract %s not found. Use 'stylus-contract add' first.\n",
+                      address.c_str());
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+      contracts.push_back(&it->second);
+    }
+  }
+
+  ContractBreakpointRequest request{functions, patterns};
+  std::vector<bool> function_found(functions.size(), false);
+  size_t total_functions = 0;
+  size_t total_breakpoints = 0;
+  bool any_pending = false;
+  for (ContractInfo *info : contracts) {
+    if (info->lazy) {
+      info->pending_breakpoints.push_back(request);
+      result.Printf("Breakpoint on %zu names in contract %s pending (resolves when the contract is first entered)\n",
+                    functions.size() + patterns.size(), info->address.c_str());
+      any_pending = true;
+      continue;
+    }
+
+    std::vector<const std::string *> matched_names;
+    lldb::SBBreakpoint bp = CreateContractBreakpoint(
+        target, *info, request, regexes, function_found, matched_names);
+    if (matched_names.empty())
+      continue;
     if (!bp.IsValid()) {
-      result.Printf("Warning: Could not set breakpoint on %s in contract %s (function may not exist)\n", 
-                    function.c_str(), address.c_str());
-      // Return success anyway to allow subsequent commands to run
-      result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+      result.Printf("Warning: Could not set breakpoint in contract %s\n",
+                    info->address.c_str());
+      continue;
+    }
+
+    if (matched_names.size() == 1)
+      result.Printf("Set breakpoint on %s in contract %s (ID: %d, %zu locations)\n",
+                    matched_names[0]->c_str(), info->address.c_str(), bp.GetID(),
+                    bp.GetNumLocations());
+    else
+      result.Printf("Set breakpoint on %zu functions in contract %s (ID: %d, %zu locations)\n",
+                    matched_names.size(), info->address.c_str(), bp.GetID(),
+                    bp.GetNumLocations());
+    total_functions += matched_names.size();
+    ++total_breakpoints;
+  }
+
+  // Pending contracts may still define the names that matched nowhere else
+  for (size_t f = 0; f < functions.size() && !any_pending; ++f) {
+    if (!function_found[f])
+      result.Printf("Warning: No function %s in the selected contracts\n",
+                    functions[f].c_str());
+  }
+  if (total_breakpoints > 1)
+    result.Printf("%zu functions in %zu contracts\n", total_functions,
+                  total_breakpoints);
+  else if (total_breakpoints == 0 && !any_pending)
+    result.Printf("Warning: No breakpoints set\n");
+
+  // Return success even when nothing matched so subsequent commands still run
+  result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+// Command: "stylus-contract reload <address> [library_path]"
+//
+// Swaps a contract's module for a rebuilt library. Functions are compared by
+// symbol name, address, size and code bytes; only breakpoints that covered a
+// function that moved, changed or disappeared, or whose request now matches a
+// new function, are deleted and re-created. The rest keep their IDs,
+// conditions and commands and simply re-resolve by name in the new module.
+struct FunctionFingerprint {
+  lldb::addr_t file_addr;
+  uint64_t size;
+  uint64_t hash;
+
+  bool operator==(const FunctionFingerprint &other) const {
+    return file_addr == other.file_addr && size == other.size &&
+           hash == other.hash;
+  }
+};
+
+static void
+FingerprintFunctions(lldb::SBModule &module,
+                     std::unordered_map<std::string, FunctionFingerprint> &out) {
+  // Each section's contents are read once and sliced per function
+  std::unordered_map<lldb::addr_t, std::vector<uint8_t>> section_bytes;
+
+  size_t num_symbols = module.GetNumSymbols();
+  for (size_t i = 0; i < num_symbols; ++i) {
+    lldb::SBSymbol symbol = module.GetSymbolAtIndex(i);
+    if (!symbol.IsValid() || symbol.GetType() != lldb::eSymbolTypeCode)
+      continue;
+    const char *mangled = symbol.GetMangledName();
+    const char *name = mangled ? mangled : symbol.GetName();
+    if (!name || !*name)
+      continue;
+
+    lldb::SBAddress start = symbol.GetStartAddress();
+    lldb::SBSection section = start.GetSection();
+    FunctionFingerprint fp{start.GetFileAddress(), symbol.GetSize(),
+                           1469598103934665603ull};
+    if (section.IsValid()) {
+      auto it = section_bytes.find(section.GetFileAddress());
+      if (it == section_bytes.end()) {
+        std::vector<uint8_t> bytes;
+        lldb::SBData data = section.GetSectionData();
+        lldb::SBError err;
+        bytes.resize(data.GetByteSize());
+        if (bytes.size() &&
+            data.ReadRawData(err, 0, bytes.data(), bytes.size()) != bytes.size())
+          bytes.clear();
+        it = section_bytes.emplace(section.GetFileAddress(), std::move(bytes)).first;
+      }
+      uint64_t offset = start.GetOffset();
+      const std::vector<uint8_t> &bytes = it->second;
+      // FNV-1a over the function's code
+      for (uint64_t b = offset; b < offset + fp.size && b < bytes.size(); ++b) {
+        fp.hash ^= bytes[b];
+        fp.hash *= 1099511628211ull;
+      }
+    }
+    out[name] = fp;
+  }
+}
+
+static bool RequestMatchesName(const ContractBreakpointRequest &request,
+                               const std::vector<std::regex> &regexes,
+                               const std::string &name) {
+  for (const auto &function : request.functions)
+    if (NameMatches(name, function))
       return true;
+  for (const auto &re : regexes)
+    if (std::regex_search(name, re))
+      return true;
+  return false;
+}
+
+bool WalnutContractReloadCommand::DoExecute(lldb::SBDebugger debugger, char **command,
+                                            lldb::SBCommandReturnObject &result) {
+  if (!command || !command[0]) {
+    result.Printf("Usage: stylus-contract reload <address> [library_path]\n");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  ContractAddress key;
+  if (!ParseContractAddress(command[0], key)) {
+    result.Printf("Invalid contract address: %s\n", command[0]);
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+  auto entry = g_contract_registry.find(key);
+  if (entry == g_contract_registry.end()) {
+    result.Printf("Contract %s not found. Use 'stylus-contract add' first.\n", command[0]);
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+  ContractInfo &info = entry->second;
+  std::string library_path = command[1] ? command[1] : info.library_path;
+
+  lldb::SBTarget target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No valid target\n");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  std::vector<uint8_t> build_id;
+  if (!ReadLibraryBuildId(library_path, build_id)) {
+    result.Printf("Failed to read module from: %s\n", library_path.c_str());
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  // Nothing is loaded yet; the new library is picked up on first entry
+  if (info.lazy) {
+    info.library_path = library_path;
+    info.build_id = std::move(build_id);
+    result.Printf("Contract %s is not loaded yet; will load %s on first entry\n",
+                  info.address.c_str(), library_path.c_str());
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  lldb::SBModuleSpec spec;
+  spec.SetFileSpec(lldb::SBFileSpec(library_path.c_str(), true));
+  spec.SetUUIDBytes(build_id.data(), build_id.size());
+  lldb::SBModule new_module(spec);
+  if (!new_module.IsValid()) {
+    result.Printf("Failed to load module from: %s\n", library_path.c_str());
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  std::unordered_map<std::string, FunctionFingerprint> old_functions;
+  std::unordered_map<std::string, FunctionFingerprint> new_functions;
+  if (info.module.IsValid())
+    FingerprintFunctions(info.module, old_functions);
+  FingerprintFunctions(new_module, new_functions);
+
+  std::unordered_set<std::string> changed; // Moved, modified or removed
+  std::unordered_set<std::string> added;
+  for (const auto &[name, fp] : old_functions) {
+    auto it = new_functions.find(name);
+    if (it == new_functions.end() || !(it->second == fp))
+      changed.insert(name);
+  }
+  for (const auto &[name, fp] : new_functions)
+    if (!old_functions.count(name))
+      added.insert(name);
+
+  if (info.module.IsValid())
+    target.RemoveModule(info.module);
+  if (!target.AddModule(new_module)) {
+    result.Printf("Failed to add module %s to the target\n", library_path.c_str());
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  // A breakpoint's module filter is the library path, so a new path means
+  // every breakpoint has to be re-created
+  bool path_changed = library_path != info.library_path;
+  {
+    std::unique_lock<std::shared_mutex> registry_lk(g_contract_registry_mutex);
+    info.module = new_module;
+  }
+  info.library_path = library_path;
+  info.build_id = std::move(build_id);
+  BuildContractFunctionIndex(new_module, info.functions);
+  InvalidateContractIndex();
+
+  std::vector<const std::string *> added_names;
+  for (const ContractFunction &fn : info.functions.functions)
+    if (added.count(fn.symbol))
+      added_names.push_back(&fn.name);
+
+  std::vector<ContractBreakpoint> old_breakpoints;
+  old_breakpoints.swap(info.breakpoints);
+  size_t reresolved = 0;
+  for (ContractBreakpoint &cb : old_breakpoints) {
+    std::vector<std::regex> regexes = CompileRequestPatterns(cb.request);
+    bool stale = path_changed;
+    for (size_t i = 0; i < cb.symbols.size() && !stale; ++i)
+      stale = changed.count(cb.symbols[i]) > 0;
+    for (size_t i = 0; i < added_names.size() && !stale; ++i)
+      stale = RequestMatchesName(cb.request, regexes, *added_names[i]);
+
+    if (!stale) {
+      info.breakpoints.push_back(std::move(cb));
+      continue;
     }
-    
-    result.Printf("Warning: Set pending breakpoint on %s for contract %s (will resolve when loaded)\n", 
-                  function.c_str(), address.c_str());
+
+    target.BreakpointDelete(cb.bp.GetID());
+    std::vector<bool> function_found(cb.request.functions.size(), false);
+    std::vector<const std::string *> matched_names;
+    CreateContractBreakpoint(target, info, cb.request, regexes, function_found,
+                             matched_names);
+    ++reresolved;
   }
 
-  // Store breakpoint reference
-  it->second.breakpoints.push_back(bp);
+  result.Printf("Reloaded contract %s from %s\n", info.address.c_str(),
+                library_path.c_str());
+  result.Printf("  %zu functions changed or removed, %zu added\n", changed.size(),
+                added.size());
+  result.Printf("  %zu of %zu breakpoints re-resolved\n", reresolved,
+                old_breakpoints.size());
+
+  lldb::SBProcess process = target.GetProcess();
+  if (process.IsValid() && process.GetState() != lldb::eStateExited)
+    result.Printf("Note: the running process still executes the old code; "
+                  "restart it to run the rebuilt contract\n");
 
-  result.Printf("Set breakpoint on %s in contract %s (ID: %d, %zu locations)\n", 
-                function.c_str(), address.c_str(), bp.GetID(), bp.GetNumLocations());
   result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
   return true;
 }
@@ -149,12 +1216,27 @@ bool WalnutContractListCommand::DoExecute(lldb::SBDebugger debugger, char **comm
   if (g_contract_registry.empty()) {
     result.Printf("No contracts registered\n");
   } else {
+    // The registry is hashed; list in address order for stable output
+    std::vector<const ContractInfo *> sorted;
+    sorted.reserve(g_contract_registry.size());
+    for (const auto& [key, info] : g_contract_registry)
+      sorted.push_back(&info);
+    std::sort(sorted.begin(), sorted.end(),
+              [](const ContractInfo *a, const ContractInfo *b) {
+                return a->address < b->address;
+              });
+
     result.Printf("Registered contracts:\n");
-    for (const auto& [addr, info] : g_contract_registry) {
-      result.Printf("  %s -> %s (%zu breakpoints)\n", 
-                    addr.c_str(), 
-                    info.library_path.c_str(),
-                    info.breakpoints.size());
+    for (const ContractInfo *info : sorted) {
+      if (info->lazy)
+        result.Printf("  %s -> %s (not loaded, %zu pending breakpoints)\n",
+                      info->address.c_str(), info->library_path.c_str(),
+                      info->pending_breakpoints.size());
+      else
+        result.Printf("  %s -> %s (%zu breakpoints)\n", 
+                      info->address.c_str(), 
+                      info->library_path.c_str(),
+                      info->breakpoints.size());
     }
   }
   
@@ -178,11 +1260,81 @@ bool WalnutContractStackCommand::DoExecute(lldb::SBDebugger debugger, char **com
   if (!g_current_context.empty()) {
     result.Printf("Current context: %s\n", g_current_context.c_str());
   }
+
+  // Attribute each frame of the selected thread to its contract
+  lldb::SBTarget target = debugger.GetSelectedTarget();
+  lldb::SBProcess process = target.IsValid() ? target.GetProcess() : lldb::SBProcess();
+  if (process.IsValid() && process.GetState() == lldb::eStateStopped) {
+    lldb::SBThread thread = process.GetSelectedThread();
+    uint32_t num_frames = thread.GetNumFrames();
+    result.Printf("Frames:\n");
+    for (uint32_t i = 0; i < num_frames; ++i) {
+      lldb::SBFrame frame = thread.GetFrameAtIndex(i);
+      const char *fn = frame.GetFunctionName();
+      const std::string *contract = LookupContractByPC(target, frame.GetPC());
+      result.Printf("  #%u 0x%016llx %s [%s]\n", i,
+                    (unsigned long long)frame.GetPC(), fn ? fn : "<unknown>",
+                    contract ? contract->c_str() : "-");
+    }
+  }
   
   result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
   return true;
 }
 
+// Command: "stylus-contract activate [address...]"
+// Without addresses, activates the lazy contracts whose entrypoint was hit;
+// the stop hook installed with the lazy entry breakpoint runs it on each stop.
+bool WalnutContractActivateCommand::DoExecute(lldb::SBDebugger debugger, char **command,
+                                              lldb::SBCommandReturnObject &result) {
+  lldb::SBTarget target = debugger.GetSelectedTarget();
+  if (!target.IsValid()) {
+    result.Printf("No valid target\n");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  std::vector<ContractAddress> keys;
+  bool explicit_keys = command && command[0];
+  if (explicit_keys) {
+    for (int i = 0; command[i]; ++i) {
+      ContractAddress key;
+      if (!ParseContractAddress(command[i], key)) {
+        result.Printf("Invalid contract address: %s\n", command[i]);
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+      keys.push_back(key);
+    }
+  } else {
+    std::lock_guard<std::mutex> lk(g_pending_activations_mutex);
+    keys.swap(g_pending_activations);
+  }
+
+  for (const ContractAddress &key : keys) {
+    auto it = g_contract_registry.find(key);
+    if (it == g_contract_registry.end() || !it->second.lazy) {
+      if (explicit_keys)
+        result.Printf("Contract %s is not a pending lazy contract\n",
+                      FormatContractAddress(key).c_str());
+      continue;
+    }
+    ActivateLazyContract(target, it->second);
+    if (it->second.module.IsValid())
+      result.Printf("Loaded contract %s from %s\n", it->second.address.c_str(),
+                    it->second.library_path.c_str());
+  }
+
+  bool any_lazy = false;
+  for (const auto &[addr, info] : g_contract_registry)
+    any_lazy |= info.lazy;
+  if (!any_lazy && g_lazy_entry_bp.IsValid())
+    g_lazy_entry_bp.SetEnabled(false);
+
+  result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+  return true;
+}
+
 // Command: "stylus-contract context <address>"
 bool WalnutContractContextCommand::DoExecute(lldb::SBDebugger debugger, char **command,
                                              lldb::SBCommandReturnObject &result) {
@@ -206,8 +1358,14 @@ bool WalnutContractContextCommand::DoExecute(lldb::SBDebugger debugger, char **c
   }
 
   // Switch to specified context
-  std::string address = arg;
-  auto it = g_contract_registry.find(address);
+  ContractAddress key;
+  if (!ParseContractAddress(arg, key)) {
+    result.Printf("Invalid contract address: %s\n", arg.c_str());
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+  std::string address = FormatContractAddress(key);
+  auto it = g_contract_registry.find(key);
   if (it == g_contract_registry.end()) {
     result.Printf("Contract %s not found. Use 'stylus-contract add' first.\n", address.c_str());
     result.SetStatus(lldb::eReturnStatusFailed);
@@ -223,6 +1381,10 @@ bool WalnutContractContextCommand::DoExecute(lldb::SBDebugger debugger, char **c
 
   // Set the current context
   g_current_context = address;
+
+  // Focusing a contract needs its symbols
+  if (it->second.lazy)
+    ActivateLazyContract(target, it->second);
   
   // Try to focus on the module in the debugger
   lldb::SBModule module = it->second.module;
@@ -251,24 +1413,49 @@ bool RegisterWalnutContractCommands(lldb::SBCommandInterpreter &interpreter) {
   {
     auto *add_iface = new WalnutContractAddCommand();
     lldb::SBCommand add_cmd = contract_cmd.AddCommand(
-        "add", add_iface, "Add a contract: stylus-contract add <address> <library_path>");
+        "add", add_iface, "Add a contract: stylus-contract add [--lazy] <address> <library_path>");
     if (!add_cmd.IsValid()) {
       std::fprintf(stderr, "Failed to register 'stylus-contract add'\n");
       return false;
     }
   }
 
+  // Subcommand: "stylus-contract add-many"
+  {
+    auto *add_many_iface = new WalnutContractAddManyCommand();
+    lldb::SBCommand add_many_cmd = contract_cmd.AddCommand(
+        "add-many", add_many_iface,
+        "Add contracts in bulk: stylus-contract add-many [--lazy] <manifest | address=library_path>...");
+    if (!add_many_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'stylus-contract add-many'\n");
+      return false;
+    }
+  }
+
   // Subcommand: "stylus-contract breakpoint"
   {
     auto *bp_iface = new WalnutContractBreakpointCommand();
     lldb::SBCommand bp_cmd = contract_cmd.AddCommand(
-        "breakpoint", bp_iface, "Set breakpoint: stylus-contract breakpoint <address> <function>");
+        "breakpoint", bp_iface,
+        "Set breakpoints: stylus-contract breakpoint <address[,address...]|all> <function>... | -r <regex>");
     if (!bp_cmd.IsValid()) {
       std::fprintf(stderr, "Failed to register 'stylus-contract breakpoint'\n");
       return false;
     }
   }
 
+  // Subcommand: "stylus-contract reload"
+  {
+    auto *reload_iface = new WalnutContractReloadCommand();
+    lldb::SBCommand reload_cmd = contract_cmd.AddCommand(
+        "reload", reload_iface,
+        "Swap in a rebuilt library: stylus-contract reload <address> [library_path]");
+    if (!reload_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'stylus-contract reload'\n");
+      return false;
+    }
+  }
+
   // Subcommand: "stylus-contract list"
   {
     auto *list_iface = new WalnutContractListCommand();
@@ -291,6 +1478,18 @@ bool RegisterWalnutContractCommands(lldb::SBCommandInterpreter &interpreter) {
     }
   }
 
+  // Subcommand: "stylus-contract activate"
+  {
+    auto *activate_iface = new WalnutContractActivateCommand();
+    lldb::SBCommand activate_cmd = contract_cmd.AddCommand(
+        "activate", activate_iface,
+        "Load lazy contracts: stylus-contract activate [address...]");
+    if (!activate_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'stylus-contract activate'\n");
+      return false;
+    }
+  }
+
   // Subcommand: "stylus-contract context"
   {
     auto *context_iface = new WalnutContractContextCommand();
@@ -1,23 +1,44 @@
 #pragma once
 
+#include <lldb/API/SBBreakpoint.h>
 #include <lldb/API/SBCommandInterpreter.h>
+#include <lldb/API/SBModule.h>
+#include <lldb/API/SBTarget.h>
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <string>
-#include <map>
+#include <unordered_map>
+#include <vector>
 
-// Command: "stylus-contract add <address> <library_path>"
+// Command: "stylus-contract add [--lazy] <address> <library_path>"
 class WalnutContractAddCommand : public lldb::SBCommandPluginInterface {
 public:
   bool DoExecute(lldb::SBDebugger debugger, char **command,
                  lldb::SBCommandReturnObject &result) override;
 };
 
-// Command: "stylus-contract breakpoint <address> <function>"
+// Command: "stylus-contract add-many [--lazy] <manifest | address=library_path>..."
+class WalnutContractAddManyCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
+
+// Command: "stylus-contract breakpoint <address[,address...]|all> <function>... | -r <regex>"
 class WalnutContractBreakpointCommand : public lldb::SBCommandPluginInterface {
 public:
   bool DoExecute(lldb::SBDebugger debugger, char **command,
                  lldb::SBCommandReturnObject &result) override;
 };
 
+// Command: "stylus-contract reload <address> [library_path]"
+class WalnutContractReloadCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
+
 // Command: "stylus-contract list"
 class WalnutContractListCommand : public lldb::SBCommandPluginInterface {
 public:
@@ -32,6 +53,13 @@ public:
                  lldb::SBCommandReturnObject &result) override;
 };
 
+// Command: "stylus-contract activate [address...]"
+class WalnutContractActivateCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
+
 // Command: "stylus-contract context <address>"
 class WalnutContractContextCommand : public lldb::SBCommandPluginInterface {
 public:
@@ -39,14 +67,77 @@ public:
                  lldb::SBCommandReturnObject &result) override;
 };
 
+// Contract address, normalized to its 20 bytes
+struct ContractAddress {
+  std::array<uint8_t, 20> bytes{};
+
+  bool operator==(const ContractAddress &other) const {
+    return bytes == other.bytes;
+  }
+};
+
+struct ContractAddressHash {
+  size_t operator()(const ContractAddress &addr) const {
+    // Addresses are already uniformly distributed; fold the low 8 bytes
+    uint64_t h;
+    std::memcpy(&h, addr.bytes.data() + 12, sizeof(h));
+    return static_cast<size_t>(h);
+  }
+};
+
+// Accepts up to 40 hex digits, with or without 0x; shorter input is
+// left-padded with zeros.
+bool ParseContractAddress(const std::string &text, ContractAddress &out);
+std::string FormatContractAddress(const ContractAddress &addr);
+
+// Function symbols of one contract library, built once when the contract is
+// registered so breakpoint requests never rescan the module.
+struct ContractFunction {
+  std::string name;   // Demangled, without the Rust hash suffix
+  std::string symbol; // Symbol name the breakpoint is created on
+};
+
+struct ContractFunctionIndex {
+  std::vector<ContractFunction> functions;
+  // Last path component ("transfer" for "erc20::Token::transfer") -> index
+  // into functions
+  std::unordered_multimap<std::string, size_t> by_base_name;
+};
+
+void BuildContractFunctionIndex(lldb::SBModule &module,
+                                ContractFunctionIndex &index);
+
+// Functions and patterns a "stylus-contract breakpoint" asked for, kept so
+// the breakpoint can be resolved later (lazy load) or again (reload)
+struct ContractBreakpointRequest {
+  std::vector<std::string> functions;
+  std::vector<std::string> patterns;
+};
+
+struct ContractBreakpoint {
+  lldb::SBBreakpoint bp;
+  ContractBreakpointRequest request;
+  std::vector<std::string> symbols; // Symbols the breakpoint was created on
+};
+
 // Global contract registry
 struct ContractInfo {
+  std::string address;      // Canonical 0x-prefixed lowercase form
   std::string library_path;
   lldb::SBModule module;
-  std::vector<lldb::SBBreakpoint> breakpoints;
+  ContractFunctionIndex functions;
+  std::vector<ContractBreakpoint> breakpoints;
+
+  // Lazily registered contracts only record the library and its build-id; the
+  // module, function index and pending breakpoints are loaded and resolved the
+  // first time execution calls into the contract.
+  bool lazy = false;
+  std::vector<uint8_t> build_id;
+  std::vector<ContractBreakpointRequest> pending_breakpoints;
 };
 
-extern std::map<std::string, ContractInfo> g_contract_registry;
+extern std::unordered_map<ContractAddress, ContractInfo, ContractAddressHash>
+    g_contract_registry;
 extern std::vector<std::string> g_call_stack;
 extern std::string g_current_context;
 
@@ -55,4 +146,9 @@ void UpdateCallStack(const std::string& stack_str);
 void PushContext(const std::string& contract_address);
 void PopContext();
 
+// PC -> contract lookup over the loaded section ranges of every registered
+// module. Returns the canonical address of the owning contract, or nullptr.
+const std::string *LookupContractByPC(lldb::SBTarget &target, lldb::addr_t pc);
+void InvalidateContractIndex();
+
 bool RegisterWalnutContractCommands(lldb::SBCommandInterpreter &interpreter);
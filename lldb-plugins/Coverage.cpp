@@ -0,0 +1,967 @@
+//
+// stylusdb
+//
+// Coverage for "calltrace coverage" and "calltrace linecov". For function
+// coverage one breakpoint covers every selected function and each of its
+// locations is disabled on the first hit, which takes the trap out of the
+// inferior: a function costs at most one stop however often it runs, and all
+// that is recorded is one bit. Coverage of several runs is merged by OR-ing
+// the bitsets. Line coverage counts hits per line-table row and merges by
+// adding the count arrays.
+//
+
+#include "Coverage.h"
+#include "ContractCommands.h"
+#include "FrameClassifier.h"
+#include "FunctionCallTrace.h"
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/JSON.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <lldb/API/SBAddress.h>
+#include <lldb/API/SBBreakpoint.h>
+#include <lldb/API/SBBreakpointLocation.h>
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBCompileUnit.h>
+#include <lldb/API/SBDebugger.h>
+#include <lldb/API/SBFileSpec.h>
+#include <lldb/API/SBFileSpecList.h>
+#include <lldb/API/SBFunction.h>
+#include <lldb/API/SBLineEntry.h>
+#include <lldb/API/SBModule.h>
+#include <lldb/API/SBSymbol.h>
+#include <lldb/API/SBTarget.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const char *const kDefaultCoverageJSON = "/tmp/lldb_function_coverage.json";
+static const char *const kDefaultCoverageLcov = "/tmp/lldb_function_coverage.info";
+static const int kCoverageFormatVersion = 1;
+
+struct CoverageFunction {
+  std::string name;
+  std::string file; // "<directory>/<file>" of the function's first line
+  uint32_t line = 0;
+};
+
+// Location slots: function index + 1, or one of these
+static const uint32_t kLocationUnresolved = 0;
+static const uint32_t kLocationIgnored = UINT32_MAX;
+
+struct FunctionCoverage {
+  // Functions in the order they were first seen; the bit index of a function
+  // is its position here. Keyed by name so every location of a function (and
+  // the same function in a later run or a merged file) shares one bit.
+  std::vector<CoverageFunction> functions;
+  std::unordered_map<std::string, uint32_t> by_name;
+  std::vector<uint64_t> hits;
+
+  lldb::SBBreakpoint bp;
+  // Breakpoint location ID -> slot
+  std::vector<uint32_t> locations;
+
+  uint32_t Add(const std::string &name, std::string file, uint32_t line) {
+    auto [it, inserted] =
+        by_name.emplace(name, static_cast<uint32_t>(functions.size()));
+    if (inserted) {
+      functions.push_back({name, std::move(file), line});
+      hits.resize((functions.size() + 63) / 64, 0);
+    }
+    return it->second;
+  }
+
+  void SetHit(uint32_t i) { hits[i >> 6] |= uint64_t(1) << (i & 63); }
+  bool IsHit(uint32_t i) const { return (hits[i >> 6] >> (i & 63)) & 1; }
+
+  size_t HitCount() const {
+    size_t n = 0;
+    for (uint64_t word : hits)
+      n += __builtin_popcountll(word);
+    return n;
+  }
+};
+
+static FunctionCoverage g_coverage;
+
+// Maps a breakpoint location to its function's slot, adding the function the
+// first time one of its locations is seen. Locations in runtime or router code
+// are disabled straight away and never stop the inferior.
+static uint32_t ResolveCoverageLocation(lldb::SBBreakpointLocation &location) {
+  lldb::break_id_t id = location.GetID();
+  if (id <= 0)
+    return kLocationIgnored;
+  if (static_cast<size_t>(id) >= g_coverage.locations.size())
+    g_coverage.locations.resize(id + 1, kLocationUnresolved);
+  if (g_coverage.locations[id] != kLocationUnresolved)
+    return g_coverage.locations[id];
+
+  lldb::SBAddress addr = location.GetAddress();
+  lldb::SBFunction function = addr.GetFunction();
+  const char *name = function.IsValid() ? function.GetName() : nullptr;
+  if (!name) {
+    lldb::SBSymbol symbol = addr.GetSymbol();
+    name = symbol.IsValid() ? symbol.GetName() : nullptr;
+  }
+
+  // The declaration line: the function's start, not the location, which sits
+  // after the prologue
+  lldb::SBAddress start = function.IsValid() ? function.GetStartAddress() : addr;
+  lldb::SBLineEntry entry = start.GetLineEntry();
+  const char *directory = nullptr;
+  const char *filename = nullptr;
+  uint32_t line = 0;
+  if (entry.IsValid()) {
+    lldb::SBFileSpec fs = entry.GetFileSpec();
+    directory = fs.GetDirectory();
+    filename = fs.GetFilename();
+    line = entry.GetLine();
+  }
+
+  uint32_t classes = 0;
+  if (name)
+    classes = g_frame_classifier.ClassifySymbol(name) |
+              g_frame_classifier.ClassifyPath(directory ? directory : "",
+                                              filename ? filename : "");
+  uint32_t slot = kLocationIgnored;
+  if (name && !(classes & (kFrameRuntime | kFrameRouter))) {
+    std::string file;
+    if (filename)
+      file = directory ? std::string(directory) + "/" + filename : filename;
+    slot = g_coverage.Add(name, std::move(file), line) + 1;
+    // Already reached in an earlier run or a merged file
+    if (g_coverage.IsHit(slot - 1))
+      location.SetEnabled(false);
+  } else {
+    location.SetEnabled(false);
+  }
+  g_coverage.locations[id] = slot;
+  return slot;
+}
+
+static bool CoverageHitCallback(void *baton, lldb::SBProcess &process,
+                                lldb::SBThread &thread,
+                                lldb::SBBreakpointLocation &location) {
+  uint32_t slot = ResolveCoverageLocation(location);
+  if (slot != kLocationIgnored)
+    g_coverage.SetHit(slot - 1);
+  // SB has no per-location delete; disabling removes the breakpoint site, so
+  // this location never traps again
+  location.SetEnabled(false);
+  return false;
+}
+
+// Picks up locations resolved since the last scan, e.g. in a contract module
+// loaded after "coverage start", so unreached functions are counted too.
+static void SyncCoverageLocations() {
+  if (!g_coverage.bp.IsValid())
+    return;
+  size_t count = g_coverage.bp.GetNumLocations();
+  for (size_t i = 0; i < count; ++i) {
+    lldb::SBBreakpointLocation location =
+        g_coverage.bp.GetLocationAtIndex(static_cast<uint32_t>(i));
+    if (location.IsValid())
+      ResolveCoverageLocation(location);
+  }
+}
+
+static void StopCoverage(lldb::SBTarget &target) {
+  if (g_coverage.bp.IsValid() && target.IsValid())
+    target.BreakpointDelete(g_coverage.bp.GetID());
+  g_coverage.bp = lldb::SBBreakpoint();
+  g_coverage.locations.clear();
+}
+
+// -----------------------------------------------------------------------------
+// Export and merge
+
+static std::string HitsToHex(const std::vector<uint64_t> &hits) {
+  std::string out;
+  out.reserve(hits.size() * 16);
+  char word[17];
+  for (uint64_t w : hits) {
+    std::snprintf(word, sizeof(word), "%016llx",
+                  static_cast<unsigned long long>(w));
+    out += word;
+  }
+  return out;
+}
+
+static bool HexToHits(llvm::StringRef hex, std::vector<uint64_t> &hits) {
+  if (hex.size() % 16)
+    return false;
+  hits.clear();
+  for (size_t i = 0; i < hex.size(); i += 16) {
+    uint64_t word;
+    if (hex.substr(i, 16).getAsInteger(16, word))
+      return false;
+    hits.push_back(word);
+  }
+  return true;
+}
+
+static bool WriteCoverageJSON(const char *path, std::string &error) {
+  FILE *fp = std::fopen(path, "w");
+  if (!fp) {
+    error = std::strerror(errno);
+    return false;
+  }
+
+  JSONWriter out;
+  out.fp = fp;
+  out.Printf("{\n  \"version\": %d,\n  \"functions\": [",
+             kCoverageFormatVersion);
+  for (size_t i = 0; i < g_coverage.functions.size(); ++i) {
+    const CoverageFunction &fn = g_coverage.functions[i];
+    out.Printf("%s\n    { \"name\": \"%s\", \"file\": \"%s\", \"line\": %u }",
+               i ? "," : "", JsonEscape(fn.name).c_str(),
+               JsonEscape(fn.file).c_str(), fn.line);
+  }
+  // Bit i of 64-bit word i / 64 is function i; words in order, 16 hex digits
+  // each
+  out.Printf("%s],\n  \"hits\": \"%s\"\n}\n",
+             g_coverage.functions.empty() ? "" : "\n  ",
+             HitsToHex(g_coverage.hits).c_str());
+  std::fclose(fp);
+  return true;
+}
+
+static bool WriteCoverageLcov(const char *path, std::string &error) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_Text);
+  if (ec) {
+    error = ec.message();
+    return false;
+  }
+
+  // lcov wants one record per source file; functions without line info have
+  // nowhere to go and are left to the JSON export
+  std::map<std::string, std::vector<uint32_t>> by_file;
+  for (uint32_t i = 0; i < g_coverage.functions.size(); ++i)
+    if (!g_coverage.functions[i].file.empty())
+      by_file[g_coverage.functions[i].file].push_back(i);
+
+  os << "TN:stylusdb\n";
+  for (const auto &[file, indices] : by_file) {
+    os << "SF:" << file << "\n";
+    for (uint32_t i : indices)
+      os << "FN:" << g_coverage.functions[i].line << ","
+         << g_coverage.functions[i].name << "\n";
+    size_t hit = 0;
+    for (uint32_t i : indices) {
+      bool reached = g_coverage.IsHit(i);
+      hit += reached;
+      os << "FNDA:" << (reached ? 1 : 0) << "," << g_coverage.functions[i].name
+         << "\n";
+    }
+    os << "FNF:" << indices.size() << "\n";
+    os << "FNH:" << hit << "\n";
+    os << "end_of_record\n";
+  }
+  return true;
+}
+
+static bool MergeCoverageFile(const char *path, std::string &error) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    error = buffer.getError().message();
+    return false;
+  }
+  llvm::Expected<llvm::json::Value> parsed =
+      llvm::json::parse((*buffer)->getBuffer());
+  if (!parsed) {
+    error = llvm::toString(parsed.takeError());
+    return false;
+  }
+
+  const llvm::json::Object *root = parsed->getAsObject();
+  const llvm::json::Array *functions =
+      root ? root->getArray("functions") : nullptr;
+  std::vector<uint64_t> hits;
+  if (!functions || !root->getString("hits") ||
+      !HexToHits(*root->getString("hits"), hits) ||
+      hits.size() != (functions->size() + 63) / 64) {
+    error = "not a calltrace coverage file";
+    return false;
+  }
+
+  // Same functions in the same order (another run of the same build): the
+  // bitsets line up and merge word by word
+  bool aligned = functions->size() == g_coverage.functions.size();
+  for (size_t i = 0; aligned && i < functions->size(); ++i) {
+    const llvm::json::Object *fn = (*functions)[i].getAsObject();
+    aligned = fn && fn->getString("name") &&
+              *fn->getString("name") == g_coverage.functions[i].name;
+  }
+  if (aligned) {
+    for (size_t w = 0; w < hits.size(); ++w)
+      g_coverage.hits[w] |= hits[w];
+    return true;
+  }
+
+  for (size_t i = 0; i < functions->size(); ++i) {
+    const llvm::json::Object *fn = (*functions)[i].getAsObject();
+    if (!fn || !fn->getString("name"))
+      continue;
+    auto name = fn->getString("name");
+    auto file = fn->getString("file");
+    auto line = fn->getInteger("line");
+    uint32_t index = g_coverage.Add(name->str(), file ? file->str() : "",
+                                    line ? static_cast<uint32_t>(*line) : 0);
+    if ((hits[i >> 6] >> (i & 63)) & 1)
+      g_coverage.SetHit(index);
+  }
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Subcommand "calltrace coverage"
+
+static void PrintCoverageSummary(lldb::SBCommandReturnObject &result) {
+  size_t total = g_coverage.functions.size();
+  size_t hit = g_coverage.HitCount();
+  result.Printf("%zu/%zu functions reached (%.1f%%)\n", hit, total,
+                total ? 100.0 * hit / total : 0.0);
+}
+
+bool CallTraceCoverageCommand::DoExecute(lldb::SBDebugger debugger,
+                                         char **command,
+                                         lldb::SBCommandReturnObject &result) {
+  std::string sub = command && command[0] ? command[0] : "show";
+  lldb::SBTarget target = debugger.GetSelectedTarget();
+
+  if (sub == "start") {
+    if (!target.IsValid()) {
+      result.Printf("No valid target. Use `target create <binary>`.\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+
+    std::string regex = ".";
+    lldb::SBFileSpecList modules;
+    bool explicit_modules = false;
+    for (int i = 1; command[i]; ++i) {
+      std::string arg = command[i];
+      if (arg == "--module") {
+        if (!command[i + 1]) {
+          result.Printf("Missing value for --module\n");
+          result.SetStatus(lldb::eReturnStatusFailed);
+          return false;
+        }
+        modules.Append(lldb::SBFileSpec(command[++i], true));
+        explicit_modules = true;
+      } else {
+        regex = arg;
+      }
+    }
+
+    // The registered contracts' libraries by default; the executable if none
+    // are registered, not every module, which would sweep in libc and the
+    // runtime
+    if (!explicit_modules) {
+      for (const auto &[addr, info] : g_contract_registry) {
+        if (info.module.IsValid())
+          modules.Append(info.module.GetFileSpec());
+        else if (info.lazy)
+          modules.Append(lldb::SBFileSpec(info.library_path.c_str(), true));
+      }
+      if (g_contract_registry.empty())
+        modules.Append(target.GetExecutable());
+    }
+
+    StopCoverage(target);
+    g_frame_classifier.Compile(g_frame_patterns);
+    g_coverage.bp = target.BreakpointCreateByRegex(regex.c_str(), modules,
+                                                   lldb::SBFileSpecList());
+    if (!g_coverage.bp.IsValid()) {
+      result.Printf("Failed to create breakpoint for regex: %s\n",
+                    regex.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    g_coverage.bp.SetCallback(CoverageHitCallback, nullptr);
+    g_coverage.bp.SetAutoContinue(true);
+    g_coverage.bp.AddName("stylusdb-coverage");
+    SyncCoverageLocations();
+
+    result.Printf("calltrace: Function coverage for '%s' (%zu functions)\n",
+                  regex.c_str(), g_coverage.functions.size());
+    result.Printf("Breakpoint ID: %d\n", g_coverage.bp.GetID());
+    result.Printf("Run/continue to collect coverage.\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "stop") {
+    SyncCoverageLocations();
+    StopCoverage(target);
+    PrintCoverageSummary(result);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "show") {
+    bool missed_only = command && command[0] && command[1] &&
+                       std::string(command[1]) == "--missed";
+    SyncCoverageLocations();
+    for (uint32_t i = 0; i < g_coverage.functions.size(); ++i) {
+      bool reached = g_coverage.IsHit(i);
+      if (missed_only && reached)
+        continue;
+      const CoverageFunction &fn = g_coverage.functions[i];
+      if (fn.file.empty())
+        result.Printf("[%c] %s\n", reached ? 'x' : ' ', fn.name.c_str());
+      else
+        result.Printf("[%c] %s (%s:%u)\n", reached ? 'x' : ' ', fn.name.c_str(),
+                      fn.file.c_str(), fn.line);
+    }
+    PrintCoverageSummary(result);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "export") {
+    std::string format = command[1] ? command[1] : "";
+    if (format != "json" && format != "lcov") {
+      result.Printf("Usage: calltrace coverage export json|lcov [path]\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    const char *path = command[2]
+                           ? command[2]
+                           : (format == "json" ? kDefaultCoverageJSON
+                                               : kDefaultCoverageLcov);
+    SyncCoverageLocations();
+    std::string error;
+    bool ok = format == "json" ? WriteCoverageJSON(path, error)
+                               : WriteCoverageLcov(path, error);
+    if (!ok) {
+      result.Printf("Failed to write %s: %s\n", path, error.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    result.Printf("Coverage written to %s\n", path);
+    PrintCoverageSummary(result);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "merge") {
+    if (!command[1]) {
+      result.Printf("Usage: calltrace coverage merge <file.json>...\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    SyncCoverageLocations();
+    for (int i = 1; command[i]; ++i) {
+      std::string error;
+      if (!MergeCoverageFile(command[i], error)) {
+        result.Printf("Failed to merge %s: %s\n", command[i], error.c_str());
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+    }
+    PrintCoverageSummary(result);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "clear") {
+    StopCoverage(target);
+    g_coverage = FunctionCoverage();
+    result.Printf("Coverage cleared\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  result.Printf("Usage: calltrace coverage start [--module <path>]... [regex]\n"
+                "       calltrace coverage stop | show [--missed] | clear\n"
+                "       calltrace coverage export json|lcov [path]\n"
+                "       calltrace coverage merge <file.json>...\n");
+  result.SetStatus(lldb::eReturnStatusFailed);
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// Line coverage: one breakpoint per line-table row of the contract's compile
+// units. The row index rides in the callback baton, so a hit is one array
+// increment with no lookup. Source text is only read when reporting.
+
+static const char *const kDefaultLineCovJSON = "/tmp/lldb_line_coverage.json";
+static const char *const kDefaultLineCovLcov = "/tmp/lldb_line_coverage.info";
+
+struct LineRow {
+  uint32_t file; // Index into LineCoverage::files
+  uint32_t line;
+};
+
+struct LineCoverage {
+  std::vector<std::string> files;
+  std::vector<LineRow> rows;
+  // Hits per row, parallel to rows. Runs over the same line table (same
+  // fingerprint) merge by adding these.
+  std::vector<uint64_t> counts;
+  uint64_t fingerprint = 0;
+  bool counted = false;
+  std::vector<lldb::SBBreakpoint> bps;
+};
+
+static LineCoverage g_line_coverage;
+
+static uint64_t Fnv1a(uint64_t h, const void *data, size_t size) {
+  const uint8_t *p = static_cast<const uint8_t *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    h ^= p[i];
+    h *= 0x100000001b3ull;
+  }
+  return h;
+}
+
+static bool LineHitCallback(void *baton, lldb::SBProcess &process,
+                            lldb::SBThread &thread,
+                            lldb::SBBreakpointLocation &location) {
+  uint32_t row = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(baton));
+  ++g_line_coverage.counts[row];
+  if (!g_line_coverage.counted)
+    location.SetEnabled(false);
+  return false;
+}
+
+static void StopLineCoverage(lldb::SBTarget &target) {
+  if (target.IsValid())
+    for (auto &bp : g_line_coverage.bps)
+      target.BreakpointDelete(bp.GetID());
+  g_line_coverage.bps.clear();
+}
+
+// Collects the rows of every compile unit in the modules, skipping runtime
+// source (standard library code inlined into the contract), line 0 and
+// addresses already taken by an earlier row. Returns the breakpoint address
+// of each row.
+static std::vector<lldb::SBAddress>
+BuildLineTable(std::vector<lldb::SBModule> &modules, LineCoverage &table) {
+  std::vector<lldb::SBAddress> addresses;
+  std::unordered_map<std::string, uint32_t> file_ids;
+  uint64_t fingerprint = 0xcbf29ce484222325ull;
+
+  for (auto &module : modules) {
+    std::unordered_map<lldb::addr_t, bool> seen;
+    uint32_t num_units = module.GetNumCompileUnits();
+    for (uint32_t u = 0; u < num_units; ++u) {
+      lldb::SBCompileUnit unit = module.GetCompileUnitAtIndex(u);
+      uint32_t num_entries = unit.GetNumLineEntries();
+      for (uint32_t e = 0; e < num_entries; ++e) {
+        lldb::SBLineEntry entry = unit.GetLineEntryAtIndex(e);
+        uint32_t line = entry.GetLine();
+        if (!entry.IsValid() || line == 0)
+          continue;
+        lldb::SBAddress addr = entry.GetStartAddress();
+        if (!seen.emplace(addr.GetFileAddress(), true).second)
+          continue;
+
+        lldb::SBFileSpec fs = entry.GetFileSpec();
+        const char *directory = fs.GetDirectory();
+        const char *filename = fs.GetFilename();
+        if (!filename)
+          continue;
+        if (g_frame_classifier.ClassifyPath(directory ? directory : "",
+                                            filename) &
+            kFrameRuntime)
+          continue;
+
+        std::string path =
+            directory ? std::string(directory) + "/" + filename : filename;
+        auto [it, inserted] = file_ids.emplace(
+            path, static_cast<uint32_t>(table.files.size()));
+        if (inserted)
+          table.files.push_back(path);
+
+        table.rows.push_back({it->second, line});
+        addresses.push_back(addr);
+        fingerprint = Fnv1a(fingerprint, path.data(), path.size());
+        fingerprint = Fnv1a(fingerprint, &line, sizeof(line));
+      }
+    }
+  }
+  // Sources edited without moving any row still change the fingerprint.
+  // Unreadable files hash as empty.
+  for (const std::string &path : table.files) {
+    std::ifstream src(path, std::ios::binary);
+    char buf[1 << 16];
+    while (src.read(buf, sizeof(buf)) || src.gcount())
+      fingerprint = Fnv1a(fingerprint, buf, static_cast<size_t>(src.gcount()));
+  }
+  table.fingerprint = fingerprint;
+  table.counts.assign(table.rows.size(), 0);
+  return addresses;
+}
+
+// Per file: line -> hits. Several rows of one line count once per pass, so a
+// line's count is the largest of its rows'.
+static std::vector<std::map<uint32_t, uint64_t>> LineCountsByFile() {
+  std::vector<std::map<uint32_t, uint64_t>> by_file(
+      g_line_coverage.files.size());
+  for (size_t i = 0; i < g_line_coverage.rows.size(); ++i) {
+    const LineRow &row = g_line_coverage.rows[i];
+    uint64_t &count = by_file[row.file][row.line];
+    count = std::max(count, g_line_coverage.counts[i]);
+  }
+  return by_file;
+}
+
+// Reads the requested lines (ascending) of a source file in one pass.
+static std::vector<std::string>
+ReadSourceLines(const std::string &path, const std::vector<uint32_t> &lines) {
+  std::vector<std::string> text(lines.size());
+  std::ifstream src(path);
+  std::string s;
+  uint32_t current_line = 0;
+  size_t next = 0;
+  while (next < lines.size() && std::getline(src, s)) {
+    ++current_line;
+    if (current_line != lines[next])
+      continue;
+    size_t start = s.find_first_not_of(" \t\r");
+    size_t end = s.find_last_not_of(" \t\r");
+    if (start != std::string::npos)
+      text[next] = s.substr(start, end - start + 1);
+    ++next;
+  }
+  return text;
+}
+
+static bool WriteLineCovLcov(const char *path, std::string &error) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_Text);
+  if (ec) {
+    error = ec.message();
+    return false;
+  }
+
+  std::vector<std::map<uint32_t, uint64_t>> by_file = LineCountsByFile();
+  os << "TN:stylusdb\n";
+  for (size_t f = 0; f < by_file.size(); ++f) {
+    if (by_file[f].empty())
+      continue;
+    os << "SF:" << g_line_coverage.files[f] << "\n";
+    size_t hit = 0;
+    for (const auto &[line, count] : by_file[f]) {
+      os << "DA:" << line << "," << count << "\n";
+      hit += count != 0;
+    }
+    os << "LF:" << by_file[f].size() << "\n";
+    os << "LH:" << hit << "\n";
+    os << "end_of_record\n";
+  }
+  return true;
+}
+
+static bool WriteLineCovJSON(const char *path, std::string &error) {
+  FILE *fp = std::fopen(path, "w");
+  if (!fp) {
+    error = std::strerror(errno);
+    return false;
+  }
+
+  // Compact: the row and count arrays run to tens of thousands of entries
+  std::string fingerprint =
+      HitsToHex(std::vector<uint64_t>{g_line_coverage.fingerprint});
+  JSONWriter out;
+  out.fp = fp;
+  out.Printf("{\"version\":%d,\"fingerprint\":\"%s\",\"counted\":%s,"
+             "\"files\":[",
+             kCoverageFormatVersion, fingerprint.c_str(),
+             g_line_coverage.counted ? "true" : "false");
+  for (size_t i = 0; i < g_line_coverage.files.size(); ++i)
+    out.Printf("%s\"%s\"", i ? "," : "",
+               JsonEscape(g_line_coverage.files[i]).c_str());
+  // Flattened (file, line) pairs
+  out.Printf("],\"rows\":[");
+  for (size_t i = 0; i < g_line_coverage.rows.size(); ++i)
+    out.Printf("%s%u,%u", i ? "," : "", g_line_coverage.rows[i].file,
+               g_line_coverage.rows[i].line);
+  out.Printf("],\"counts\":[");
+  for (size_t i = 0; i < g_line_coverage.counts.size(); ++i)
+    out.Printf("%s%llu", i ? "," : "",
+               static_cast<unsigned long long>(g_line_coverage.counts[i]));
+  out.Printf("]}\n");
+  std::fclose(fp);
+  return true;
+}
+
+static bool MergeLineCovFile(const char *path, std::string &error) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    error = buffer.getError().message();
+    return false;
+  }
+  llvm::Expected<llvm::json::Value> parsed =
+      llvm::json::parse((*buffer)->getBuffer());
+  if (!parsed) {
+    error = llvm::toString(parsed.takeError());
+    return false;
+  }
+
+  const llvm::json::Object *root = parsed->getAsObject();
+  const llvm::json::Array *files = root ? root->getArray("files") : nullptr;
+  const llvm::json::Array *rows = root ? root->getArray("rows") : nullptr;
+  const llvm::json::Array *counts = root ? root->getArray("counts") : nullptr;
+  std::vector<uint64_t> fingerprint;
+  if (!files || !rows || !counts || !root->getString("fingerprint") ||
+      !HexToHits(*root->getString("fingerprint"), fingerprint) ||
+      fingerprint.size() != 1 || rows->size() != 2 * counts->size()) {
+    error = "not a calltrace linecov file";
+    return false;
+  }
+
+  // Nothing collected yet: adopt the file's line table
+  if (g_line_coverage.rows.empty() && g_line_coverage.bps.empty()) {
+    LineCoverage table;
+    for (const auto &file : *files)
+      table.files.push_back(file.getAsString() ? file.getAsString()->str() : "");
+    for (size_t i = 0; i < counts->size(); ++i) {
+      auto file = (*rows)[2 * i].getAsInteger();
+      auto line = (*rows)[2 * i + 1].getAsInteger();
+      if (!file || !line || *file < 0 ||
+          static_cast<size_t>(*file) >= table.files.size()) {
+        error = "bad row " + std::to_string(i);
+        return false;
+      }
+      table.rows.push_back(
+          {static_cast<uint32_t>(*file), static_cast<uint32_t>(*line)});
+    }
+    table.fingerprint = fingerprint[0];
+    auto counted = root->getBoolean("counted");
+    table.counted = counted && *counted;
+    table.counts.assign(table.rows.size(), 0);
+    g_line_coverage = std::move(table);
+  }
+
+  if (fingerprint[0] != g_line_coverage.fingerprint ||
+      counts->size() != g_line_coverage.counts.size()) {
+    error = "line table differs from the current one (different build?)";
+    return false;
+  }
+  for (size_t i = 0; i < counts->size(); ++i) {
+    auto count = (*counts)[i].getAsInteger();
+    if (count && *count > 0)
+      g_line_coverage.counts[i] += static_cast<uint64_t>(*count);
+  }
+  return true;
+}
+
+static void PrintLineCovSummary(lldb::SBCommandReturnObject &result) {
+  size_t total = 0;
+  size_t hit = 0;
+  for (const auto &lines : LineCountsByFile()) {
+    total += lines.size();
+    for (const auto &[line, count] : lines)
+      hit += count != 0;
+  }
+  result.Printf("%zu/%zu lines reached (%.1f%%)\n", hit, total,
+                total ? 100.0 * hit / total : 0.0);
+}
+
+bool CallTraceLineCovCommand::DoExecute(lldb::SBDebugger debugger,
+                                        char **command,
+                                        lldb::SBCommandReturnObject &result) {
+  std::string sub = command && command[0] ? command[0] : "show";
+  lldb::SBTarget target = debugger.GetSelectedTarget();
+
+  if (sub == "start") {
+    if (!target.IsValid()) {
+      result.Printf("No valid target. Use `target create <binary>`.\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+
+    bool counted = false;
+    std::vector<lldb::SBModule> modules;
+    for (int i = 1; command[i]; ++i) {
+      std::string arg = command[i];
+      if (arg == "--counted") {
+        counted = true;
+      } else if (arg == "--module" && command[i + 1]) {
+        lldb::SBModule module =
+            target.FindModule(lldb::SBFileSpec(command[++i], true));
+        if (!module.IsValid()) {
+          result.Printf("Module not found in target: %s\n", command[i]);
+          result.SetStatus(lldb::eReturnStatusFailed);
+          return false;
+        }
+        modules.push_back(module);
+      } else {
+        result.Printf("Unknown option: %s\n", arg.c_str());
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+    }
+
+    // The registered contracts' libraries by default; the executable if none
+    // are registered. Lazy contracts have no module to read a line table from
+    // until they are first entered.
+    if (modules.empty()) {
+      for (const auto &[addr, info] : g_contract_registry) {
+        if (info.module.IsValid())
+          modules.push_back(info.module);
+        else if (info.lazy)
+          result.Printf("Skipping lazily registered contract %s (not loaded "
+                        "yet)\n",
+                        info.address.c_str());
+      }
+      if (g_contract_registry.empty() && target.GetNumModules())
+        modules.push_back(target.GetModuleAtIndex(0));
+    }
+
+    StopLineCoverage(target);
+    g_frame_classifier.Compile(g_frame_patterns);
+    LineCoverage table;
+    std::vector<lldb::SBAddress> addresses = BuildLineTable(modules, table);
+    if (table.rows.empty()) {
+      result.Printf("No line table entries found\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+
+    // Same line table as before (another run of the same build): keep
+    // accumulating
+    if (table.fingerprint == g_line_coverage.fingerprint &&
+        table.rows.size() == g_line_coverage.rows.size())
+      table.counts = std::move(g_line_coverage.counts);
+    table.counted = counted;
+    g_line_coverage = std::move(table);
+
+    g_line_coverage.bps.reserve(addresses.size());
+    for (size_t row = 0; row < addresses.size(); ++row) {
+      // One-shot rows reached in an earlier run never need to stop again
+      if (!counted && g_line_coverage.counts[row])
+        continue;
+      lldb::SBBreakpoint bp = target.BreakpointCreateBySBAddress(addresses[row]);
+      if (!bp.IsValid())
+        continue;
+      bp.SetCallback(LineHitCallback,
+                     reinterpret_cast<void *>(static_cast<uintptr_t>(row)));
+      bp.SetAutoContinue(true);
+      bp.AddName("stylusdb-linecov");
+      g_line_coverage.bps.push_back(bp);
+    }
+
+    result.Printf("calltrace: Line coverage (%s) over %zu rows in %zu files, "
+                  "%zu breakpoints\n",
+                  counted ? "counted" : "one-shot", g_line_coverage.rows.size(),
+                  g_line_coverage.files.size(), g_line_coverage.bps.size());
+    result.Printf("Run/continue to collect coverage.\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "stop") {
+    StopLineCoverage(target);
+    PrintLineCovSummary(result);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "show") {
+    bool missed_only = command && command[0] && command[1] &&
+                       std::string(command[1]) == "--missed";
+    std::vector<std::map<uint32_t, uint64_t>> by_file = LineCountsByFile();
+    for (size_t f = 0; f < by_file.size(); ++f) {
+      if (by_file[f].empty())
+        continue;
+      size_t hit = 0;
+      std::vector<uint32_t> lines;
+      std::vector<uint64_t> line_counts;
+      for (const auto &[line, count] : by_file[f]) {
+        hit += count != 0;
+        if (!missed_only || !count) {
+          lines.push_back(line);
+          line_counts.push_back(count);
+        }
+      }
+      const std::string &path = g_line_coverage.files[f];
+      result.Printf("%s: %zu/%zu lines\n", path.c_str(), hit,
+                    by_file[f].size());
+      std::vector<std::string> text = ReadSourceLines(path, lines);
+      for (size_t i = 0; i < lines.size(); ++i)
+        result.Printf("  %6u %8llu  %s\n", lines[i],
+                      static_cast<unsigned long long>(line_counts[i]),
+                      text[i].c_str());
+    }
+    PrintLineCovSummary(result);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "export") {
+    std::string format = command[1] ? command[1] : "";
+    if (format != "json" && format != "lcov") {
+      result.Printf("Usage: calltrace linecov export json|lcov [path]\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    const char *path = command[2]
+                           ? command[2]
+                           : (format == "json" ? kDefaultLineCovJSON
+                                               : kDefaultLineCovLcov);
+    std::string error;
+    bool ok = format == "json" ? WriteLineCovJSON(path, error)
+                               : WriteLineCovLcov(path, error);
+    if (!ok) {
+      result.Printf("Failed to write %s: %s\n", path, error.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    result.Printf("Line coverage written to %s\n", path);
+    PrintLineCovSummary(result);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "merge") {
+    if (!command[1]) {
+      result.Printf("Usage: calltrace linecov merge <file.json>...\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    for (int i = 1; command[i]; ++i) {
+      std::string error;
+      if (!MergeLineCovFile(command[i], error)) {
+        result.Printf("Failed to merge %s: %s\n", command[i], error.c_str());
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+    }
+    PrintLineCovSummary(result);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "clear") {
+    StopLineCoverage(target);
+    g_line_coverage = LineCoverage();
+    result.Printf("Line coverage cleared\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  result.Printf("Usage: calltrace linecov start [--counted] [--module <path>]...\n"
+                "       calltrace linecov stop | show [--missed] | clear\n"
+                "       calltrace linecov export json|lcov [path]\n"
+                "       calltrace linecov merge <file.json>...\n");
+  result.SetStatus(lldb::eReturnStatusFailed);
+  return false;
+}
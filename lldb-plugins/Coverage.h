@@ -0,0 +1,17 @@
+#pragma once
+
+#include <lldb/API/SBCommandInterpreter.h>
+
+// Command: "calltrace coverage start|stop|show|export|merge|clear"
+class CallTraceCoverageCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
+
+// Command: "calltrace linecov start|stop|show|export|merge|clear"
+class CallTraceLineCovCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
@@ -0,0 +1,142 @@
+//
+// stylusdb
+//
+// Shared-memory consumer for fast tracing. The ring is created here, before
+// the inferior starts, and the preloaded runtime attaches to it by name. A
+// drain thread copies events out as they are published and resolves each new
+// function address once, while its module is loaded; nothing here touches
+// the inferior.
+//
+
+#include "FastTrace.h"
+#include "ContractCommands.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+FastTraceConsumer::~FastTraceConsumer() { Stop(); }
+
+bool FastTraceConsumer::Start(lldb::SBTarget target, uint32_t capacity,
+                              std::string &error) {
+  Stop();
+  m_events.clear();
+  m_sites.clear();
+  m_dropped = 0;
+
+  static std::atomic<unsigned> next_ring{0};
+  m_name = "/stylusdb-fasttrace-" + std::to_string(getpid()) + "-" +
+           std::to_string(next_ring++);
+  int fd = shm_open(m_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    error = std::string("shm_open: ") + std::strerror(errno);
+    return false;
+  }
+  size_t bytes = FastTraceRingBytes(capacity);
+  void *map = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(bytes)) == 0)
+    map = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  else
+    error = std::string("ftruncate: ") + std::strerror(errno);
+  close(fd);
+  if (map == MAP_FAILED) {
+    if (error.empty())
+      error = std::string("mmap: ") + std::strerror(errno);
+    shm_unlink(m_name.c_str());
+    return false;
+  }
+
+  m_target = target;
+  m_ring = static_cast<FastTraceRingHeader *>(map);
+  m_bytes = bytes;
+  FastTraceRingInit(m_ring, capacity);
+  m_stop.store(false);
+  m_thread = std::thread([this] {
+    while (!m_stop.load(std::memory_order_acquire))
+      if (!Drain())
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+  });
+  return true;
+}
+
+void FastTraceConsumer::Stop() {
+  if (!m_ring)
+    return;
+  m_stop.store(true, std::memory_order_release);
+  m_thread.join();
+  Drain();
+  m_dropped = __atomic_load_n(&m_ring->dropped, __ATOMIC_RELAXED);
+  munmap(m_ring, m_bytes);
+  shm_unlink(m_name.c_str());
+  m_ring = nullptr;
+}
+
+bool FastTraceConsumer::Drain() {
+  FastTraceEvent ev;
+  bool any = false;
+  while (FastTraceRingPop(m_ring, &ev)) {
+    any = true;
+    if (ev.kind == kFastTraceEnter && !m_sites.count(ev.fn)) {
+      FastTraceSite site;
+      site.address = m_target.ResolveLoadAddress(ev.fn);
+      site.contract = LookupContractByPC(m_target, ev.fn);
+      m_sites.emplace(ev.fn, site);
+    }
+    m_events.push_back(ev);
+  }
+  return any;
+}
+
+bool FastTraceConsumer::Push(uint64_t fn, uint64_t fp, uint32_t tid) {
+  if (!m_ring)
+    return false;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return FastTraceRingPush(m_ring, fn, fp,
+                           static_cast<uint64_t>(now.tv_sec) * 1000000000ull +
+                               static_cast<uint64_t>(now.tv_nsec),
+                           tid, kFastTraceEnter);
+}
+
+std::vector<FastTraceEvent> FastTraceConsumer::TakeEvents() {
+  std::vector<FastTraceEvent> events;
+  events.swap(m_events);
+  return events;
+}
+
+const FastTraceSite *FastTraceConsumer::FindSite(uint64_t fn) const {
+  auto it = m_sites.find(fn);
+  return it == m_sites.end() ? nullptr : &it->second;
+}
+
+std::string DefaultFastTraceRuntime() {
+  if (const char *path = std::getenv("STYLUSDB_FASTTRACE_RUNTIME"))
+    return path;
+#if defined(__APPLE__)
+  const char *library = "libstylusdb_fasttrace.dylib";
+#else
+  const char *library = "libstylusdb_fasttrace.so";
+#endif
+  // Installed in lib/ next to the plugin; the stylusdb binary itself sits in
+  // bin/
+  Dl_info info;
+  if (dladdr(reinterpret_cast<void *>(&DefaultFastTraceRuntime), &info) &&
+      info.dli_fname) {
+    std::string self = info.dli_fname;
+    size_t slash = self.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : self.substr(0, slash);
+    for (const char *candidate : {"/", "/../lib/"}) {
+      std::string path = dir + candidate + library;
+      if (access(path.c_str(), R_OK) == 0)
+        return path;
+    }
+  }
+  return library;
+}
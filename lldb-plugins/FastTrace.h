@@ -0,0 +1,63 @@
+#pragma once
+
+#include "FastTraceRing.h"
+
+#include <lldb/API/SBAddress.h>
+#include <lldb/API/SBTarget.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Where an event's function address resolved to, captured by the drain
+// thread while the module was still loaded
+struct FastTraceSite {
+  lldb::SBAddress address; // Section-relative, so it outlives the process
+  const std::string *contract = nullptr;
+};
+
+// Consumer side of "calltrace start --fast". Owns the shared-memory ring and
+// a thread that drains it while the inferior runs, so the ring only has to
+// absorb bursts. Events are kept raw; turning them into call records is left
+// to "calltrace stop".
+class FastTraceConsumer {
+public:
+  ~FastTraceConsumer();
+
+  bool Start(lldb::SBTarget target, uint32_t capacity, std::string &error);
+  // Drains what is left, joins the drain thread and removes the ring. The
+  // events stay until taken.
+  void Stop();
+
+  bool active() const { return m_ring != nullptr; }
+  const std::string &name() const { return m_name; }
+  uint64_t dropped() const { return m_dropped; }
+
+  // Records an event on behalf of the inferior, for calls that reached a trap
+  // instead of a hook. Only valid while the inferior is stopped, so the event
+  // lands in program order.
+  bool Push(uint64_t fn, uint64_t fp, uint32_t tid);
+
+  std::vector<FastTraceEvent> TakeEvents();
+  const FastTraceSite *FindSite(uint64_t fn) const;
+
+private:
+  bool Drain();
+
+  lldb::SBTarget m_target;
+  std::string m_name;
+  FastTraceRingHeader *m_ring = nullptr;
+  size_t m_bytes = 0;
+  std::thread m_thread;
+  std::atomic<bool> m_stop{false};
+  std::vector<FastTraceEvent> m_events;
+  std::unordered_map<uint64_t, FastTraceSite> m_sites;
+  uint64_t m_dropped = 0;
+};
+
+// The runtime library installed next to the plugin, unless
+// STYLUSDB_FASTTRACE_RUNTIME names another
+std::string DefaultFastTraceRuntime();
@@ -0,0 +1,120 @@
+//
+// stylusdb
+//
+// Shared-memory event ring between the fast-trace runtime preloaded into the
+// inferior (FastTraceRuntime.c) and stylusdb. Plain C so both sides build it.
+// The ring is a bounded multi-producer queue: every inferior thread claims a
+// slot by advancing `head`, fills it and publishes it through the slot's
+// sequence number; stylusdb is the only consumer. A full ring drops events
+// (counted) rather than stalling the inferior.
+//
+
+#ifndef STYLUSDB_FAST_TRACE_RING_H
+#define STYLUSDB_FAST_TRACE_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STYLUSDB_FASTTRACE_MAGIC 0x31545346424453ull // "SDBFST1"
+#define STYLUSDB_FASTTRACE_VERSION 1u
+// Environment variable naming the shm object the runtime attaches to
+#define STYLUSDB_FASTTRACE_SHM_ENV "STYLUSDB_FASTTRACE_SHM"
+
+enum {
+  kFastTraceEnter = 0,
+  kFastTraceExit = 1,
+};
+
+struct FastTraceEvent {
+  uint64_t seq; // Slot sequence; not part of the event
+  uint64_t fn;  // Function address (or a pc inside it, for mcount hooks)
+  uint64_t fp;  // Frame pointer of the instrumented function
+  uint64_t ts;  // CLOCK_MONOTONIC, nanoseconds
+  uint32_t tid;
+  uint32_t kind;
+};
+
+// Producer and consumer counters sit on separate cache lines
+struct FastTraceRingHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t capacity; // Events, a power of two
+  uint64_t dropped;
+  uint64_t pad0[5];
+  uint64_t head; // Next slot a producer claims
+  uint64_t pad1[7];
+  uint64_t tail; // Next slot the consumer reads
+  uint64_t pad2[7];
+};
+
+static inline size_t FastTraceRingBytes(uint32_t capacity) {
+  return sizeof(struct FastTraceRingHeader) +
+         (size_t)capacity * sizeof(struct FastTraceEvent);
+}
+
+static inline struct FastTraceEvent *
+FastTraceRingSlots(struct FastTraceRingHeader *ring) {
+  return (struct FastTraceEvent *)(ring + 1);
+}
+
+// Called once by the side that creates the ring, before the other maps it
+static inline void FastTraceRingInit(struct FastTraceRingHeader *ring,
+                                     uint32_t capacity) {
+  struct FastTraceEvent *slots = FastTraceRingSlots(ring);
+  uint32_t i;
+  ring->version = STYLUSDB_FASTTRACE_VERSION;
+  ring->capacity = capacity;
+  ring->dropped = 0;
+  ring->head = 0;
+  ring->tail = 0;
+  for (i = 0; i < capacity; ++i)
+    slots[i].seq = i;
+  __atomic_store_n(&ring->magic, STYLUSDB_FASTTRACE_MAGIC, __ATOMIC_RELEASE);
+}
+
+static inline int FastTraceRingPush(struct FastTraceRingHeader *ring,
+                                    uint64_t fn, uint64_t fp, uint64_t ts,
+                                    uint32_t tid, uint32_t kind) {
+  struct FastTraceEvent *slots = FastTraceRingSlots(ring);
+  uint64_t mask = ring->capacity - 1;
+  uint64_t pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  for (;;) {
+    struct FastTraceEvent *slot = &slots[pos & mask];
+    uint64_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    int64_t dif = (int64_t)(seq - pos);
+    if (dif == 0) {
+      if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        slot->fn = fn;
+        slot->fp = fp;
+        slot->ts = ts;
+        slot->tid = tid;
+        slot->kind = kind;
+        __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+        return 1;
+      }
+    } else if (dif < 0) {
+      // The consumer has not freed this slot yet: the ring is full
+      __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+      return 0;
+    } else {
+      pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+// Single consumer. Returns 0 when the next slot is not published yet.
+static inline int FastTraceRingPop(struct FastTraceRingHeader *ring,
+                                   struct FastTraceEvent *out) {
+  struct FastTraceEvent *slots = FastTraceRingSlots(ring);
+  uint64_t pos = ring->tail;
+  struct FastTraceEvent *slot = &slots[pos & (ring->capacity - 1)];
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1)
+    return 0;
+  *out = *slot;
+  __atomic_store_n(&slot->seq, pos + ring->capacity, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->tail, pos + 1, __ATOMIC_RELAXED);
+  return 1;
+}
+
+#endif // STYLUSDB_FAST_TRACE_RING_H
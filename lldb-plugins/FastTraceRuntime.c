@@ -0,0 +1,131 @@
+//
+// stylusdb
+//
+// Fast-trace runtime, preloaded into the inferior by "calltrace start --fast"
+// (LD_PRELOAD, or DYLD_INSERT_LIBRARIES on macOS). It defines the entry/exit
+// hooks that instrumented builds call and writes one event per hook into the
+// shared-memory ring named by STYLUSDB_FASTTRACE_SHM. No trap, no debugger
+// round trip: a call costs a handful of stores.
+//
+// Supported instrumentation:
+//   -finstrument-functions: __cyg_profile_func_enter/exit
+//   Rust -Z instrument-mcount: mcount / _mcount (entry only; returns are
+//   inferred from frame pointers)
+//   SDK hooks: stylusdb_fasttrace_enter/exit, called directly from the traced
+//   function
+//   Dynamic probes ("calltrace start --probes"): stylusdb_fasttrace_probe,
+//   called from the trampolines stylusdb injects, with the function's CFA
+//
+// The instrumented code must keep frame pointers.
+//
+
+#include "FastTraceRing.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#else
+#include <pthread.h>
+#endif
+
+#define FASTTRACE_HOOK                                                         \
+  __attribute__((no_instrument_function, visibility("default"), used))
+#define FASTTRACE_INTERNAL __attribute__((no_instrument_function))
+
+static struct FastTraceRingHeader *g_ring;
+static __thread uint32_t t_tid;
+
+FASTTRACE_INTERNAL __attribute__((constructor)) static void
+FastTraceAttach(void) {
+  const char *name = getenv(STYLUSDB_FASTTRACE_SHM_ENV);
+  if (!name)
+    return;
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0)
+    return;
+  struct stat st;
+  void *map = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(struct FastTraceRingHeader))
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               fd, 0);
+  close(fd);
+  if (map == MAP_FAILED)
+    return;
+
+  struct FastTraceRingHeader *ring = (struct FastTraceRingHeader *)map;
+  if (__atomic_load_n(&ring->magic, __ATOMIC_ACQUIRE) !=
+          STYLUSDB_FASTTRACE_MAGIC ||
+      ring->version != STYLUSDB_FASTTRACE_VERSION ||
+      FastTraceRingBytes(ring->capacity) > (size_t)st.st_size) {
+    munmap(map, (size_t)st.st_size);
+    return;
+  }
+  __atomic_store_n(&g_ring, ring, __ATOMIC_RELEASE);
+}
+
+FASTTRACE_INTERNAL static inline uint32_t CurrentTid(void) {
+  if (!t_tid) {
+#if defined(__linux__)
+    t_tid = (uint32_t)syscall(SYS_gettid);
+#else
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    t_tid = (uint32_t)tid;
+#endif
+  }
+  return t_tid;
+}
+
+FASTTRACE_INTERNAL static inline void Record(uint64_t fn, uint64_t fp,
+                                             uint32_t kind) {
+  struct FastTraceRingHeader *ring =
+      __atomic_load_n(&g_ring, __ATOMIC_ACQUIRE);
+  if (!ring)
+    return;
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  FastTraceRingPush(ring, fn, fp,
+                    (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec,
+                    CurrentTid(), kind);
+}
+
+// The hooks are called from inside the instrumented function, after its
+// prologue: the frame pointer our own prologue saved is that function's.
+#define CALLER_FP() (*(uint64_t *)__builtin_frame_address(0))
+
+FASTTRACE_HOOK void __cyg_profile_func_enter(void *fn, void *call_site) {
+  (void)call_site;
+  Record((uint64_t)(uintptr_t)fn, CALLER_FP(), kFastTraceEnter);
+}
+
+FASTTRACE_HOOK void __cyg_profile_func_exit(void *fn, void *call_site) {
+  (void)call_site;
+  Record((uint64_t)(uintptr_t)fn, CALLER_FP(), kFastTraceExit);
+}
+
+FASTTRACE_HOOK void mcount(void) {
+  Record((uint64_t)(uintptr_t)__builtin_return_address(0), CALLER_FP(),
+         kFastTraceEnter);
+}
+
+FASTTRACE_HOOK void _mcount(void) {
+  Record((uint64_t)(uintptr_t)__builtin_return_address(0), CALLER_FP(),
+         kFastTraceEnter);
+}
+
+FASTTRACE_HOOK void stylusdb_fasttrace_enter(const void *fn) {
+  Record((uint64_t)(uintptr_t)fn, CALLER_FP(), kFastTraceEnter);
+}
+
+FASTTRACE_HOOK void stylusdb_fasttrace_exit(const void *fn) {
+  Record((uint64_t)(uintptr_t)fn, CALLER_FP(), kFastTraceExit);
+}
+
+FASTTRACE_HOOK void stylusdb_fasttrace_probe(uint64_t fn, uint64_t cfa) {
+  Record(fn, cfa, kFastTraceEnter);
+}
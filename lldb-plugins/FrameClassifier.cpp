@@ -0,0 +1,133 @@
+//
+// stylusdb
+//
+// Frame classification for the call tracer. Symbol and path patterns are
+// compiled into deterministic Aho-Corasick automata over a compressed
+// alphabet (only bytes that occur in some pattern get their own column), so
+// classifying a frame is one table lookup per character.
+//
+
+#include "FrameClassifier.h"
+
+#include <deque>
+
+std::vector<FramePattern> DefaultFramePatterns() {
+  return {
+      {"std::", kMatchSymbol, kMatchPrefix, kFrameRuntime},
+      {"core::", kMatchSymbol, kMatchPrefix, kFrameRuntime},
+      {"alloc::", kMatchSymbol, kMatchPrefix, kFrameRuntime},
+      {"__rust", kMatchSymbol, kMatchSubstring, kFrameRuntime},
+      {"as$u20$stylus_sdk..abi..Router", kMatchSymbol, kMatchSubstring,
+       kFrameRouter},
+      {"core::panicking::assert_failed", kMatchSymbol, kMatchSubstring,
+       kFramePanic},
+      {"core::panicking::panic_fmt", kMatchSymbol, kMatchSubstring, kFramePanic},
+      {"rust_begin_unwind", kMatchSymbol, kMatchSubstring, kFramePanic},
+      {"__assert_rtn", kMatchSymbol, kMatchSubstring, kFrameAbort},
+      {"__assert_fail", kMatchSymbol, kMatchSubstring, kFrameAbort},
+      {"abort", kMatchSymbol, kMatchSubstring, kFrameAbort},
+      {"__builtin_trap", kMatchSymbol, kMatchSubstring, kFrameAbort},
+      {"/rustc/", kMatchPath, kMatchSubstring, kFrameRuntime},
+      {"/library/core/", kMatchPath, kMatchSubstring, kFrameRuntime},
+      {"/library/std/", kMatchPath, kMatchSubstring, kFrameRuntime},
+      {"/library/alloc/", kMatchPath, kMatchSubstring, kFrameRuntime},
+  };
+}
+
+std::vector<FramePattern> g_frame_patterns = DefaultFramePatterns();
+FrameClassifier g_frame_classifier;
+
+void FrameClassifier::Automaton::Build(
+    const std::vector<const FramePattern *> &patterns) {
+  *this = Automaton();
+  for (const FramePattern *p : patterns)
+    for (unsigned char c : p->text)
+      if (!byte_class[c])
+        byte_class[c] = static_cast<uint8_t>(alphabet++);
+
+  // Trie; 0 is the root and doubles as "no edge" while building
+  auto add_state = [this](uint32_t d) {
+    next.resize(next.size() + alphabet, 0);
+    depth.push_back(d);
+    substring_mask.push_back(0);
+    prefix_mask.push_back(0);
+    return static_cast<uint32_t>(depth.size() - 1);
+  };
+  add_state(0);
+  for (const FramePattern *p : patterns) {
+    if (p->text.empty())
+      continue;
+    uint32_t s = 0;
+    for (unsigned char c : p->text) {
+      uint32_t &edge = next[s * alphabet + byte_class[c]];
+      if (!edge) {
+        uint32_t child = add_state(depth[s] + 1);
+        next[s * alphabet + byte_class[c]] = child;
+        s = child;
+      } else {
+        s = edge;
+      }
+    }
+    (p->kind == kMatchPrefix ? prefix_mask : substring_mask)[s] |= p->classes;
+  }
+
+  // Breadth-first: resolve missing edges through the failure links and fold
+  // each state's failure chain into its substring mask
+  std::vector<uint32_t> fail(depth.size(), 0);
+  std::deque<uint32_t> queue;
+  for (uint32_t a = 0; a < alphabet; ++a)
+    if (uint32_t child = next[a])
+      queue.push_back(child);
+  while (!queue.empty()) {
+    uint32_t s = queue.front();
+    queue.pop_front();
+    substring_mask[s] |= substring_mask[fail[s]];
+    for (uint32_t a = 0; a < alphabet; ++a) {
+      uint32_t &edge = next[s * alphabet + a];
+      uint32_t via_fail = next[fail[s] * alphabet + a];
+      if (edge && depth[edge] == depth[s] + 1) {
+        fail[edge] = via_fail;
+        queue.push_back(edge);
+      } else {
+        edge = via_fail;
+      }
+    }
+  }
+}
+
+uint32_t FrameClassifier::Automaton::Feed(std::string_view text,
+                                          uint32_t &state, uint32_t &offset,
+                                          uint32_t mask) const {
+  for (unsigned char c : text) {
+    state = next[state * alphabet + byte_class[c]];
+    ++offset;
+    mask |= substring_mask[state];
+    // Still on the path from the root: the match starts at the first byte
+    if (depth[state] == offset)
+      mask |= prefix_mask[state];
+  }
+  return mask;
+}
+
+void FrameClassifier::Compile(const std::vector<FramePattern> &patterns) {
+  std::vector<const FramePattern *> symbols, paths;
+  for (const FramePattern &p : patterns)
+    (p.target == kMatchSymbol ? symbols : paths).push_back(&p);
+  m_symbols.Build(symbols);
+  m_paths.Build(paths);
+}
+
+uint32_t FrameClassifier::ClassifySymbol(std::string_view name) const {
+  uint32_t state = 0, offset = 0;
+  return m_symbols.Feed(name, state, offset, 0);
+}
+
+uint32_t FrameClassifier::ClassifyPath(std::string_view directory,
+                                       std::string_view file) const {
+  uint32_t state = 0, offset = 0, mask = 0;
+  if (!directory.empty()) {
+    mask = m_paths.Feed(directory, state, offset, mask);
+    mask = m_paths.Feed("/", state, offset, mask);
+  }
+  return m_paths.Feed(file, state, offset, mask);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// What a frame is, as far as tracing cares. A frame can be several at once.
+enum FrameClass : uint32_t {
+  kFrameRuntime = 1u << 0,   // Standard library, compiler runtime or SDK code
+  kFrameRouter = 1u << 1,    // Generated ABI router
+  kFramePanic = 1u << 2,     // Rust panic / assert entry points
+  kFrameAbort = 1u << 3,     // C assert, abort and traps
+};
+
+enum FramePatternTarget : uint8_t {
+  kMatchSymbol, // Function or symbol name
+  kMatchPath,   // "<directory>/<file>" of the frame's line entry
+};
+
+enum FramePatternKind : uint8_t {
+  kMatchPrefix,
+  kMatchSubstring,
+};
+
+struct FramePattern {
+  std::string text;
+  FramePatternTarget target;
+  FramePatternKind kind;
+  uint32_t classes;
+};
+
+// The patterns stylusdb ships with
+std::vector<FramePattern> DefaultFramePatterns();
+
+// Every pattern compiled into one Aho-Corasick automaton per target, so a
+// frame is classified in a single pass over its name (or path) however many
+// patterns there are. Prefix patterns only count while the match is still
+// anchored at the first character. Compile() is not thread-safe; Classify*()
+// on a compiled classifier are.
+class FrameClassifier {
+public:
+  void Compile(const std::vector<FramePattern> &patterns);
+
+  uint32_t ClassifySymbol(std::string_view name) const;
+  uint32_t ClassifyPath(std::string_view directory, std::string_view file) const;
+
+private:
+  struct Automaton {
+    uint8_t byte_class[256] = {}; // 0 for bytes no pattern uses
+    uint32_t alphabet = 1;
+    // Per state: next state for each byte class, with failures resolved
+    std::vector<uint32_t> next;
+    std::vector<uint32_t> depth;
+    std::vector<uint32_t> substring_mask; // Substring matches ending here
+    std::vector<uint32_t> prefix_mask;    // Prefix patterns ending here
+
+    void Build(const std::vector<const FramePattern *> &patterns);
+    uint32_t Feed(std::string_view text, uint32_t &state, uint32_t &offset,
+                  uint32_t mask) const;
+  };
+
+  Automaton m_symbols;
+  Automaton m_paths;
+};
+
+// Patterns as configured by "calltrace classify", and the classifier compiled
+// from them when tracing or coverage starts
+extern std::vector<FramePattern> g_frame_patterns;
+extern FrameClassifier g_frame_classifier;
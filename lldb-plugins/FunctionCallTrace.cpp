@@ -11,6 +11,15 @@
 //
 
 #include "FunctionCallTrace.h"
+#include "ContractCommands.h"
+#include "Coverage.h"
+#include "FastTrace.h"
+#include "FrameClassifier.h"
+#include "HostHooks.h"
+#include "ProbeEngine.h"
+#include "Sampler.h"
+#include "TraceArena.h"
+#include "ValuePool.h"
 
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/SmallString.h>
@@ -27,23 +36,37 @@
 #include <lldb/API/SBEvent.h>
 #include <lldb/API/SBFileSpec.h>
 #include <lldb/API/SBFrame.h>
+#include <lldb/API/SBFunction.h>
 #include <lldb/API/SBListener.h>
 #include <lldb/API/SBProcess.h>
 #include <lldb/API/SBStream.h>
+#include <lldb/API/SBSymbol.h>
+#include <lldb/API/SBSymbolContext.h>
 #include <lldb/API/SBTarget.h>
 #include <lldb/API/SBThread.h>
+#include <lldb/API/SBType.h>
 #include <lldb/API/SBValue.h>
 
+#include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
 #include <cstddef>
 #include <iomanip>
+#include <iterator>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -52,34 +75,224 @@
 
 // -----------------------------------------------------------------------------
 
-// Argument info: name, type, value
+// Argument info: name, type, value. Names and types are interned by LLDB; the
+// value is an id into g_value_pool.
 struct ArgInfo {
-  std::string name;
-  std::string type;
-  std::string value;
+  std::string_view name;
+  std::string_view type;
+  uint32_t value_id;
 };
 
+// A record's arguments, stored contiguously in the trace arena
+struct ArgSpan {
+  const ArgInfo *data = nullptr;
+  uint32_t count = 0;
+
+  size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  const ArgInfo &operator[](size_t i) const { return data[i]; }
+  const ArgInfo *begin() const { return data; }
+  const ArgInfo *end() const { return data + count; }
+};
+
+// Names, files and contracts are views: LLDB interns function names and file
+// specs for the lifetime of the debugger, and registry entries are never
+// erased and keep their address string when registered again or reloaded, so
+// recording a call copies no strings. Records own no memory; the whole trace
+// is dropped by clearing the vector and rewinding the arenas.
 struct CallRecord {
-  std::string function;
-  std::string file;
-  std::string directory;  // Directory path for full file path
+  std::string_view function = "<unknown>";
+  std::string_view file = "<unknown>";
+  std::string_view directory;  // Directory path for full file path
+  std::string_view contract;   // Registered contract owning the PC (if any)
   uint32_t line;
   size_t call_id;        // Unique ID for this call
   size_t parent_call_id; // ID of parent call (0 for root)
+  // Stack pointer at the hit, past the prologue, so the function's own frame
+  // is already allocated; 0 when unknown (synthesized callers, fast tracing)
+  uint64_t sp = 0;
   // For each argument: name, type, value
-  std::vector<ArgInfo> args;
-  // Error info (set if this call caused an error)
-  bool is_error = false;
-  std::string error_message;
+  ArgSpan args;
+};
+
+// Call records as parallel columns: record i is entry i of every column, so a
+// pass over the tree (ids and parents) streams only the bytes it reads.
+// Function names, source locations and contracts are interned into tables
+// and stored as 32-bit ids.
+class TraceStore {
+public:
+  size_t size() const { return m_call_ids.size(); }
+  bool empty() const { return m_call_ids.empty(); }
+
+  void push_back(const CallRecord &rec) {
+    m_call_ids.push_back(rec.call_id);
+    m_parent_ids.push_back(rec.parent_call_id);
+    m_function_ids.push_back(Intern(m_functions, m_function_index, rec.function));
+    m_location_ids.push_back(InternLocation(rec.file, rec.directory));
+    m_lines.push_back(rec.line);
+    m_sps.push_back(rec.sp);
+    m_contract_ids.push_back(
+        rec.contract.empty() ? 0 : Intern(m_contracts, m_contract_index, rec.contract));
+    m_args.push_back(rec.args);
+  }
+
+  // Reassembles record i; every string is a view, so this copies no text
+  CallRecord operator[](size_t i) const {
+    CallRecord rec;
+    rec.call_id = m_call_ids[i];
+    rec.parent_call_id = m_parent_ids[i];
+    rec.function = m_functions[m_function_ids[i]];
+    rec.file = m_locations[m_location_ids[i]].first;
+    rec.directory = m_locations[m_location_ids[i]].second;
+    rec.line = m_lines[i];
+    rec.sp = m_sps[i];
+    rec.contract = m_contracts[m_contract_ids[i]];
+    rec.args = m_args[i];
+    return rec;
+  }
+
+  CallRecord back() const { return (*this)[size() - 1]; }
+
+  // Single columns of record i, for passes that need no full record
+  size_t call_id(size_t i) const { return m_call_ids[i]; }
+  size_t parent_id(size_t i) const { return m_parent_ids[i]; }
+  uint64_t sp(size_t i) const { return m_sps[i]; }
+  uint32_t function_id(size_t i) const { return m_function_ids[i]; }
+  std::string_view function(size_t i) const {
+    return m_functions[m_function_ids[i]];
+  }
+
+  // Keeps the columns' capacity for the next trace
+  void clear() {
+    m_call_ids.clear();
+    m_parent_ids.clear();
+    m_function_ids.clear();
+    m_location_ids.clear();
+    m_lines.clear();
+    m_sps.clear();
+    m_contract_ids.clear();
+    m_args.clear();
+    m_functions.clear();
+    m_function_index.clear();
+    m_locations.clear();
+    m_location_index.clear();
+    m_contracts.assign(1, std::string_view());
+    m_contract_index.clear();
+  }
+
+  struct ColumnUsage {
+    const char *name;
+    size_t used;     // Bytes holding records
+    size_t reserved; // Bytes allocated
+  };
+
+  std::vector<ColumnUsage> MemoryUsage() const {
+    std::vector<ColumnUsage> usage = {
+        Column("call_ids", m_call_ids),
+        Column("parent_ids", m_parent_ids),
+        Column("function_ids", m_function_ids),
+        Column("location_ids", m_location_ids),
+        Column("lines", m_lines),
+        Column("sps", m_sps),
+        Column("contract_ids", m_contract_ids),
+        Column("args", m_args),
+        Column("functions", m_functions),
+        Column("locations", m_locations),
+        Column("contracts", m_contracts),
+    };
+    usage.push_back({"intern indexes",
+                     IndexBytes(m_function_index) + IndexBytes(m_location_index) +
+                         IndexBytes(m_contract_index),
+                     IndexBytes(m_function_index) + IndexBytes(m_location_index) +
+                         IndexBytes(m_contract_index)});
+    return usage;
+  }
+
+private:
+  using Location = std::pair<std::string_view, std::string_view>;
+
+  struct LocationHash {
+    size_t operator()(const Location &l) const {
+      size_t h = std::hash<std::string_view>()(l.first);
+      return h ^ (std::hash<std::string_view>()(l.second) + 0x9e3779b97f4a7c15ULL +
+                  (h << 6) + (h >> 2));
+    }
+  };
+
+  static uint32_t Intern(std::vector<std::string_view> &table,
+                         std::unordered_map<std::string_view, uint32_t> &index,
+                         std::string_view s) {
+    auto it = index.emplace(s, static_cast<uint32_t>(table.size())).first;
+    if (it->second == table.size())
+      table.push_back(s);
+    return it->second;
+  }
+
+  uint32_t InternLocation(std::string_view file, std::string_view directory) {
+    Location key(file, directory);
+    auto it = m_location_index.emplace(key, static_cast<uint32_t>(m_locations.size())).first;
+    if (it->second == m_locations.size())
+      m_locations.push_back(key);
+    return it->second;
+  }
+
+  template <typename T>
+  static ColumnUsage Column(const char *name, const std::vector<T> &column) {
+    return {name, column.size() * sizeof(T), column.capacity() * sizeof(T)};
+  }
+
+  // Approximate: buckets plus one node (value, next pointer, cached hash) per
+  // entry
+  template <typename Map> static size_t IndexBytes(const Map &index) {
+    return index.bucket_count() * sizeof(void *) +
+           index.size() * (sizeof(typename Map::value_type) + 2 * sizeof(void *));
+  }
+
+  std::vector<size_t> m_call_ids;
+  std::vector<size_t> m_parent_ids;
+  std::vector<uint32_t> m_function_ids;
+  std::vector<uint32_t> m_location_ids;
+  std::vector<uint32_t> m_lines;
+  std::vector<uint64_t> m_sps;
+  std::vector<uint32_t> m_contract_ids; // 0 when the PC is in no contract
+  std::vector<ArgSpan> m_args;
+
+  std::vector<std::string_view> m_functions;
+  std::unordered_map<std::string_view, uint32_t> m_function_index;
+  std::vector<Location> m_locations; // (file, directory)
+  std::unordered_map<Location, uint32_t, LocationHash> m_location_index;
+  std::vector<std::string_view> m_contracts{std::string_view()};
+  std::unordered_map<std::string_view, uint32_t> m_contract_index;
+};
+
+struct ActiveCall {
+  uint64_t fp;
+  size_t call_id;
 };
 
 // Thread-local call stack to track hierarchy
 struct ThreadCallStack {
-  std::vector<size_t> stack;  // Stack of call IDs currently active
+  // Shadow stack of the traced frames, outermost first, so frame pointers
+  // decrease toward the top. There are no return breakpoints: a frame whose
+  // pointer lies below the current SP has returned, and is popped before the
+  // stack is consulted.
+  std::vector<ActiveCall> stack;
   size_t next_call_id = 1; // Start with 1 (0 means no parent)
-  std::map<uint64_t, size_t> active_frames; // Map frame pointer to call_id
 };
 
+static void PopReturnedCalls(ThreadCallStack &calls, lldb::addr_t sp) {
+  while (!calls.stack.empty() && calls.stack.back().fp < sp)
+    calls.stack.pop_back();
+}
+
+// A frame at or below `fp` is gone once a call occupies `fp`
+static void PushActiveCall(ThreadCallStack &calls, uint64_t fp,
+                           size_t call_id) {
+  while (!calls.stack.empty() && calls.stack.back().fp <= fp)
+    calls.stack.pop_back();
+  calls.stack.push_back({fp, call_id});
+}
+
 // Global flag to track if we hit a panic breakpoint
 static std::atomic<bool> g_panic_detected{false};
 
@@ -96,11 +309,19 @@ struct ExecutionStatus {
 };
 
 static std::mutex g_trace_mutex;
-static std::vector<CallRecord> g_trace_data;
+static TraceStore g_trace_data;
+// Argument storage. Arena 0 belongs to the breakpoint callback, arena i + 1 to
+// trace worker i; "calltrace start" rewinds them all.
+static std::vector<std::unique_ptr<TraceArena>> g_trace_arenas;
+// Distinct argument values of the trace, shared by all records
+static ValuePool g_value_pool;
+static bool g_trace_huge_pages = false;
 static ExecutionStatus g_execution_status;
 // Use thread-specific storage for call stacks
 static thread_local ThreadCallStack g_thread_call_stack;
 static thread_local size_t g_base_depth = SIZE_MAX;
+// DEBUG_TRACE, read once per "calltrace start"
+static bool g_debug_trace = false;
 
 // Decoding functions.
 
@@ -390,10 +611,49 @@ static bool ExtractPrimitiveInt(lldb::SBValue &val, std::string &out) {
   return false;
 }
 
+// -----------------------------------------------------------------------------
+// Argument capture policies ("calltrace policy").
+//
+// A policy decides how much of an argument is recorded: nothing, its type
+// only, its top-level fields, or the full value within depth/children/byte
+// limits. Rules match either the traced function or the argument type by
+// regex; they are compiled at "calltrace start" and resolved once per
+// breakpoint location (and once per type name), so a hit never touches a
+// regex.
+enum CaptureMode : uint8_t {
+  kCaptureNone,     // Argument is not recorded at all
+  kCaptureTypeOnly, // Name and type, no value
+  kCaptureShallow,  // Top-level fields only
+  kCaptureFull,
+};
+
+struct CapturePolicy {
+  CaptureMode mode = kCaptureFull;
+  int max_depth = 8;
+  uint32_t max_children = 32;
+  size_t max_bytes = 1024; // Per hit, across all arguments
+  bool include_self = false;
+
+  int EffectiveDepth() const {
+    return mode == kCaptureShallow ? std::min(max_depth, 1) : max_depth;
+  }
+};
+
+struct CapturePolicyRule {
+  bool match_type; // Otherwise matches the function name
+  std::string pattern;
+  CapturePolicy policy;
+};
+
+static const char *const kCaptureModeNames[] = {"none", "type-only", "shallow",
+                                                "full"};
+static const char *kNotCaptured = "<not captured>";
+
 // -----------------------------------------------------------------------------
 // Helper: Recursively format an SBValue (structs, arrays, etc.) as a string.
 
-static std::string FormatValueRecursive(lldb::SBValue &val, int depth = 0) {
+static std::string FormatValueRecursive(lldb::SBValue &val, int depth = 0,
+                                        const CapturePolicy *policy = nullptr) {
   if (!val.IsValid()) {
     return "<invalid>";
   }
@@ -466,20 +726,32 @@ static std::string FormatValueRecursive(lldb::SBValue &val, int depth = 0) {
   // If we have children, build a string from them
   uint32_t num_children = val.GetNumChildren();
   if (num_children > 0) {
+    if (policy && depth >= policy->EffectiveDepth())
+      return "{...}";
+    uint32_t shown = policy ? std::min(num_children, policy->max_children)
+                            : num_children;
+
     // Collect child fields in JSON-ish format (without type name - shown separately)
     std::ostringstream oss;
     oss << "{ ";
-    for (uint32_t i = 0; i < num_children; ++i) {
+    for (uint32_t i = 0; i < shown; ++i) {
       lldb::SBValue child = val.GetChildAtIndex(i);
       if (!child.IsValid()) continue;
 
       const char *child_name = child.GetName();
       if (!child_name) child_name = "<anon>";
-      oss << child_name << "=" << FormatValueRecursive(child, depth + 1);
-      if (i + 1 < num_children) {
+      oss << child_name << "=" << FormatValueRecursive(child, depth + 1, policy);
+      // Already over the byte budget; the caller truncates
+      if (policy && (size_t)oss.tellp() > policy->max_bytes) {
+        shown = i + 1;
+        break;
+      }
+      if (i + 1 < shown) {
         oss << ", ";
       }
     }
+    if (shown < num_children)
+      oss << ", ...";
     oss << " }";
     return oss.str();
   }
@@ -488,206 +760,953 @@ static std::string FormatValueRecursive(lldb::SBValue &val, int depth = 0) {
   return "<unavailable>";
 }
 
-static std::string ExtractBaseName(const std::string &fn) {
-  // Goal: Extract a meaningful identifier from Rust function names
-  // Examples:
-  //   crate::Module::Struct::method::h123abc -> Struct::method
-  //   crate::function::h123abc -> function
-  //   Struct::method::h123abc -> Struct::method
-  //   function::h123abc -> function
-  //   some::module::function -> function (if no hash)
+// -----------------------------------------------------------------------------
+// Stack-snapshot decoding.
+//
+// Reading arguments through SBValue costs one inferior memory read per leaf
+// (every limb of a Uint, every field of a struct), which adds up fast when the
+// process sits behind lldb-server. At each hit we instead read a window of the
+// stack above SP in one go and decode the arguments that live in it straight
+// from that buffer, using the static type layout. Anything that lives in
+// registers, points outside the window, or has a layout we don't understand
+// goes through FormatValueRecursive as before.
+
+// Upper bound of the window. Each hit reads only as far as its arguments'
+// stack locations reach; data they point to is not followed.
+static constexpr lldb::addr_t kStackSnapshotSize = 16 * 1024;
+static bool g_use_stack_snapshot = true;
+
+struct StackSnapshot {
+  lldb::addr_t base = LLDB_INVALID_ADDRESS;
+  std::vector<uint8_t> bytes;
+
+  const uint8_t *At(lldb::addr_t addr, uint64_t size) const {
+    if (base == LLDB_INVALID_ADDRESS || addr < base ||
+        addr - base + size > bytes.size())
+      return nullptr;
+    return bytes.data() + (addr - base);
+  }
+};
 
-  // First, remove the hash suffix if it exists
-  std::string name = fn;
-  auto last_sep = name.rfind("::");
-  if (last_sep != std::string::npos && last_sep + 2 < name.length()) {
-    // Check if what follows :: looks like a hash (h followed by hex)
-    if (name[last_sep + 2] == 'h' && last_sep + 3 < name.length()) {
-      bool is_hash = true;
-      for (size_t i = last_sep + 3; i < name.length() && is_hash; i++) {
-        char c = name[i];
-        is_hash = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
-                  (c >= 'A' && c <= 'F');
-      }
-      if (is_hash) {
-        // Remove the hash suffix
-        name = name.substr(0, last_sep);
-      }
-    }
+// Bytes from SP up to the end of the last argument stored within
+// kStackSnapshotSize of it; 0 when every argument lives in a register.
+// Locations are known without reading the inferior.
+static lldb::addr_t ArgumentWindowSize(lldb::SBFrame &frame,
+                                       lldb::SBValueList &vars) {
+  lldb::addr_t sp = frame.GetSP();
+  lldb::addr_t window = 0;
+  for (uint32_t i = 0; i < vars.GetSize(); ++i) {
+    lldb::SBValue v = vars.GetValueAtIndex(i);
+    const char *location = v.IsValid() ? v.GetLocation() : nullptr;
+    if (!location || std::strncmp(location, "0x", 2) != 0)
+      continue;
+    lldb::addr_t addr = std::strtoull(location, nullptr, 16);
+    if (addr < sp || addr - sp >= kStackSnapshotSize)
+      continue;
+    lldb::addr_t end = addr - sp + v.GetByteSize();
+    window = std::max(window, std::min(end, kStackSnapshotSize));
   }
+  return window;
+}
 
-  // Now extract the meaningful part
-  // Count how many :: separators we have
-  std::vector<size_t> separators;
-  size_t pos = 0;
-  while ((pos = name.find("::", pos)) != std::string::npos) {
-    separators.push_back(pos);
-    pos += 2;
+static void CaptureStackSnapshot(lldb::SBProcess &process, lldb::SBFrame &frame,
+                                 lldb::addr_t size, StackSnapshot &snap) {
+  lldb::addr_t sp = frame.GetSP();
+  if (sp == LLDB_INVALID_ADDRESS || size == 0)
+    return;
+  snap.bytes.resize(size);
+  lldb::SBError err;
+  size_t read = process.ReadMemory(sp, snap.bytes.data(), snap.bytes.size(), err);
+  // Near the top of the stack only part of the window is mapped
+  if (read == 0 && frame.GetCFA() > sp && frame.GetCFA() - sp < size) {
+    snap.bytes.resize(frame.GetCFA() - sp);
+    read = process.ReadMemory(sp, snap.bytes.data(), snap.bytes.size(), err);
   }
+  snap.bytes.resize(read);
+  if (read)
+    snap.base = sp;
+}
 
-  if (separators.empty()) {
-    // No separators, return as is
-    return name;
+static llvm::APInt LoadAPInt(const uint8_t *p, unsigned bits) {
+  llvm::APInt api(bits, 0);
+  for (unsigned i = 0; i < bits / 64; ++i) {
+    uint64_t limb;
+    std::memcpy(&limb, p + i * 8, sizeof(limb));
+    api |= llvm::APInt(64, limb).zext(bits).shl(64ull * i);
   }
+  return api;
+}
 
-  // If we have exactly one separator, it might be Struct::method or
-  // module::function
-  if (separators.size() == 1) {
-    // Check what comes before the separator
-    std::string first_part = name.substr(0, separators[0]);
-    std::string second_part = name.substr(separators[0] + 2);
+static std::string APIntToString(const llvm::APInt &api, bool is_signed) {
+  llvm::SmallString<128> buffer;
+  api.toString(buffer, /*Radix=*/10, is_signed);
+  return buffer.c_str();
+}
 
-    // If the first part looks like a crate/module name (contains underscore or
-    // all lowercase), just return the second part (the function name)
-    bool is_crate_or_module = false;
-    if (first_part.find('_') != std::string::npos) {
-      is_crate_or_module = true; // Crate names often have underscores
-    } else {
-      // Check if all lowercase (module) vs has uppercase (Type)
-      bool has_upper = false;
-      for (char c : first_part) {
-        if (c >= 'A' && c <= 'Z') {
-          has_upper = true;
-          break;
-        }
-      }
-      is_crate_or_module = !has_upper;
+static std::string HexFromBytes(const uint8_t *p, size_t len) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string hex = "0x";
+  hex.reserve(2 + len * 2);
+  for (size_t i = 0; i < len; ++i) {
+    hex += kHex[p[i] >> 4];
+    hex += kHex[p[i] & 0xf];
+  }
+  return hex;
+}
+
+// Parses the two integer template arguments of "Prefix<A, B>"
+static bool ParseTwoParams(const std::string &type_name, int &a, int &b) {
+  auto lt = type_name.find('<');
+  auto comma = type_name.find(',', lt);
+  auto gt = type_name.find('>', comma);
+  if (lt == std::string::npos || comma == std::string::npos ||
+      gt == std::string::npos)
+    return false;
+  a = std::atoi(type_name.c_str() + lt + 1);
+  b = std::atoi(type_name.c_str() + comma + 1);
+  return a > 0 && b > 0;
+}
+
+// Static layout of a value, flattened from its SBType once so that values can
+// be decoded from raw bytes without further SB calls, e.g. on the trace
+// workers while the inferior runs. Parts the decoder does not handle become
+// kUnsupported nodes; decoding fails only if it reaches one.
+struct TypeLayout {
+  enum Kind : uint8_t {
+    kUnsupported,
+    kUnsigned,
+    kSigned,
+    kInt128,
+    kBool,
+    kAddress,
+    kFixedBytes,
+    kBigInt, // ruint::Uint and alloy Signed, limbs of 64 bits
+    kPointer,
+    kArray,
+    kStruct,
+  };
+  Kind kind = kUnsupported;
+  bool is_signed = false;
+  uint64_t size = 0;
+  uint64_t count = 0;  // kFixedBytes: bytes shown; kArray: elements
+  unsigned bits = 0;   // kBigInt: value width
+  unsigned limbs = 0;  // kBigInt
+  std::string name;    // Field name, for members of a kStruct
+  uint64_t offset = 0; // Field offset, for members of a kStruct
+  std::vector<TypeLayout> children; // kArray: the element; kStruct: fields
+};
+
+// Compiles the layout of `type` stored in `size` bytes. Mirrors
+// FormatValueRecursive's output for every kind it accepts.
+static TypeLayout CompileTypeLayout(lldb::SBType type, uint64_t size) {
+  TypeLayout layout;
+  layout.size = size;
+  const char *cname = type.GetName();
+  if (!cname)
+    return layout;
+  std::string type_name(cname);
+
+  if (type_name == "u8" || type_name == "u16" || type_name == "u32" ||
+      type_name == "u64" || type_name == "i8" || type_name == "i16" ||
+      type_name == "i32" || type_name == "i64") {
+    if (size <= 8)
+      layout.kind = type_name[0] == 'u' ? TypeLayout::kUnsigned
+                                        : TypeLayout::kSigned;
+    return layout;
+  }
+  if (type_name == "u128" || type_name == "i128") {
+    if (size >= 16) {
+      layout.kind = TypeLayout::kInt128;
+      layout.is_signed = type_name[0] == 'i';
     }
+    return layout;
+  }
+  if (type_name == "bool") {
+    layout.kind = TypeLayout::kBool;
+    return layout;
+  }
 
-    if (is_crate_or_module) {
-      // It's crate::function or module::function, return just the function
-      return second_part;
-    } else {
-      // It's Type::method, return both
-      return name;
+  if (type_name.rfind("alloy_primitives::bits::address::Address", 0) == 0) {
+    if (size >= 20)
+      layout.kind = TypeLayout::kAddress;
+    return layout;
+  }
+  if (type_name.rfind("alloy_primitives::bits::fixed::FixedBytes<", 0) == 0) {
+    int n = std::atoi(type_name.c_str() + type_name.find('<') + 1);
+    if (n > 0 && (uint64_t)n <= size) {
+      layout.kind = TypeLayout::kFixedBytes;
+      layout.count = n;
+    }
+    return layout;
+  }
+  bool is_uint = type_name.rfind("ruint::Uint<", 0) == 0;
+  if (is_uint ||
+      type_name.rfind("alloy_primitives::signed::int::Signed<", 0) == 0) {
+    int bits, limbs;
+    if (ParseTwoParams(type_name, bits, limbs) && (uint64_t)limbs * 8 <= size &&
+        bits <= limbs * 64) {
+      layout.kind = TypeLayout::kBigInt;
+      layout.is_signed = !is_uint;
+      layout.bits = bits;
+      layout.limbs = limbs;
     }
+    return layout;
   }
 
-  // For multiple separators, we want the last two components (Type::method)
-  // unless the second-to-last looks like a module (lowercase)
-  if (separators.size() >= 2) {
-    size_t start = separators[separators.size() - 2] + 2;
-    std::string last_two = name.substr(start);
-
-    // Check if this looks like Type::method (Type starts with uppercase)
-    // or if it's module::function (module is lowercase)
-    size_t mid = last_two.find("::");
-    if (mid != std::string::npos && mid > 0) {
-      char first_char = last_two[0];
-      if (first_char >= 'A' && first_char <= 'Z') {
-        // Looks like Type::method, keep both parts
-        return last_two;
+  // Byte containers point outside the stack; leave them to the SBValue path
+  if (type_name.find("[u8]") != std::string::npos ||
+      type_name.rfind("stylus_sdk::abi::bytes::Bytes", 0) == 0 ||
+      type_name.rfind("alloc::", 0) == 0 || type_name.rfind("core::", 0) == 0 ||
+      type_name.rfind("std::", 0) == 0)
+    return layout;
+
+  lldb::TypeClass type_class = type.GetTypeClass();
+  if (type_class == lldb::eTypeClassPointer ||
+      type_class == lldb::eTypeClassReference) {
+    if (size == 8)
+      layout.kind = TypeLayout::kPointer;
+    return layout;
+  }
+
+  if (type_class == lldb::eTypeClassArray) {
+    lldb::SBType elem = type.GetArrayElementType();
+    uint64_t elem_size = elem.GetByteSize();
+    if (!elem.IsValid() || elem_size == 0 || size / elem_size == 0)
+      return layout;
+    layout.kind = TypeLayout::kArray;
+    layout.count = size / elem_size;
+    layout.children.push_back(CompileTypeLayout(elem, elem_size));
+    return layout;
+  }
+
+  if (type_class == lldb::eTypeClassStruct || type_class == lldb::eTypeClassClass) {
+    uint32_t num_fields = type.GetNumberOfFields();
+    if (num_fields == 0)
+      return layout;
+    layout.kind = TypeLayout::kStruct;
+    layout.children.reserve(num_fields);
+    for (uint32_t i = 0; i < num_fields; ++i) {
+      lldb::SBTypeMember field = type.GetFieldAtIndex(i);
+      const char *fname = field.IsValid() ? field.GetName() : nullptr;
+      TypeLayout member;
+      // Enums show up as structs with "$variants$"-style members
+      if (field.IsValid() && !(fname && fname[0] == '$')) {
+        lldb::SBType ftype = field.GetType();
+        uint64_t off = field.GetOffsetInBytes();
+        uint64_t fsize = ftype.GetByteSize();
+        if (off + fsize <= size)
+          member = CompileTypeLayout(ftype, fsize);
+        member.offset = off;
       }
+      member.name = fname ? fname : "<anon>";
+      layout.children.push_back(std::move(member));
     }
-
-    // Otherwise just return the last component
-    return name.substr(separators.back() + 2);
+    return layout;
   }
 
-  // Default: return last component after the last ::
-  return name.substr(separators.back() + 2);
+  return layout;
 }
 
-// Helper: Read a source line from file and extract error message
-static std::string ReadSourceLine(const char *filepath, uint32_t line_num) {
-   if (!filepath || line_num == 0) return "";
+// Decodes a value laid out as `layout` stored at `p`. Output matches what
+// FormatValueRecursive prints for the same value. Returns false for anything
+// it does not handle so the caller can fall back to the SBValue path.
+static bool DecodeLayout(const TypeLayout &layout, const uint8_t *p,
+                         std::string &out,
+                         const CapturePolicy *policy = nullptr,
+                         int depth = 0) {
+  uint64_t size = layout.size;
+  switch (layout.kind) {
+  case TypeLayout::kUnsupported:
+    return false;
+  case TypeLayout::kUnsigned: {
+    uint64_t v = 0;
+    std::memcpy(&v, p, size);
+    out = std::to_string(v);
+    return true;
+  }
+  case TypeLayout::kSigned: {
+    uint64_t v = 0;
+    std::memcpy(&v, p, size);
+    unsigned shift = 64 - 8 * size;
+    out = std::to_string(static_cast<int64_t>(v << shift) >> shift);
+    return true;
+  }
+  case TypeLayout::kInt128:
+    out = APIntToString(LoadAPInt(p, 128), layout.is_signed);
+    return true;
+  case TypeLayout::kBool:
+    out = *p ? "true" : "false";
+    return true;
+  case TypeLayout::kAddress: {
+    static const uint8_t kZero[20] = {};
+    out = std::memcmp(p, kZero, 20) == 0 ? "<zero address>" : HexFromBytes(p, 20);
+    return true;
+  }
+  case TypeLayout::kFixedBytes:
+    out = HexFromBytes(p, layout.count);
+    return true;
+  case TypeLayout::kBigInt: {
+    llvm::APInt api = LoadAPInt(p, layout.limbs * 64).trunc(layout.bits);
+    out = APIntToString(api, layout.is_signed);
+    if (out == "0")
+      out = "<unavailable>";
+    return true;
+  }
+  case TypeLayout::kPointer: {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "0x%016llx", (unsigned long long)v);
+    out = buf;
+    return true;
+  }
+  case TypeLayout::kArray: {
+    const TypeLayout &elem = layout.children[0];
+    uint64_t count = layout.count;
+    if (policy && depth >= policy->EffectiveDepth()) {
+      out = "{...}";
+      return true;
+    }
+    uint64_t shown = policy ? std::min<uint64_t>(count, policy->max_children) : count;
+    std::string body = "{ ";
+    for (uint64_t i = 0; i < shown; ++i) {
+      std::string v;
+      if (!DecodeLayout(elem, p + i * elem.size, v, policy, depth + 1))
+        return false;
+      body += "[" + std::to_string(i) + "]=" + v;
+      if (policy && body.size() > policy->max_bytes) {
+        shown = i + 1;
+        break;
+      }
+      if (i + 1 < shown)
+        body += ", ";
+    }
+    if (shown < count)
+      body += ", ...";
+    out = body + " }";
+    return true;
+  }
+  case TypeLayout::kStruct: {
+    uint32_t num_fields = static_cast<uint32_t>(layout.children.size());
+    if (policy && depth >= policy->EffectiveDepth()) {
+      out = "{...}";
+      return true;
+    }
+    uint32_t shown = policy ? std::min(num_fields, policy->max_children) : num_fields;
+    std::string body = "{ ";
+    for (uint32_t i = 0; i < shown; ++i) {
+      const TypeLayout &field = layout.children[i];
+      std::string v;
+      if (!DecodeLayout(field, p + field.offset, v, policy, depth + 1))
+        return false;
+      body += field.name + "=" + v;
+      if (policy && body.size() > policy->max_bytes) {
+        shown = i + 1;
+        break;
+      }
+      if (i + 1 < shown)
+        body += ", ";
+    }
+    if (shown < num_fields)
+      body += ", ...";
+    out = body + " }";
+    return true;
+  }
+  }
+  return false;
+}
 
-   FILE *src = std::fopen(filepath, "r");
-   if (!src) return "";
+static bool FormatValueFromSnapshot(const StackSnapshot &snap, lldb::SBValue &val,
+                                    std::string &out,
+                                    const CapturePolicy *policy = nullptr) {
+  lldb::addr_t addr = val.GetLoadAddress();
+  if (addr == LLDB_INVALID_ADDRESS)
+    return false; // Register-located; LLDB's per-stop register cache serves it
+  lldb::SBType type = val.GetType();
+  uint64_t size = type.GetByteSize();
+  const uint8_t *p = size ? snap.At(addr, size) : nullptr;
+  return p && DecodeLayout(CompileTypeLayout(type, size), p, out, policy);
+}
 
-   char line_buf[1024];
-   uint32_t current_line = 0;
-   std::string result;
+// -----------------------------------------------------------------------------
+// Compiled argument extractors.
+//
+// GetVariables() re-evaluates every parameter's DWARF location and builds
+// fresh SBValues on each hit. The first hit of a breakpoint location records,
+// per parameter, where it lives (a register, or an offset from SP into the
+// stack snapshot) and how to decode it; later hits at the same PC replay that
+// recipe against the registers and the snapshot. Locations we cannot express
+// that way (composite pieces, memory outside the snapshot, values too wide for
+// one register) mark the function as uncompilable and it keeps using the
+// SBValue path.
+
+enum ArgDecoderKind : uint8_t {
+  kArgDecodeUnsigned,
+  kArgDecodeSigned,
+  kArgDecodeBool,
+  kArgDecodeGeneric, // DecodeLayout over the recorded layout
+};
 
-   while (std::fgets(line_buf, sizeof(line_buf), src)) {
-     current_line++;
-     if (current_line == line_num) {
-       result = line_buf;
-       // Trim whitespace
-       size_t start = result.find_first_not_of(" \t\n\r");
-       size_t end = result.find_last_not_of(" \t\n\r");
-       if (start != std::string::npos && end != std::string::npos) {
-         result = result.substr(start, end - start + 1);
-       }
-       break;
-     }
-   }
-   std::fclose(src);
+struct ArgExtractorStep {
+  std::string_view name;      // Interned by LLDB
+  std::string_view type_name; // Interned by LLDB
+  std::string reg;          // Register holding the value; empty if in memory
+  int64_t sp_offset = 0;    // Memory location relative to SP
+  uint64_t size = 0;
+  ArgDecoderKind decoder = kArgDecodeGeneric;
+  TypeLayout layout; // kArgDecodeGeneric only
+  const CapturePolicy *policy = nullptr;
+  CaptureMode mode = kCaptureFull; // After the "self" rule
+};
 
-   return result;
-}
+struct ArgExtractor {
+  bool compiled = false;
+  bool needs_snapshot = false;
+  // SP-relative byte range covering every memory step, so replaying the
+  // extractor reads only the bytes it decodes
+  int64_t span_begin = 0;
+  int64_t span_end = 0;
+  std::vector<ArgExtractorStep> steps;
+};
 
-// Helper: Extract panic message from panic_fmt or assert_failed frame arguments
-// The from_str function returns { ptr, ptr } where:
-//   - First ptr: points to the string data (the alloc_XXX static string)
-//   - Second ptr: metadata pointer (for slices this contains length info)
-// However, in practice for simple string panics, we often get:
-//   arg0 = pointer to string data
-//   arg1 = length or slice metadata
-//   arg2 = location pointer
+// Guards the extractor and policy caches below
+static std::mutex g_capture_mutex;
+// Breakpoint location PC -> extractor
+static std::unordered_map<lldb::addr_t, ArgExtractor> g_arg_extractors;
 
-// TODO: Need to be main implementation, currently it does not works
-static std::string ExtractPanicMessage(lldb::SBThread &thread, lldb::SBProcess &process) {
-  lldb::SBFrame frame0 = thread.GetFrameAtIndex(0);
-  if (!frame0.IsValid()) return "";
+// Rules as configured by "calltrace policy"; copied and compiled at start so
+// editing them mid-trace cannot invalidate the cached pointers.
+static std::vector<CapturePolicyRule> g_policy_rules;
+static CapturePolicy g_default_policy;
 
-  const char *fn = frame0.GetFunctionName();
-  if (!fn) return "";
-  std::string func_name(fn);
+struct CompiledPolicyRule {
+  std::regex re;
+  const CapturePolicy *policy;
+};
+static std::vector<CapturePolicyRule> g_active_policy_rules;
+static CapturePolicy g_active_default_policy;
+static std::vector<CompiledPolicyRule> g_function_policy_rules;
+static std::vector<CompiledPolicyRule> g_type_policy_rules;
+// Breakpoint location PC -> function policy
+static std::unordered_map<lldb::addr_t, const CapturePolicy *> g_location_policies;
+// Type name (interned by LLDB) -> type policy, nullptr when no type rule
+// matches
+static std::unordered_map<std::string_view, const CapturePolicy *> g_type_policies;
+
+static void CompileCapturePolicies() {
+  std::lock_guard<std::mutex> lk(g_capture_mutex);
+  g_active_policy_rules = g_policy_rules;
+  g_active_default_policy = g_default_policy;
+  g_function_policy_rules.clear();
+  g_type_policy_rules.clear();
+  g_location_policies.clear();
+  g_type_policies.clear();
+  g_arg_extractors.clear();
+  for (const auto &rule : g_active_policy_rules) {
+    // Patterns were validated by "calltrace policy add"
+    CompiledPolicyRule compiled{std::regex(rule.pattern), &rule.policy};
+    (rule.match_type ? g_type_policy_rules : g_function_policy_rules)
+        .push_back(std::move(compiled));
+  }
+}
 
-  // Get function arguments
-  lldb::SBValueList args = frame0.GetVariables(/*arguments=*/true, /*locals=*/false,
-                                               /*statics=*/false, /*in_scope_only=*/true);
-  
-  // Try interpreting first two args as (data_ptr, length) for &str
-  if (args.GetSize() >= 2) {
-    lldb::SBValue arg0 = args.GetValueAtIndex(0);
-    lldb::SBValue arg1 = args.GetValueAtIndex(1);
-    
-    if (arg0.IsValid() && arg1.IsValid()) {
-      uint64_t ptr = arg0.GetValueAsUnsigned(0);
-      uint64_t len = arg1.GetValueAsUnsigned(0);
-      
-      // Sanity check - len should be reasonable for a message (1-4096 chars)
-      if (ptr != 0 && len > 0 && len < 4096) {
-        std::vector<char> buf(len + 1, 0);
-        lldb::SBError err;
-        size_t read = process.ReadMemory(ptr, buf.data(), len, err);
-        
-        if (!err.Fail() && read == len) {
-          // Validate it looks like a string (printable ASCII/UTF-8)
-          bool valid = true;
-          for (size_t i = 0; i < len && valid; ++i) {
-            unsigned char c = buf[i];
-            // Allow printable ASCII, common control chars, and UTF-8 continuation bytes
-            valid = (c >= 0x20 && c < 0x7F) || c == '\n' || c == '\r' || c == '\t' || (c >= 0x80);
-          }
-          if (valid) {
-            std::string msg(buf.data(), len);
-            return msg;
-          }
-        }
+// Caller must hold g_capture_mutex.
+static const CapturePolicy *ResolveFunctionPolicy(lldb::addr_t location_pc,
+                                                  std::string_view fn) {
+  auto it = g_location_policies.find(location_pc);
+  if (it != g_location_policies.end())
+    return it->second;
+  const CapturePolicy *policy = &g_active_default_policy;
+  for (const auto &rule : g_function_policy_rules) {
+    if (std::regex_search(fn.begin(), fn.end(), rule.re)) {
+      policy = rule.policy;
+      break;
+    }
+  }
+  g_location_policies.emplace(location_pc, policy);
+  return policy;
+}
+
+// Caller must hold g_capture_mutex.
+static const CapturePolicy *ResolveArgPolicy(const CapturePolicy *fn_policy,
+                                             std::string_view type_name) {
+  if (g_type_policy_rules.empty())
+    return fn_policy;
+  auto it = g_type_policies.find(type_name);
+  if (it == g_type_policies.end()) {
+    const CapturePolicy *policy = nullptr;
+    for (const auto &rule : g_type_policy_rules) {
+      if (std::regex_search(type_name.begin(), type_name.end(), rule.re)) {
+        policy = rule.policy;
+        break;
       }
     }
+    it = g_type_policies.emplace(type_name, policy).first;
   }
+  return it->second ? it->second : fn_policy;
+}
 
-  // For fmt::Arguments structure - look for pieces field
-  for (uint32_t i = 0; i < args.GetSize(); ++i) {
-    lldb::SBValue arg = args.GetValueAtIndex(i);
-    if (!arg.IsValid()) continue;
+static CaptureMode ArgCaptureMode(const CapturePolicy *policy,
+                                  std::string_view name) {
+  if (name == "self" && !policy->include_self)
+    return std::min(policy->mode, kCaptureTypeOnly);
+  return policy->mode;
+}
 
-    const char *type_name = arg.GetTypeName();
-    if (!type_name) continue;
-    std::string type_str(type_name);
-    
-    if (type_str.find("fmt::Arguments") != std::string::npos) {
-      // Arguments has a 'pieces' field which contains the static string parts
-      lldb::SBValue pieces = arg.GetChildMemberWithName("pieces");
-      if (pieces.IsValid() && pieces.GetNumChildren() > 0) {
-        lldb::SBValue piece0 = pieces.GetChildAtIndex(0);
-        if (piece0.IsValid()) {
-          lldb::SBValue data_ptr = piece0.GetChildMemberWithName("data_ptr");
-          lldb::SBValue length = piece0.GetChildMemberWithName("length");
+// Interns the value, truncated to what is left of the call's byte budget
+static void AppendArg(std::vector<ArgInfo> &args, std::string_view name,
+                      std::string_view type, std::string_view value,
+                      size_t &bytes_left) {
+  uint32_t id;
+  if (value.size() > bytes_left) {
+    std::string truncated(value.substr(0, bytes_left));
+    truncated += "...";
+    id = g_value_pool.Intern(truncated);
+  } else {
+    id = g_value_pool.Intern(value);
+  }
+  bytes_left -= std::min(bytes_left, value.size());
+  args.push_back({name, type, id});
+}
+
+static ArgSpan StoreArgs(TraceArena &arena, const std::vector<ArgInfo> &args) {
+  ArgSpan span;
+  if (args.empty())
+    return span;
+  ArgInfo *data = arena.AllocateArray<ArgInfo>(args.size());
+  std::copy(args.begin(), args.end(), data);
+  span.data = data;
+  span.count = static_cast<uint32_t>(args.size());
+  return span;
+}
+
+static ArgDecoderKind ClassifyArgDecoder(std::string_view type_name) {
+  if (type_name == "u8" || type_name == "u16" || type_name == "u32" ||
+      type_name == "u64" || type_name == "usize")
+    return kArgDecodeUnsigned;
+  if (type_name == "i8" || type_name == "i16" || type_name == "i32" ||
+      type_name == "i64" || type_name == "isize")
+    return kArgDecodeSigned;
+  if (type_name == "bool")
+    return kArgDecodeBool;
+  return kArgDecodeGeneric;
+}
+
+static bool RunArgDecoder(const ArgExtractorStep &step, const uint8_t *p,
+                          std::string &out) {
+  switch (step.decoder) {
+  case kArgDecodeUnsigned: {
+    uint64_t v = 0;
+    std::memcpy(&v, p, step.size);
+    out = std::to_string(v);
+    return true;
+  }
+  case kArgDecodeSigned: {
+    uint64_t v = 0;
+    std::memcpy(&v, p, step.size);
+    unsigned shift = 64 - 8 * step.size;
+    out = std::to_string(static_cast<int64_t>(v << shift) >> shift);
+    return true;
+  }
+  case kArgDecodeBool:
+    out = *p ? "true" : "false";
+    return true;
+  case kArgDecodeGeneric:
+    return DecodeLayout(step.layout, p, out, step.policy);
+  }
+  return false;
+}
+
+// Builds the extractor from the first hit's SBValues. Every captured parameter
+// must be decodable from its register or from the snapshot, or nothing is
+// compiled. Caller must hold g_capture_mutex.
+static ArgExtractor CompileArgExtractor(lldb::SBFrame &frame,
+                                        lldb::SBValueList &vars,
+                                        const StackSnapshot &snap,
+                                        const CapturePolicy *fn_policy) {
+  ArgExtractor ex;
+  lldb::addr_t sp = frame.GetSP();
+  lldb::addr_t cfa = frame.GetCFA();
+  for (uint32_t i = 0; i < vars.GetSize(); ++i) {
+    lldb::SBValue v = vars.GetValueAtIndex(i);
+    if (!v.IsValid())
+      return ex;
+
+    ArgExtractorStep step;
+    const char *n = v.GetName();
+    const char *type_name = v.GetTypeName();
+    step.name = n ? n : "<anon>";
+    step.type_name = type_name ? type_name : "<unknown>";
+    step.policy = ResolveArgPolicy(fn_policy, step.type_name);
+    step.mode = ArgCaptureMode(step.policy, step.name);
+    if (step.mode <= kCaptureTypeOnly) {
+      // Nothing to read at hit time
+      ex.steps.push_back(std::move(step));
+      continue;
+    }
+
+    lldb::SBType type = v.GetType();
+    step.size = type.GetByteSize();
+    step.decoder = ClassifyArgDecoder(step.type_name);
+    if (step.size == 0 || (step.decoder != kArgDecodeGeneric && step.size > 8))
+      return ex;
+    if (step.decoder == kArgDecodeGeneric)
+      step.layout = CompileTypeLayout(type, step.size);
+
+    const char *location = v.GetLocation();
+    if (!location || !*location)
+      return ex;
+
+    std::string check;
+    if (std::strncmp(location, "0x", 2) == 0) {
+      lldb::addr_t addr = std::strtoull(location, nullptr, 16);
+      // Only the function's own frame sits at a fixed offset from SP. Above
+      // the CFA lie the caller's frames, where arguments passed by reference
+      // (Rust passes anything over 16 bytes that way) land wherever the caller
+      // put them, so those functions stay on the SBValue path.
+      if (cfa == LLDB_INVALID_ADDRESS || addr < sp || addr >= cfa ||
+          step.size > cfa - addr || !snap.At(addr, step.size))
+        return ex;
+      step.sp_offset = static_cast<int64_t>(addr - sp);
+      int64_t end = step.sp_offset + static_cast<int64_t>(step.size);
+      ex.span_begin = ex.needs_snapshot ? std::min(ex.span_begin, step.sp_offset)
+                                        : step.sp_offset;
+      ex.span_end = ex.needs_snapshot ? std::max(ex.span_end, end) : end;
+      ex.needs_snapshot = true;
+      if (!RunArgDecoder(step, snap.At(addr, step.size), check))
+        return ex;
+    } else {
+      // Register locations name the register, e.g. "rdi" or "x1"
+      if (step.size > 8 || !frame.FindRegister(location).IsValid())
+        return ex;
+      step.reg = location;
+      uint64_t raw = ReadRegisterValue(frame, location);
+      if (!RunArgDecoder(step, reinterpret_cast<const uint8_t *>(&raw), check))
+        return ex;
+    }
+    ex.steps.push_back(std::move(step));
+  }
+  ex.compiled = true;
+  return ex;
+}
+
+// Reads the stack bytes and register values a compiled extractor decodes.
+// `regs` is indexed like ex.steps.
+static void CaptureExtractorInputs(const ArgExtractor &ex,
+                                   lldb::SBProcess &process, lldb::SBFrame &frame,
+                                   StackSnapshot &snap, std::vector<uint64_t> &regs) {
+  regs.assign(ex.steps.size(), 0);
+  for (size_t i = 0; i < ex.steps.size(); ++i)
+    if (!ex.steps[i].reg.empty() && ex.steps[i].mode > kCaptureTypeOnly)
+      regs[i] = ReadRegisterValue(frame, ex.steps[i].reg.c_str());
+
+  if (!ex.needs_snapshot)
+    return;
+  lldb::addr_t base = frame.GetSP() + ex.span_begin;
+  snap.bytes.resize(ex.span_end - ex.span_begin);
+  lldb::SBError err;
+  size_t read = process.ReadMemory(base, snap.bytes.data(), snap.bytes.size(), err);
+  snap.bytes.resize(read);
+  snap.base = read ? base : LLDB_INVALID_ADDRESS;
+}
+
+static bool RunArgExtractor(const ArgExtractor &ex, lldb::addr_t sp,
+                            const std::vector<uint64_t> &regs,
+                            const StackSnapshot &snap, size_t bytes_left,
+                            std::vector<ArgInfo> &args) {
+  for (size_t i = 0; i < ex.steps.size(); ++i) {
+    const ArgExtractorStep &step = ex.steps[i];
+    if (step.mode == kCaptureNone)
+      continue;
+    std::string value;
+    if (step.mode == kCaptureTypeOnly) {
+      value = kNotCaptured;
+    } else if (step.reg.empty()) {
+      const uint8_t *p = snap.At(sp + step.sp_offset, step.size);
+      if (!p || !RunArgDecoder(step, p, value))
+        return false;
+    } else {
+      if (!RunArgDecoder(step, reinterpret_cast<const uint8_t *>(&regs[i]), value))
+        return false;
+    }
+    AppendArg(args, step.name, step.type_name, value, bytes_left);
+  }
+  return true;
+}
+
+// Argument capture for one hit: the compiled extractor when there is one,
+// otherwise GetVariables() with snapshot decoding and SBValue fallback, both
+// under the capture policy resolved for this location.
+static void CaptureArguments(lldb::SBProcess &process, lldb::SBFrame &frame,
+                             lldb::addr_t location_pc, std::string_view fn,
+                             std::vector<ArgInfo> &args) {
+  StackSnapshot snapshot;
+  std::unique_lock<std::mutex> lk(g_capture_mutex);
+  const CapturePolicy *fn_policy = ResolveFunctionPolicy(location_pc, fn);
+  if (fn_policy->mode == kCaptureNone)
+    return;
+
+  if (g_use_stack_snapshot) {
+    auto it = g_arg_extractors.find(location_pc);
+    if (it != g_arg_extractors.end() && it->second.compiled) {
+      const ArgExtractor &ex = it->second;
+      lk.unlock();
+      std::vector<uint64_t> regs;
+      CaptureExtractorInputs(ex, process, frame, snapshot, regs);
+      if (RunArgExtractor(ex, frame.GetSP(), regs, snapshot,
+                          fn_policy->max_bytes, args))
+        return;
+      args.clear();
+      snapshot = StackSnapshot();
+      lk.lock();
+    }
+  }
+  lk.unlock();
+
+  auto vars = frame.GetVariables(/*args=*/true, false, false, true);
+  if (g_use_stack_snapshot && vars.GetSize() > 0 && !snapshot.bytes.size())
+    CaptureStackSnapshot(process, frame, ArgumentWindowSize(frame, vars),
+                         snapshot);
+  size_t bytes_left = fn_policy->max_bytes;
+  for (uint32_t i = 0; i < vars.GetSize(); ++i) {
+    auto v = vars.GetValueAtIndex(i);
+    if (!v.IsValid())
+      continue;
+    const char *n = v.GetName();
+    const char *typeName = v.GetTypeName();
+    std::string_view name = n ? n : "<anon>";
+    std::string_view type = typeName ? typeName : "<unknown>";
+
+    const CapturePolicy *policy;
+    {
+      std::lock_guard<std::mutex> plk(g_capture_mutex);
+      policy = ResolveArgPolicy(fn_policy, type);
+    }
+    CaptureMode mode = ArgCaptureMode(policy, name);
+    if (mode == kCaptureNone)
+      continue;
+
+    std::string val;
+    if (mode == kCaptureTypeOnly)
+      val = kNotCaptured;
+    else if (!FormatValueFromSnapshot(snapshot, v, val, policy))
+      val = FormatValueRecursive(v, 0, policy);
+
+    AppendArg(args, name, type,
+              val.empty() ? std::string_view("<unavailable>") : val, bytes_left);
+  }
+
+  if (g_use_stack_snapshot) {
+    std::lock_guard<std::mutex> clk(g_capture_mutex);
+    if (!g_arg_extractors.count(location_pc))
+      g_arg_extractors.emplace(
+          location_pc, CompileArgExtractor(frame, vars, snapshot, fn_policy));
+  }
+}
+
+static bool IsUpper(char c) { return c >= 'A' && c <= 'Z'; }
+
+std::string_view StripRustHash(std::string_view name) {
+  auto last_sep = name.rfind("::");
+  if (last_sep != std::string_view::npos && last_sep + 2 < name.length()) {
+    // Check if what follows :: looks like a hash (h followed by hex)
+    if (name[last_sep + 2] == 'h' && last_sep + 3 < name.length()) {
+      bool is_hash = true;
+      for (size_t i = last_sep + 3; i < name.length() && is_hash; i++) {
+        char c = name[i];
+        is_hash = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+                  (c >= 'A' && c <= 'F');
+      }
+      if (is_hash)
+        name = name.substr(0, last_sep);
+    }
+  }
+  return name;
+}
+
+// Calls fn(pos) for every "::" that is not inside generic arguments, e.g. not
+// the one in foo<a::B>::bar's "<a::B>"
+template <typename Fn>
+static void ForEachPathSeparator(std::string_view name, Fn fn) {
+  int depth = 0;
+  for (size_t i = 0; i + 1 < name.size(); ++i) {
+    if (name[i] == '<') {
+      ++depth;
+    } else if (name[i] == '>') {
+      if (depth > 0)
+        --depth;
+    } else if (depth == 0 && name[i] == ':' && name[i + 1] == ':') {
+      fn(i);
+      ++i;
+    }
+  }
+}
+
+std::string_view LastPathComponent(std::string_view name) {
+  size_t last = std::string_view::npos;
+  ForEachPathSeparator(name, [&](size_t pos) { last = pos; });
+  return last == std::string_view::npos ? name : name.substr(last + 2);
+}
+
+// Returns a view into `fn`, so classifying a frame allocates nothing.
+static std::string_view BaseNameView(std::string_view name) {
+  // Goal: Extract a meaningful identifier from Rust function names
+  // Examples:
+  //   crate::Module::Struct::method::h123abc -> Struct::method
+  //   crate::function::h123abc -> function
+  //   Struct::method::h123abc -> Struct::method
+  //   function::h123abc -> function
+  //   some::module::function -> function (if no hash)
+
+  // First, remove the hash suffix if it exists
+  name = StripRustHash(name);
+
+  // Now extract the meaningful part. Only the first, second-to-last and last
+  // :: separators outside generic arguments matter.
+  size_t count = 0;
+  size_t first = std::string_view::npos;
+  size_t prev = std::string_view::npos;
+  size_t last = std::string_view::npos;
+  ForEachPathSeparator(name, [&](size_t pos) {
+    if (count++ == 0)
+      first = pos;
+    prev = last;
+    last = pos;
+  });
+
+  if (count == 0) {
+    // No separators, return as is
+    return name;
+  }
+
+  // If we have exactly one separator, it might be Struct::method or
+  // module::function
+  if (count == 1) {
+    std::string_view first_part = name.substr(0, first);
+
+    // If the first part looks like a crate/module name (contains underscore or
+    // all lowercase), just return the second part (the function name).
+    // Otherwise it's Type::method, return both.
+    bool is_crate_or_module =
+        first_part.find('_') != std::string_view::npos ||
+        std::none_of(first_part.begin(), first_part.end(), IsUpper);
+    return is_crate_or_module ? name.substr(first + 2) : name;
+  }
+
+  // For multiple separators, we want the last two components (Type::method)
+  // unless the second-to-last looks like a module (lowercase)
+  std::string_view last_two = name.substr(prev + 2);
+  if (last > prev + 2 && IsUpper(last_two[0]))
+    return last_two;
+
+  // Otherwise just return the last component
+  return name.substr(last + 2);
+}
+
+std::string ExtractBaseName(std::string_view fn) {
+  return std::string(BaseNameView(fn));
+}
+
+// Helper: Read a source line from file and extract error message
+static std::string ReadSourceLine(const char *filepath, uint32_t line_num) {
+   if (!filepath || line_num == 0) return "";
+
+   FILE *src = std::fopen(filepath, "r");
+   if (!src) return "";
+
+   char line_buf[1024];
+   uint32_t current_line = 0;
+   std::string result;
+
+   while (std::fgets(line_buf, sizeof(line_buf), src)) {
+     current_line++;
+     if (current_line == line_num) {
+       result = line_buf;
+       // Trim whitespace
+       size_t start = result.find_first_not_of(" \t\n\r");
+       size_t end = result.find_last_not_of(" \t\n\r");
+       if (start != std::string::npos && end != std::string::npos) {
+         result = result.substr(start, end - start + 1);
+       }
+       break;
+     }
+   }
+   std::fclose(src);
+
+   return result;
+}
+
+// Helper: Extract panic message from panic_fmt or assert_failed frame arguments
+// The from_str function returns { ptr, ptr } where:
+//   - First ptr: points to the string data (the alloc_XXX static string)
+//   - Second ptr: metadata pointer (for slices this contains length info)
+// However, in practice for simple string panics, we often get:
+//   arg0 = pointer to string data
+//   arg1 = length or slice metadata
+//   arg2 = location pointer
+
+// TODO: Need to be main implementation, currently it does not works
+static std::string ExtractPanicMessage(lldb::SBThread &thread, lldb::SBProcess &process) {
+  lldb::SBFrame frame0 = thread.GetFrameAtIndex(0);
+  if (!frame0.IsValid()) return "";
+
+  const char *fn = frame0.GetFunctionName();
+  if (!fn) return "";
+  std::string func_name(fn);
+
+  // Get function arguments
+  lldb::SBValueList args = frame0.GetVariables(/*arguments=*/true, /*locals=*/false,
+                                               /*statics=*/false, /*in_scope_only=*/true);
+  
+  // Try interpreting first two args as (data_ptr, length) for &str
+  if (args.GetSize() >= 2) {
+    lldb::SBValue arg0 = args.GetValueAtIndex(0);
+    lldb::SBValue arg1 = args.GetValueAtIndex(1);
+    
+    if (arg0.IsValid() && arg1.IsValid()) {
+      uint64_t ptr = arg0.GetValueAsUnsigned(0);
+      uint64_t len = arg1.GetValueAsUnsigned(0);
+      
+      // Sanity check - len should be reasonable for a message (1-4096 chars)
+      if (ptr != 0 && len > 0 && len < 4096) {
+        std::vector<char> buf(len + 1, 0);
+        lldb::SBError err;
+        size_t read = process.ReadMemory(ptr, buf.data(), len, err);
+        
+        if (!err.Fail() && read == len) {
+          // Validate it looks like a string (printable ASCII/UTF-8)
+          bool valid = true;
+          for (size_t i = 0; i < len && valid; ++i) {
+            unsigned char c = buf[i];
+            // Allow printable ASCII, common control chars, and UTF-8 continuation bytes
+            valid = (c >= 0x20 && c < 0x7F) || c == '\n' || c == '\r' || c == '\t' || (c >= 0x80);
+          }
+          if (valid) {
+            std::string msg(buf.data(), len);
+            return msg;
+          }
+        }
+      }
+    }
+  }
+
+  // For fmt::Arguments structure - look for pieces field
+  for (uint32_t i = 0; i < args.GetSize(); ++i) {
+    lldb::SBValue arg = args.GetValueAtIndex(i);
+    if (!arg.IsValid()) continue;
+
+    const char *type_name = arg.GetTypeName();
+    if (!type_name) continue;
+    std::string type_str(type_name);
+    
+    if (type_str.find("fmt::Arguments") != std::string::npos) {
+      // Arguments has a 'pieces' field which contains the static string parts
+      lldb::SBValue pieces = arg.GetChildMemberWithName("pieces");
+      if (pieces.IsValid() && pieces.GetNumChildren() > 0) {
+        lldb::SBValue piece0 = pieces.GetChildAtIndex(0);
+        if (piece0.IsValid()) {
+          lldb::SBValue data_ptr = piece0.GetChildMemberWithName("data_ptr");
+          lldb::SBValue length = piece0.GetChildMemberWithName("length");
           
           if (!data_ptr.IsValid()) {
             data_ptr = piece0.GetChildAtIndex(0);
@@ -843,68 +1862,164 @@ static bool PanicBreakpointCallback(void *baton, lldb::SBProcess &process,
    return true; // Stop execution
 }
 
-// On each function-entry breakpoint, capture the current function and its args,
-// then walk the real LLDB call stack to find the first frame in our crate
-// (skipping over ABI/router layers). Extract that caller’s base name and link
-// this call to the most recent matching record in g_trace_data. No hard-coded
-// names or return-breakpoints needed—purely driven by LLDB’s backtrace.
-static bool BreakpointHitCallback(void *baton, lldb::SBProcess &process,
-                                  lldb::SBThread &thread,
-                                  lldb::SBBreakpointLocation &location) {
+// -----------------------------------------------------------------------------
+// Call linking. A hit is first decoded into a record plus its caller frame,
+// then linked: given a call id and a parent found through the caller's frame
+// pointer. Without workers both happen inside the breakpoint callback; with
+// "calltrace start --workers N" only compiled-extractor hits are decoded off
+// the callback, and linking is deferred to "calltrace stop", in hit order.
+
+// Frames that can be reported as a caller: Rust paths outside the standard
+// library, runtime and generated ABI router.
+static bool IsCallerCandidate(std::string_view s) {
+  if (s.find("::") == std::string_view::npos)
+    return false;
+  // Generated router functions are implementation details; the real caller
+  // is further down
+  if (g_frame_classifier.ClassifySymbol(s) & (kFrameRuntime | kFrameRouter))
+    return false;
+  return BaseNameView(s) != "route";
+}
+
+struct CallerInfo {
+  bool found = false;
+  std::string_view function;
+  uint64_t fp = 0;
+  lldb::addr_t pc = LLDB_INVALID_ADDRESS;
+  // pc - 1 resolved to its section, so the line is the call site and stays
+  // resolvable after the module unloads. Set when the hit is decoded, since
+  // in worker mode even inline hits are only linked at stop.
+  lldb::SBAddress address;
+  std::string_view contract; // Registered contract owning pc, if any
+};
+
+// A caller frame taken from the frame-pointer chain
+struct RawFrame {
+  lldb::addr_t pc; // Return address
+  uint64_t fp;
+};
+
+struct DecodedHit {
+  uint64_t seq = 0;
+  CallRecord rec;
+  uint64_t fp = 0;
+  CallerInfo caller;
+  // Hits decoded by a worker: function PC and raw callers, symbolized at stop
+  lldb::addr_t pc = LLDB_INVALID_ADDRESS;
+  std::vector<RawFrame> frames;
+};
+
+// Assigns the call id and parent and appends the record. A caller from the
+// same crate that was not traced itself gets a synthesized record so the
+// tree stays connected. Hits on a frame that is already active are dropped.
+static void LinkCallRecord(ThreadCallStack &calls, CallRecord &&rec,
+                           uint64_t fp, const CallerInfo &caller) {
+  if (rec.sp)
+    PopReturnedCalls(calls, rec.sp);
+  if (!calls.stack.empty() && calls.stack.back().fp == fp)
+    return; // Already processed this exact frame
+
+  size_t parent_id = 0;
+  size_t call_id = calls.next_call_id++;
+
+  if (caller.found) {
+    // Compute our crate prefix (contract name)
+    std::string_view crate_prefix;
+    if (auto pos = rec.function.find("::"); pos != std::string_view::npos)
+      crate_prefix = rec.function.substr(0, pos + 2);
+
+    auto it = std::find_if(
+        calls.stack.rbegin(), calls.stack.rend(),
+        [&](const ActiveCall &active) { return active.fp == caller.fp; });
+    if (it != calls.stack.rend()) {
+      parent_id = it->call_id;
+    } else if (!crate_prefix.empty() &&
+               caller.function.find(crate_prefix) != std::string_view::npos) {
+      // Caller not yet tracked but is from our crate - add it
+      CallRecord caller_rec;
+      caller_rec.function = caller.function;
+      caller_rec.line = 0;
+      caller_rec.parent_call_id = 0; // Will be root or find its parent later
+      caller_rec.call_id = calls.next_call_id++;
+      caller_rec.contract = caller.contract;
+
+      lldb::SBAddress caller_address = caller.address;
+      lldb::SBLineEntry cle = caller_address.GetLineEntry();
+      if (cle.IsValid()) {
+        caller_rec.line = cle.GetLine();
+        if (auto fs = cle.GetFileSpec(); fs.IsValid()) {
+          if (fs.GetFilename()) caller_rec.file = fs.GetFilename();
+          if (fs.GetDirectory()) caller_rec.directory = fs.GetDirectory();
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> lk(g_trace_mutex);
+        g_trace_data.push_back(caller_rec);
+      }
+
+      PushActiveCall(calls, caller.fp, caller_rec.call_id);
+      parent_id = caller_rec.call_id;
+
+      // Regenerate call_id for current function since we used one
+      call_id = calls.next_call_id++;
+    }
+  }
+
+  // Track this function as active using frame pointer
+  PushActiveCall(calls, fp, call_id);
+
+  rec.parent_call_id = parent_id;
+  rec.call_id = call_id;
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  g_trace_data.push_back(std::move(rec));
+}
+
+// Decodes a hit straight from the stopped thread: function, line, arguments
+// and the first caller frame that passes IsCallerCandidate.
+static bool DecodeHitInline(lldb::SBProcess &process, lldb::SBThread &thread,
+                            lldb::SBBreakpointLocation &location,
+                            TraceArena &arena, DecodedHit &hit) {
   // Grab current frame
   lldb::SBFrame frame = thread.GetFrameAtIndex(0);
   if (!frame.IsValid())
     return false;
 
   // Extract our full function name
-  const char *cfn = frame.GetFunctionName();
-  std::string fn = cfn ? cfn : "<unknown>";
+  CallRecord &rec = hit.rec;
+  if (const char *cfn = frame.GetFunctionName())
+    rec.function = cfn;
 
   // File & line
+  rec.line = 0;
   lldb::SBLineEntry le = frame.GetLineEntry();
-  std::string file = "<unknown>";
-  std::string directory;
-  uint32_t line = 0;
   if (le.IsValid()) {
-    line = le.GetLine();
+    rec.line = le.GetLine();
     if (auto fs = le.GetFileSpec(); fs.IsValid()) {
-      if (fs.GetFilename()) file = fs.GetFilename();
-      if (fs.GetDirectory()) directory = fs.GetDirectory();
+      if (fs.GetFilename()) rec.file = fs.GetFilename();
+      if (fs.GetDirectory()) rec.directory = fs.GetDirectory();
     }
   }
 
   // Gather arguments
-  std::vector<ArgInfo> args;
-  auto vars = frame.GetVariables(/*args=*/true, false, false, true);
-  for (uint32_t i = 0; i < vars.GetSize(); ++i) {
-    auto v = vars.GetValueAtIndex(i);
-    if (!v.IsValid())
-      continue;
-    const char *n = v.GetName();
-    const char *typeName = v.GetTypeName();
- 
-    std::string val = FormatValueRecursive(v);
-
-    ArgInfo arg;
-    arg.name = n ? n : "<anon>";
-    arg.type = typeName ? typeName : "<unknown>";
-    arg.value = val.empty() ? "<unavailable>" : val;
-    args.push_back(std::move(arg));
-  }
-
-  // Compute our crate prefix (contract name)
-  std::string crate_prefix;
-  if (auto pos = fn.find("::"); pos != std::string::npos)
-    crate_prefix = fn.substr(0, pos + 2);
+  static thread_local std::vector<ArgInfo> args;
+  args.clear();
+  CaptureArguments(process, frame, location.GetLoadAddress(), rec.function,
+                   args);
+  rec.args = StoreArgs(arena, args);
+
+  // Attribute the call to its registered contract by PC
+  lldb::SBTarget target = process.GetTarget();
+  if (const std::string *contract = LookupContractByPC(target, frame.GetPC()))
+    rec.contract = *contract;
+  hit.fp = frame.GetFP();
+  rec.sp = frame.GetSP();
 
-  // Scan down the real backtrace to find the actual caller
-  // This might be in the same crate OR a different crate (cross-contract call)
-  std::string caller_base;
-  std::string caller_full;
   size_t nframes = thread.GetNumFrames();
 
   // Debug: Print the full call stack
-  if (getenv("DEBUG_TRACE")) {
+  if (g_debug_trace) {
+    std::string fn(rec.function);
     fprintf(stderr, "[DEBUG] Processing: %s (base: %s)\n", fn.c_str(),
             ExtractBaseName(fn).c_str());
     fprintf(stderr, "[DEBUG] Full call stack (%zu frames):\n", nframes);
@@ -920,142 +2035,638 @@ static bool BreakpointHitCallback(void *baton, lldb::SBProcess &process,
     }
   }
 
+  // Scan down the real backtrace to find the actual caller. This might be in
+  // the same crate OR a different crate (cross-contract call). Recursive calls
+  // are not skipped: there the caller IS the same function.
   for (uint32_t i = 1; i < nframes; ++i) {
     auto f = thread.GetFrameAtIndex(i);
+    if (!f.IsValid())
+      continue;
     const char *cf = f.GetFunctionName();
-    if (!cf)
+    if (!cf || !IsCallerCandidate(cf))
       continue;
-    std::string s = cf;
 
-    // Note: Don't skip same function - for recursive calls, the caller IS
-    // the same function, and we want to track that relationship
+    hit.caller.found = true;
+    hit.caller.function = cf;
+    hit.caller.fp = f.GetFP();
+    hit.caller.pc = f.GetPC();
+    hit.caller.address = lldb::SBAddress(hit.caller.pc - 1, target);
+    if (const std::string *caller_contract =
+            LookupContractByPC(target, hit.caller.pc))
+      hit.caller.contract = *caller_contract;
+    if (g_debug_trace) {
+      fprintf(stderr, "[DEBUG] Found caller: %s (base: %s)\n", cf,
+              ExtractBaseName(cf).c_str());
+    }
+    break;
+  }
+  return true;
+}
 
-    // Check if this is a valid Rust function from our contracts
-    // (has :: separator and looks like a Rust function)
-    if (s.find("::") == std::string::npos)
-      continue;
+// -----------------------------------------------------------------------------
+// Background decoding ("calltrace start --workers N").
+//
+// SBValues and register reads are only valid while the inferior is stopped,
+// so only hits whose location already has a compiled argument extractor (or
+// captures nothing) are deferred: the callback copies the extractor's stack
+// span and registers and the raw frame-pointer chain, and pushes them to a
+// worker, which decodes the arguments while the inferior runs. Workers make
+// no SB calls. Names, lines, callers and contracts are resolved at stop. All
+// other hits are decoded inline, as without workers.
+
+static constexpr uint32_t kMaxRawFrames = 64;
+static constexpr uint32_t kMaxTraceWorkers = 64;
+// Bytes of stack read per frame-chain read; the walk reads again only where
+// a caller's frame lies beyond it
+static constexpr size_t kFrameChainWindow = 4096;
+
+struct RawHit {
+  uint64_t seq = 0;
+  lldb::addr_t pc = LLDB_INVALID_ADDRESS;
+  uint64_t fp = 0;
+  lldb::addr_t sp = 0;
+  const CapturePolicy *fn_policy = nullptr;
+  const ArgExtractor *extractor = nullptr; // nullptr when nothing is captured
+  std::vector<uint64_t> regs;
+  StackSnapshot snapshot;
+  std::vector<RawFrame> frames;
+};
 
-    // Skip system/runtime functions that aren't user code
-    if (s.find("std::") == 0 || s.find("core::") == 0 ||
-        s.find("alloc::") == 0 || s.find("__rust") != std::string::npos)
-      continue;
+// Section-relative address and contract of each address a deferred hit
+// refers to (its PC, and pc - 1 of each caller so lookups land in the calling
+// function). Taken the first time the callback sees the address, so that
+// hits can be symbolized at stop after the process and its load addresses
+// are gone. Callback thread only until StopTraceWorkers.
+struct HitAddress {
+  lldb::SBAddress address;
+  std::string_view contract;
+};
+static std::unordered_map<lldb::addr_t, HitAddress> g_hit_addresses;
 
-    // Skip generated router functions - they're implementation details
-    // Look for the actual user function that called the router
-    if (s.find("as$u20$stylus_sdk..abi..Router") != std::string::npos ||
-        ExtractBaseName(s) == "route") {
-      if (getenv("DEBUG_TRACE")) {
-        fprintf(stderr, "[DEBUG] Skipping router function: %s\n", s.c_str());
-      }
-      continue; // Skip to find the real caller
+static void RememberHitAddress(lldb::SBTarget &target, lldb::addr_t addr) {
+  auto [it, inserted] = g_hit_addresses.try_emplace(addr);
+  if (!inserted)
+    return;
+  it->second.address = lldb::SBAddress(addr, target);
+  if (const std::string *contract = LookupContractByPC(target, addr))
+    it->second.contract = *contract;
+}
+
+// Walks the frame-pointer chain above `fp`: each frame record holds the
+// caller's frame pointer and the return address. Frame pointers must grow
+// strictly, which also ends the walk at the outermost frame.
+static void CaptureFrameChain(lldb::SBProcess &process, uint64_t fp,
+                              std::vector<RawFrame> &frames) {
+  if (!fp || fp == LLDB_INVALID_ADDRESS || process.GetAddressByteSize() != 8)
+    return;
+  uint64_t window[kFrameChainWindow / sizeof(uint64_t)];
+  uint64_t base = fp;
+  size_t read = 0;
+  lldb::SBError error;
+  while (frames.size() < kMaxRawFrames) {
+    if (fp % sizeof(uint64_t))
+      break;
+    if (fp < base || fp - base + 2 * sizeof(uint64_t) > read) {
+      base = fp;
+      read = process.ReadMemory(base, window, sizeof(window), error);
+      if (read < 2 * sizeof(uint64_t))
+        break;
     }
+    const uint64_t *record = &window[(fp - base) / sizeof(uint64_t)];
+    uint64_t caller_fp = record[0];
+    lldb::addr_t ret = record[1];
+    if (!ret)
+      break;
+    frames.push_back({ret, caller_fp});
+    if (caller_fp <= fp)
+      break;
+    fp = caller_fp;
+  }
+}
+
+// Vyukov's intrusive MPSC queue: Push is wait-free for any number of
+// producers, Pop is for the single consumer only.
+template <typename T> class MPSCQueue {
+  struct Node {
+    std::atomic<Node *> next{nullptr};
+    T value;
+  };
+  std::atomic<Node *> m_head;
+  Node *m_tail;
+
+public:
+  MPSCQueue() : m_head(new Node), m_tail(m_head.load()) {}
+  MPSCQueue(const MPSCQueue &) = delete;
+  MPSCQueue &operator=(const MPSCQueue &) = delete;
+  ~MPSCQueue() {
+    T discard;
+    while (Pop(discard))
+      ;
+    delete m_tail;
+  }
 
-    // Found a potential caller - could be same crate or different
-    caller_full = s;
-    caller_base = ExtractBaseName(s);
+  void Push(T value) {
+    Node *node = new Node;
+    node->value = std::move(value);
+    Node *prev = m_head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+  }
 
-    if (getenv("DEBUG_TRACE")) {
-      fprintf(stderr, "[DEBUG] Found caller: %s (base: %s)\n",
-              caller_full.c_str(), caller_base.c_str());
+  bool Pop(T &out) {
+    Node *next = m_tail->next.load(std::memory_order_acquire);
+    if (!next)
+      return false;
+    out = std::move(next->value);
+    delete m_tail;
+    m_tail = next;
+    return true;
+  }
+};
+
+struct TraceWorker {
+  MPSCQueue<RawHit> queue;
+  TraceArena *arena;
+  // Set after a push, cleared by the worker before it drains the queue
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool pending = false;
+  std::vector<DecodedHit> decoded; // Owned by the worker thread until joined
+  std::thread thread;
+};
+
+static std::vector<std::unique_ptr<TraceWorker>> g_trace_workers;
+static std::atomic<bool> g_trace_workers_stop{false};
+static std::atomic<uint64_t> g_next_hit_seq{0};
+static size_t g_next_trace_worker = 0;
+// Hits decoded inline while workers are running, linked with the rest at stop
+static std::mutex g_inline_hits_mutex;
+static std::vector<DecodedHit> g_inline_hits;
+static ThreadCallStack g_worker_call_stack;
+
+// Name of the function (or, without debug info, the symbol) at an address
+static const char *FunctionNameAt(lldb::SBSymbolContext &sc) {
+  if (lldb::SBFunction function = sc.GetFunction(); function.IsValid())
+    if (const char *name = function.GetName())
+      return name;
+  if (lldb::SBSymbol symbol = sc.GetSymbol(); symbol.IsValid())
+    if (const char *name = symbol.GetName())
+      return name;
+  return "<unknown>";
+}
+
+// Worker side: decodes the arguments; the rest of the hit is kept raw
+static void DecodeRawHit(RawHit &raw, TraceArena &arena,
+                         std::vector<ArgInfo> &args, DecodedHit &hit) {
+  hit.seq = raw.seq;
+  hit.fp = raw.fp;
+  hit.pc = raw.pc;
+  hit.rec.sp = raw.sp;
+  // A decoder failure keeps the arguments decoded before it
+  if (raw.extractor) {
+    args.clear();
+    RunArgExtractor(*raw.extractor, raw.sp, raw.regs, raw.snapshot,
+                    raw.fn_policy->max_bytes, args);
+    hit.rec.args = StoreArgs(arena, args);
+  }
+  hit.frames = std::move(raw.frames);
+}
+
+// Stop side: resolves the function, line, contract and caller of a hit
+// decoded by a worker
+static void SymbolizeRawHit(
+    DecodedHit &hit, std::unordered_map<lldb::addr_t, CallRecord> &locations,
+    std::unordered_map<lldb::addr_t, const char *> &names) {
+  auto loc = locations.find(hit.pc);
+  if (loc == locations.end()) {
+    CallRecord resolved;
+    HitAddress &at = g_hit_addresses[hit.pc];
+    lldb::SBSymbolContext sc = at.address.GetSymbolContext(
+        lldb::eSymbolContextFunction | lldb::eSymbolContextSymbol |
+        lldb::eSymbolContextLineEntry);
+    resolved.function = FunctionNameAt(sc);
+    resolved.line = 0;
+    lldb::SBLineEntry le = sc.GetLineEntry();
+    if (le.IsValid()) {
+      resolved.line = le.GetLine();
+      if (auto fs = le.GetFileSpec(); fs.IsValid()) {
+        if (fs.GetFilename()) resolved.file = fs.GetFilename();
+        if (fs.GetDirectory()) resolved.directory = fs.GetDirectory();
+      }
+    }
+    resolved.contract = at.contract;
+    loc = locations.emplace(hit.pc, std::move(resolved)).first;
+  }
+  hit.rec.function = loc->second.function;
+  hit.rec.file = loc->second.file;
+  hit.rec.directory = loc->second.directory;
+  hit.rec.line = loc->second.line;
+  hit.rec.contract = loc->second.contract;
+
+  for (const RawFrame &f : hit.frames) {
+    HitAddress &at = g_hit_addresses[f.pc - 1];
+    auto name = names.find(f.pc);
+    if (name == names.end()) {
+      lldb::SBSymbolContext sc = at.address.GetSymbolContext(
+          lldb::eSymbolContextFunction | lldb::eSymbolContextSymbol);
+      name = names.emplace(f.pc, FunctionNameAt(sc)).first;
     }
+    if (!IsCallerCandidate(name->second))
+      continue;
+    hit.caller.found = true;
+    hit.caller.function = name->second;
+    hit.caller.fp = f.fp;
+    hit.caller.pc = f.pc;
+    hit.caller.address = at.address;
+    hit.caller.contract = at.contract;
     break;
   }
+}
 
-  // Determine parent ID
-  size_t parent_id = 0;
+static void RunTraceWorker(TraceWorker *worker) {
+  std::vector<ArgInfo> args;
+  RawHit raw;
+  for (;;) {
+    while (worker->queue.Pop(raw)) {
+      DecodedHit hit;
+      DecodeRawHit(raw, *worker->arena, args, hit);
+      worker->decoded.push_back(std::move(hit));
+    }
+    std::unique_lock<std::mutex> lk(worker->mutex);
+    worker->wake.wait(lk, [&] {
+      return worker->pending ||
+             g_trace_workers_stop.load(std::memory_order_acquire);
+    });
+    // Callbacks have stopped once the flag is set, and every push before it
+    // left `pending` set, so an empty queue here stays empty
+    if (!worker->pending)
+      return;
+    worker->pending = false;
+  }
+}
+
+// Rewinds the arenas of the previous trace, making sure there is one for the
+// callback and one per worker. Records referencing them must be gone.
+static void ResetTraceArenas(unsigned workers) {
+  while (g_trace_arenas.size() < workers + 1)
+    g_trace_arenas.push_back(std::make_unique<TraceArena>());
+  for (auto &arena : g_trace_arenas) {
+    arena->Reset();
+    arena->SetUseHugePages(g_trace_huge_pages);
+  }
+}
 
-  // Get current frame pointer (unique for each call)
-  uint64_t current_fp = frame.GetFP();
-
-  // Check if this exact frame is already tracked
-  auto existing_it = g_thread_call_stack.active_frames.find(current_fp);
-  if (existing_it != g_thread_call_stack.active_frames.end()) {
-    return false; // Already processed this exact frame
-  }
-
-  // Generate call ID for this function
-  size_t call_id = g_thread_call_stack.next_call_id++;
-
-  // Find parent by looking up the caller's frame pointer
-  if (nframes > 1) {
-    // Find the caller frame (skip system frames)
-    for (uint32_t i = 1; i < nframes; ++i) {
-      auto caller_frame = thread.GetFrameAtIndex(i);
-      if (!caller_frame.IsValid()) continue;
-
-      const char *cf = caller_frame.GetFunctionName();
-      if (!cf) continue;
-
-      std::string s = cf;
-
-      // Skip system/runtime functions
-      if (s.find("::") == std::string::npos) continue;
-      if (s.find("std::") == 0 || s.find("core::") == 0 ||
-          s.find("alloc::") == 0 || s.find("__rust") != std::string::npos)
-        continue;
-
-      // Skip router functions
-      if (s.find("as$u20$stylus_sdk..abi..Router") != std::string::npos ||
-          ExtractBaseName(s) == "route")
-        continue;
-
-      // Found a valid caller - check if it's tracked
-      uint64_t caller_fp = caller_frame.GetFP();
-      auto it = g_thread_call_stack.active_frames.find(caller_fp);
-      if (it != g_thread_call_stack.active_frames.end()) {
-        parent_id = it->second;
-      } else if (!crate_prefix.empty() && s.find(crate_prefix) != std::string::npos) {
-        // Caller not yet tracked but is from our crate - add it
-        CallRecord caller_rec;
-        caller_rec.function = s;
-        caller_rec.file = "<unknown>";
-        caller_rec.line = 0;
-        caller_rec.parent_call_id = 0; // Will be root or find its parent later
-        caller_rec.call_id = g_thread_call_stack.next_call_id++;
-
-        // Try to get line info
-        lldb::SBLineEntry cle = caller_frame.GetLineEntry();
-        if (cle.IsValid()) {
-          caller_rec.line = cle.GetLine();
-          if (auto fs = cle.GetFileSpec(); fs.IsValid()) {
-            if (fs.GetFilename()) caller_rec.file = fs.GetFilename();
-            if (fs.GetDirectory()) caller_rec.directory = fs.GetDirectory();
+static void StartTraceWorkers(unsigned count) {
+  g_worker_call_stack = ThreadCallStack();
+  g_hit_addresses.clear();
+  g_next_hit_seq.store(0);
+  g_next_trace_worker = 0;
+  for (unsigned i = 0; i < count; ++i) {
+    auto worker = std::make_unique<TraceWorker>();
+    worker->arena = g_trace_arenas[i + 1].get();
+    worker->thread = std::thread(RunTraceWorker, worker.get());
+    g_trace_workers.push_back(std::move(worker));
+  }
+}
+
+// A host-side event (see "Host-side profiles") whose call is resolved while
+// the worker hits are linked
+struct DeferredHostEvent {
+  uint64_t seq;
+  lldb::addr_t cfa;
+  size_t *call_id;
+};
+static void CollectDeferredHostEvents(std::vector<DeferredHostEvent> &events);
+
+// The innermost linked call whose frame encloses `cfa`. The host call's SP is
+// below its CFA, so calls whose frame pointer lies below the CFA have returned.
+static size_t EnclosingCallId(ThreadCallStack &calls, lldb::addr_t cfa) {
+  PopReturnedCalls(calls, cfa);
+  return calls.stack.empty() ? 0 : calls.stack.back().call_id;
+}
+
+// Joins the workers and, when `link` is set, symbolizes their hits and links
+// every hit of the run in hit order. Must not race with trace callbacks: call
+// while the inferior is stopped or gone.
+static void StopTraceWorkers(bool link) {
+  if (g_trace_workers.empty())
+    return;
+  g_trace_workers_stop.store(true, std::memory_order_release);
+  for (auto &worker : g_trace_workers) {
+    { std::lock_guard<std::mutex> lk(worker->mutex); }
+    worker->wake.notify_one();
+  }
+
+  std::vector<DecodedHit> hits;
+  {
+    std::lock_guard<std::mutex> lk(g_inline_hits_mutex);
+    hits.swap(g_inline_hits);
+  }
+  for (auto &worker : g_trace_workers) {
+    worker->thread.join();
+    std::move(worker->decoded.begin(), worker->decoded.end(),
+              std::back_inserter(hits));
+  }
+  g_trace_workers.clear();
+  g_trace_workers_stop.store(false);
+  if (!link) {
+    g_hit_addresses.clear();
+    return;
+  }
+
+  std::unordered_map<lldb::addr_t, CallRecord> locations;
+  std::unordered_map<lldb::addr_t, const char *> names;
+  for (DecodedHit &hit : hits)
+    if (hit.pc != LLDB_INVALID_ADDRESS)
+      SymbolizeRawHit(hit, locations, names);
+  g_hit_addresses.clear();
+
+  std::sort(hits.begin(), hits.end(),
+            [](const DecodedHit &a, const DecodedHit &b) { return a.seq < b.seq; });
+  std::vector<DeferredHostEvent> deferred;
+  CollectDeferredHostEvents(deferred);
+  std::sort(deferred.begin(), deferred.end(),
+            [](const DeferredHostEvent &a, const DeferredHostEvent &b) {
+              return a.seq < b.seq;
+            });
+  size_t next = 0;
+  auto resolve_until = [&](uint64_t seq) {
+    for (; next < deferred.size() && deferred[next].seq < seq; ++next)
+      *deferred[next].call_id =
+          EnclosingCallId(g_worker_call_stack, deferred[next].cfa);
+  };
+  for (DecodedHit &hit : hits) {
+    resolve_until(hit.seq);
+    LinkCallRecord(g_worker_call_stack, std::move(hit.rec), hit.fp, hit.caller);
+  }
+  resolve_until(UINT64_MAX);
+}
+
+// -----------------------------------------------------------------------------
+// Fast tracing ("calltrace start --fast"): no breakpoints. Instrumented code
+// calls hooks in a preloaded runtime that write (function, frame pointer,
+// timestamp) events into a shared-memory ring; FastTraceConsumer drains it.
+// At stop the events are linked into ordinary call records. With --probes the
+// hooks are trampolines patched into uninstrumented code (ProbeEngine.h),
+// which log the function's CFA in place of its frame pointer.
+
+static const uint32_t kDefaultFastTraceRing = 1u << 20;
+static FastTraceConsumer g_fast_trace;
+static std::string g_fast_trace_regex;
+static const char *const kPreloadVariable =
+#if defined(__APPLE__)
+    "DYLD_INSERT_LIBRARIES";
+#else
+    "LD_PRELOAD";
+#endif
+
+// The user's own value of the preload variable in target.env-vars, put back
+// when the fast trace ends
+static bool g_saved_preload_set = false;
+static std::string g_saved_preload;
+
+// The value of `name` in target.env-vars, read from "settings show", which
+// lists one "NAME=value" per line
+static bool ReadTargetEnvVar(lldb::SBCommandInterpreter &ci, const char *name,
+                             std::string &value) {
+  lldb::SBCommandReturnObject out;
+  ci.HandleCommand("settings show target.env-vars", out);
+  if (!out.Succeeded() || !out.GetOutput())
+    return false;
+  std::istringstream lines(out.GetOutput());
+  std::string prefix = std::string(name) + "=";
+  for (std::string line; std::getline(lines, line);) {
+    size_t start = line.find_first_not_of(" \t");
+    if (start != std::string::npos &&
+        line.compare(start, prefix.size(), prefix) == 0) {
+      value = line.substr(start + prefix.size());
+      return true;
+    }
+  }
+  return false;
+}
+
+// With a runtime, prepends it to the user's preload list and points the
+// runtime at the ring; without, restores the user's value.
+static void SetFastTraceEnvironment(lldb::SBDebugger &debugger,
+                                    const std::string &runtime) {
+  lldb::SBCommandInterpreter ci = debugger.GetCommandInterpreter();
+  lldb::SBCommandReturnObject ignored;
+  std::string preload = runtime;
+  if (!runtime.empty()) {
+    g_saved_preload_set =
+        ReadTargetEnvVar(ci, kPreloadVariable, g_saved_preload);
+    if (g_saved_preload_set && !g_saved_preload.empty())
+      preload += ":" + g_saved_preload;
+  } else if (g_saved_preload_set) {
+    preload = g_saved_preload;
+    g_saved_preload_set = false;
+  }
+
+  std::string cmd = "settings remove target.env-vars ";
+  ci.HandleCommand((cmd + kPreloadVariable).c_str(), ignored);
+  ci.HandleCommand((cmd + STYLUSDB_FASTTRACE_SHM_ENV).c_str(), ignored);
+  cmd = "settings append target.env-vars ";
+  if (!preload.empty())
+    ci.HandleCommand(
+        (cmd + "'" + kPreloadVariable + "=" + preload + "'").c_str(), ignored);
+  if (!runtime.empty())
+    ci.HandleCommand((cmd + STYLUSDB_FASTTRACE_SHM_ENV + "=" +
+                      g_fast_trace.name()).c_str(),
+                     ignored);
+}
+
+// Rebuilds each thread's call stack from frame pointers: an entry pops every
+// frame at or below its own (those calls have returned), an exit pops its own
+// frame. Functions outside the start regex stay on the stack so that their
+// callees attach to the nearest traced ancestor.
+static void LinkFastTraceEvents(lldb::SBTarget &target) {
+  std::vector<FastTraceEvent> events = g_fast_trace.TakeEvents();
+  std::regex filter;
+  bool filtered = g_fast_trace_regex != ".*";
+  try {
+    filter.assign(g_fast_trace_regex);
+  } catch (const std::regex_error &) {
+    filtered = false;
+  }
+
+  struct Site {
+    bool traced = true;
+    CallRecord rec;
+  };
+  struct Frame {
+    uint64_t fp;
+    size_t call_id;
+  };
+  std::unordered_map<uint64_t, Site> sites;
+  std::unordered_map<uint32_t, std::vector<Frame>> stacks;
+  size_t next_call_id = 1;
+  TraceArena &arena = *g_trace_arenas[0];
+
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  for (const FastTraceEvent &ev : events) {
+    std::vector<Frame> &stack = stacks[ev.tid];
+    if (ev.kind == kFastTraceExit) {
+      while (!stack.empty() && stack.back().fp < ev.fp)
+        stack.pop_back();
+      if (!stack.empty() && stack.back().fp == ev.fp)
+        stack.pop_back();
+      continue;
+    }
+    while (!stack.empty() && stack.back().fp <= ev.fp)
+      stack.pop_back();
+
+    auto it = sites.find(ev.fn);
+    if (it == sites.end()) {
+      Site site;
+      const FastTraceSite *resolved = g_fast_trace.FindSite(ev.fn);
+      if (resolved && resolved->address.IsValid()) {
+        lldb::SBAddress address = resolved->address;
+        lldb::SBSymbolContext sc = address.GetSymbolContext(
+            lldb::eSymbolContextFunction | lldb::eSymbolContextSymbol |
+            lldb::eSymbolContextLineEntry);
+        site.rec.function = FunctionNameAt(sc);
+        lldb::SBLineEntry le = sc.GetLineEntry();
+        if (le.IsValid()) {
+          site.rec.line = le.GetLine();
+          if (auto fs = le.GetFileSpec(); fs.IsValid()) {
+            if (fs.GetFilename()) site.rec.file = fs.GetFilename();
+            if (fs.GetDirectory()) site.rec.directory = fs.GetDirectory();
           }
         }
+      } else {
+        char name[32];
+        std::snprintf(name, sizeof(name), "0x%llx",
+                      static_cast<unsigned long long>(ev.fn));
+        site.rec.function = arena.Copy(name);
+      }
+      if (resolved && resolved->contract)
+        site.rec.contract = *resolved->contract;
+      site.traced = !filtered || std::regex_search(std::string(site.rec.function),
+                                                   filter);
+      it = sites.emplace(ev.fn, std::move(site)).first;
+    }
+
+    size_t parent_id = stack.empty() ? 0 : stack.back().call_id;
+    if (!it->second.traced) {
+      stack.push_back({ev.fp, parent_id});
+      continue;
+    }
+    CallRecord rec = it->second.rec;
+    rec.call_id = next_call_id++;
+    rec.parent_call_id = parent_id;
+    g_trace_data.push_back(rec);
+    stack.push_back({ev.fp, rec.call_id});
+  }
+}
 
-        {
-          std::lock_guard<std::mutex> lk(g_trace_mutex);
-          g_trace_data.push_back(caller_rec);
-        }
+// Ends a fast trace: restores the launch environment, drains the ring and,
+// when `link` is set, links the events into the trace and reports the probes
+// to `result`. Returns how many events the runtime dropped because the ring
+// was full.
+static uint64_t StopFastTrace(lldb::SBDebugger &debugger,
+                              lldb::SBTarget &target, bool link,
+                              lldb::SBCommandReturnObject *result = nullptr) {
+  if (!g_fast_trace.active())
+    return 0;
+  ProbeStats probes = StopProbes(target);
+  if (link && result) {
+    if (probes.no_runtime)
+      result->Printf("warning: the fast-trace runtime's probe entry was not "
+                     "found; is the runtime preloaded? Probed functions fell "
+                     "back to breakpoints\n");
+    if (probes.patched || probes.deferred || probes.fallback)
+      result->Printf("calltrace: %zu functions probed, %zu left on breakpoints "
+                     "(prologue not relocatable), %zu never re-entered\n",
+                     probes.patched, probes.fallback, probes.deferred);
+  }
+  g_fast_trace.Stop();
+  SetFastTraceEnvironment(debugger, "");
+  if (link)
+    LinkFastTraceEvents(target);
+  else
+    g_fast_trace.TakeEvents();
+  return g_fast_trace.dropped();
+}
 
-        g_thread_call_stack.active_frames[caller_fp] = caller_rec.call_id;
-        parent_id = caller_rec.call_id;
+static void EnqueueHit(lldb::SBProcess &process, lldb::SBThread &thread,
+                       lldb::SBBreakpointLocation &location) {
+  uint64_t seq = g_next_hit_seq.fetch_add(1, std::memory_order_relaxed);
+  lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+  if (!frame.IsValid())
+    return;
 
-        // Regenerate call_id for current function since we used one
-        call_id = g_thread_call_stack.next_call_id++;
-      }
-      break; // Found our caller
+  lldb::addr_t location_pc = location.GetLoadAddress();
+  const CapturePolicy *fn_policy = nullptr;
+  const ArgExtractor *extractor = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(g_capture_mutex);
+    auto pit = g_location_policies.find(location_pc);
+    if (pit != g_location_policies.end()) {
+      fn_policy = pit->second;
+      auto eit = g_arg_extractors.find(location_pc);
+      if (eit != g_arg_extractors.end() && eit->second.compiled)
+        extractor = &eit->second;
     }
   }
 
-  // Track this function as active using frame pointer
-  g_thread_call_stack.active_frames[current_fp] = call_id;
+  if (!fn_policy || (fn_policy->mode != kCaptureNone && !extractor)) {
+    // First hit of the location, or no extractor: decode inline
+    DecodedHit hit;
+    hit.seq = seq;
+    if (!DecodeHitInline(process, thread, location, *g_trace_arenas[0], hit))
+      return;
+    std::lock_guard<std::mutex> lk(g_inline_hits_mutex);
+    g_inline_hits.push_back(std::move(hit));
+    return;
+  }
 
-  // Emit our record
-  CallRecord rec;
-  rec.function = std::move(fn);
-  rec.file = std::move(file);
-  rec.directory = std::move(directory);
-  rec.line = line;
-  rec.parent_call_id = parent_id;
-  rec.call_id = call_id;
-  rec.args = std::move(args);
+  lldb::SBTarget target = process.GetTarget();
+  RawHit raw;
+  raw.seq = seq;
+  raw.pc = frame.GetPC();
+  raw.fp = frame.GetFP();
+  raw.sp = frame.GetSP();
+  raw.fn_policy = fn_policy;
+  if (fn_policy->mode != kCaptureNone) {
+    raw.extractor = extractor;
+    CaptureExtractorInputs(*extractor, process, frame, raw.snapshot, raw.regs);
+  }
+
+  // Inlined frames share their caller's frame pointer and are not in the
+  // chain, as they cannot be linked on their own
+  CaptureFrameChain(process, raw.fp, raw.frames);
+  RememberHitAddress(target, raw.pc);
+  for (const RawFrame &f : raw.frames)
+    RememberHitAddress(target, f.pc - 1);
 
+  TraceWorker &worker =
+      *g_trace_workers[g_next_trace_worker++ % g_trace_workers.size()];
+  worker.queue.Push(std::move(raw));
   {
-    std::lock_guard<std::mutex> lk(g_trace_mutex);
-    g_trace_data.push_back(std::move(rec));
+    std::lock_guard<std::mutex> lk(worker.mutex);
+    worker.pending = true;
+  }
+  worker.wake.notify_one();
+}
+
+// On each function-entry breakpoint, capture the current function and its args,
+// then walk the real LLDB call stack to find the first frame in our crate
+// (skipping over ABI/router layers). Extract that caller’s base name and link
+// this call to the most recent matching record in g_trace_data. No hard-coded
+// names or return-breakpoints needed—purely driven by LLDB’s backtrace.
+static bool BreakpointHitCallback(void *baton, lldb::SBProcess &process,
+                                  lldb::SBThread &thread,
+                                  lldb::SBBreakpointLocation &location) {
+  if (!g_trace_workers.empty()) {
+    EnqueueHit(process, thread, location);
+    return false;
   }
 
+  DecodedHit hit;
+  if (!DecodeHitInline(process, thread, location, *g_trace_arenas[0], hit))
+    return false;
+  LinkCallRecord(g_thread_call_stack, std::move(hit.rec), hit.fp, hit.caller);
+
   // No return breakpoints needed
   return false;
 }
@@ -1063,7 +2674,7 @@ static bool BreakpointHitCallback(void *baton, lldb::SBProcess &process,
 //
 // Escape a string for safe inclusion in JSON.
 //
-static std::string JsonEscape(const std::string &s) {
+std::string JsonEscape(std::string_view s) {
   std::ostringstream oss;
   oss << std::hex; // make sure we print hex for \u00xx
 
@@ -1105,52 +2716,39 @@ static std::string JsonEscape(const std::string &s) {
   return oss.str();
 }
 
-// Helper: find first user frame
-lldb::SBFrame FindUserFrame(lldb::SBThread &thread) {
-    uint32_t n = thread.GetNumFrames();
+// Helper: a frame with line info whose function and source file are both
+// outside the runtime
+bool IsUserFrame(lldb::SBFrame &frame) {
+    if (!frame.IsValid()) return false;
 
-    for (uint32_t i = 0; i < n; i++) {
-        lldb::SBFrame frame = thread.GetFrameAtIndex(i);
-        if (!frame.IsValid()) continue;
+    // Check function name - skip runtime functions
+    const char *fn = frame.GetFunctionName();
+    if (fn && (g_frame_classifier.ClassifySymbol(fn) & kFrameRuntime))
+        return false;
 
-        // Check function name - skip core/std/alloc functions
-        const char *fn = frame.GetFunctionName();
-        if (fn) {
-            std::string func(fn);
-            if (func.find("core::") == 0 ||
-                func.find("std::") == 0 ||
-                func.find("alloc::") == 0 ||
-                func.find("__rust") != std::string::npos) {
-                continue;
-            }
-        }
+    lldb::SBLineEntry line = frame.GetLineEntry();
+    if (!line.IsValid()) return false;
 
-        lldb::SBLineEntry line = frame.GetLineEntry();
-        if (!line.IsValid()) continue;
+    lldb::SBFileSpec fs = line.GetFileSpec();
+    if (!fs.IsValid()) return false;
 
-        lldb::SBFileSpec fs = line.GetFileSpec();
-        if (!fs.IsValid()) continue;
+    const char *filename = fs.GetFilename();
+    const char *directory = fs.GetDirectory();
 
-        const char *filename = fs.GetFilename();
-        const char *directory = fs.GetDirectory();
-
-        // Skip rust standard library files
-        std::string full_path;
-        if (directory) full_path = directory;
-        if (filename) {
-            if (!full_path.empty()) full_path += "/";
-            full_path += filename;
-        }
+    // Skip rust standard library files
+    return !(g_frame_classifier.ClassifyPath(directory ? directory : "",
+                                             filename ? filename : "") &
+             kFrameRuntime);
+}
 
-        if (full_path.find("/rustc/") != std::string::npos ||
-            full_path.find("/library/core/") != std::string::npos ||
-            full_path.find("/library/std/") != std::string::npos ||
-            full_path.find("/library/alloc/") != std::string::npos) {
-            continue;
-        }
+// Helper: find first user frame
+lldb::SBFrame FindUserFrame(lldb::SBThread &thread) {
+    uint32_t n = thread.GetNumFrames();
 
-        // Found a user frame
-        return frame;
+    for (uint32_t i = 0; i < n; i++) {
+        lldb::SBFrame frame = thread.GetFrameAtIndex(i);
+        if (IsUserFrame(frame))
+            return frame;
     }
 
     return lldb::SBFrame();
@@ -1180,12 +2778,10 @@ bool IsAssertOrPanic(lldb::SBThread &thread, ExecutionStatus &status) {
         }
 
         if (!name) continue;
-        std::string fn(name);
+        uint32_t classes = g_frame_classifier.ClassifySymbol(name);
 
         // Rust assert/panic
-        if (fn.find("core::panicking::assert_failed") != std::string::npos ||
-            fn.find("core::panicking::panic_fmt") != std::string::npos ||
-            fn.find("rust_begin_unwind") != std::string::npos) {
+        if (classes & kFramePanic) {
 
             status.is_error = true;
 
@@ -1193,14 +2789,14 @@ bool IsAssertOrPanic(lldb::SBThread &thread, ExecutionStatus &status) {
             {
                 std::lock_guard<std::mutex> lk(g_trace_mutex);
                 if (!g_trace_data.empty()) {
-                    const CallRecord &last_call = g_trace_data.back();
+                    CallRecord last_call = g_trace_data.back();
                     status.error_file = last_call.file;
                     status.error_line = last_call.line;
                     status.error_function = last_call.function;
 
                     // Read source line as error message
                     if (!last_call.directory.empty() && !last_call.file.empty() && last_call.line > 0) {
-                        std::string full_path = last_call.directory + "/" + last_call.file;
+                        std::string full_path = std::string(last_call.directory) + "/" + std::string(last_call.file);
                         std::string source_line = ReadSourceLine(full_path.c_str(), last_call.line);
                         if (!source_line.empty()) {
                             status.error_message = source_line;
@@ -1221,10 +2817,7 @@ bool IsAssertOrPanic(lldb::SBThread &thread, ExecutionStatus &status) {
         }
 
         // C/C++ assert (macOS) or Rust abort
-        if (fn.find("__assert_rtn") != std::string::npos ||
-            fn.find("__assert_fail") != std::string::npos ||
-            fn.find("abort") != std::string::npos ||
-            fn.find("__builtin_trap") != std::string::npos) {
+        if (classes & kFrameAbort) {
 
             status.is_error = true;
 
@@ -1232,14 +2825,14 @@ bool IsAssertOrPanic(lldb::SBThread &thread, ExecutionStatus &status) {
             {
                 std::lock_guard<std::mutex> lk(g_trace_mutex);
                 if (!g_trace_data.empty()) {
-                    const CallRecord &last_call = g_trace_data.back();
+                    CallRecord last_call = g_trace_data.back();
                     status.error_file = last_call.file;
                     status.error_line = last_call.line;
                     status.error_function = last_call.function;
 
                     // Read source line as error message
                     if (!last_call.directory.empty() && !last_call.file.empty() && last_call.line > 0) {
-                        std::string full_path = last_call.directory + "/" + last_call.file;
+                        std::string full_path = std::string(last_call.directory) + "/" + std::string(last_call.file);
                         std::string source_line = ReadSourceLine(full_path.c_str(), last_call.line);
                         if (!source_line.empty()) {
                             status.error_message = source_line;
@@ -1275,44 +2868,977 @@ ExecutionStatus GetExecutionStatus(lldb::SBDebugger &debugger) {
     lldb::SBTarget target = debugger.GetSelectedTarget();
     if (!target.IsValid()) return status;
 
-    lldb::SBProcess process = target.GetProcess();
-    if (!process.IsValid()) return status;
+    lldb::SBProcess process = target.GetProcess();
+    if (!process.IsValid()) return status;
+
+    lldb::StateType state = process.GetState();
+
+    // Process exited or crashed
+    if (state == lldb::eStateCrashed || state == lldb::eStateExited) {
+        int exit_status = process.GetExitStatus();
+        if (exit_status != 0) {
+            status.is_error = true;
+            status.error_message = "Process exited with status " + std::to_string(exit_status);
+        }
+    }
+
+    // Process stopped (maybe panic/assert)
+    if (state == lldb::eStateStopped) {
+        lldb::SBThread thread = process.GetSelectedThread();
+        if (thread.IsValid()) {
+            lldb::StopReason stop_reason = thread.GetStopReason();
+
+            if (stop_reason == lldb::eStopReasonSignal) {
+                uint64_t signal_num = thread.GetStopReasonDataAtIndex(0);
+                if (signal_num == 6) { // SIGABRT
+                    IsAssertOrPanic(thread, status);
+                } else {
+                    status.is_error = true;
+                    status.error_message = "Stopped by signal " + std::to_string(signal_num);
+                }
+            } else if (stop_reason == lldb::eStopReasonException) {
+                status.is_error = true;
+                status.error_message = "Exception occurred";
+            } else if (stop_reason == lldb::eStopReasonBreakpoint) {
+                IsAssertOrPanic(thread, status);
+            }
+        }
+    }
+
+    return status;
+}
+
+// -----------------------------------------------------------------------------
+void JSONWriter::Printf(const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  if (fp) {
+    std::vfprintf(fp, fmt, ap);
+  } else if (result) {
+    va_list ap_len;
+    va_copy(ap_len, ap);
+    int n = std::vsnprintf(nullptr, 0, fmt, ap_len);
+    va_end(ap_len);
+    if (n > 0) {
+      std::string buf(n, '\0');
+      std::vsnprintf(buf.data(), n + 1, fmt, ap);
+      result->Printf("%s", buf.c_str());
+    }
+  }
+  va_end(ap);
+}
+
+// -----------------------------------------------------------------------------
+// Contract-level tracing ("calltrace start --contracts-only").
+//
+// Only the cross-contract host calls and each registered contract's entrypoint
+// are hooked, so the inferior runs close to native speed while we record who
+// called whom, with which selector and value.
+
+struct ContractCallRecord {
+  size_t call_id;
+  size_t parent_call_id; // 0 for the top-level contract
+  uint32_t depth;
+  const char *kind;      // "entry" or the host function used for the call
+  std::string caller;
+  std::string callee;
+  std::string selector;  // First 4 bytes of the calldata
+  std::string value;     // Wei sent along (call_contract only)
+  bool reverted = false;
+};
+
+static bool g_contracts_only = false;
+// Guarded by g_trace_mutex
+static std::vector<ContractCallRecord> g_contract_calls;
+static std::vector<size_t> g_contract_call_stack; // Indices into g_contract_calls
+static lldb::SBBreakpoint g_entrypoint_bp;
+// Return breakpoints of the top-level entrypoint, by return address, and the
+// CFA of the entry in progress
+static std::unordered_map<lldb::addr_t, lldb::SBBreakpoint> g_entrypoint_return_bps;
+static lldb::addr_t g_entrypoint_cfa = LLDB_INVALID_ADDRESS;
+static int g_contract_call_listener = -1;
+
+static std::string HexBytes(const uint8_t *bytes, size_t len) {
+  static const char kHex[] = "0123456789abcdef";
+  std::string out = "0x";
+  for (size_t i = 0; i < len; ++i) {
+    out += kHex[bytes[i] >> 4];
+    out += kHex[bytes[i] & 0xf];
+  }
+  return out;
+}
+
+static std::string ContractAtFrame(lldb::SBThread &thread, uint32_t idx) {
+  lldb::SBFrame frame = thread.GetFrameAtIndex(idx);
+  if (!frame.IsValid())
+    return "";
+  lldb::SBTarget target = thread.GetProcess().GetTarget();
+  const std::string *contract = LookupContractByPC(target, frame.GetPC());
+  return contract ? *contract : "";
+}
+
+// The top-level entrypoint returned: SP is back above its CFA. Whatever is
+// still on the stack belonged to that transaction, so the next entry starts a
+// new tree at depth 0.
+static bool ContractEntryReturnCallback(void *baton, lldb::SBProcess &process,
+                                        lldb::SBThread &thread,
+                                        lldb::SBBreakpointLocation &location) {
+  lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  if (!frame.IsValid() || g_entrypoint_cfa == LLDB_INVALID_ADDRESS ||
+      frame.GetSP() < g_entrypoint_cfa)
+    return false;
+  g_contract_call_stack.clear();
+  g_entrypoint_cfa = LLDB_INVALID_ADDRESS;
+  return false;
+}
+
+static bool ContractEntryCallback(void *baton, lldb::SBProcess &process,
+                                  lldb::SBThread &thread,
+                                  lldb::SBBreakpointLocation &location) {
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  // Nested entries were already recorded by the host call that caused them
+  if (!g_contract_call_stack.empty())
+    return false;
+
+  lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+  lldb::SBFrame caller = thread.GetFrameAtIndex(1);
+  if (frame.IsValid() && caller.IsValid()) {
+    g_entrypoint_cfa = frame.GetCFA();
+    lldb::addr_t return_pc = caller.GetPC();
+    if (!g_entrypoint_return_bps.count(return_pc)) {
+      lldb::SBTarget target = process.GetTarget();
+      lldb::SBBreakpoint bp = target.BreakpointCreateByAddress(return_pc);
+      if (bp.IsValid()) {
+        bp.SetCallback(ContractEntryReturnCallback, nullptr);
+        bp.SetAutoContinue(true);
+        g_entrypoint_return_bps.emplace(return_pc, bp);
+      }
+    }
+  }
+
+  ContractCallRecord rec;
+  rec.call_id = g_contract_calls.size() + 1;
+  rec.parent_call_id = 0;
+  rec.depth = 0;
+  rec.kind = "entry";
+  rec.callee = ContractAtFrame(thread, 0);
+  if (rec.callee.empty())
+    rec.callee = "<unknown>";
+  g_contract_call_stack.push_back(g_contract_calls.size());
+  g_contract_calls.push_back(std::move(rec));
+  return false;
+}
+
+static void ContractCallHostHandler(lldb::SBProcess &process,
+                                    lldb::SBThread &thread,
+                                    const HostCallEvent &event) {
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  if (event.is_return) {
+    if (!g_contract_call_stack.empty()) {
+      ContractCallRecord &top = g_contract_calls[g_contract_call_stack.back()];
+      if (std::strcmp(top.kind, "entry") != 0) {
+        // Host call status byte: 0 on success
+        top.reverted = (event.ret & 0xff) != 0;
+        g_contract_call_stack.pop_back();
+      }
+    }
+    return;
+  }
+
+  ContractCallRecord rec;
+  rec.call_id = g_contract_calls.size() + 1;
+  rec.parent_call_id = g_contract_call_stack.empty()
+                           ? 0
+                           : g_contract_calls[g_contract_call_stack.back()].call_id;
+  rec.depth = static_cast<uint32_t>(g_contract_call_stack.size());
+  rec.kind = g_host_functions[event.id].name;
+
+  // The host function's caller runs in the calling contract
+  rec.caller = ContractAtFrame(thread, 1);
+  if (rec.caller.empty() && !g_contract_call_stack.empty())
+    rec.caller = g_contract_calls[g_contract_call_stack.back()].callee;
+
+  // (contract, calldata, calldata_len, [value,] gas, return_data_len)
+  lldb::SBError err;
+  uint8_t callee[20];
+  if (process.ReadMemory(event.args[0], callee, sizeof(callee), err) ==
+          sizeof(callee) && !err.Fail())
+    rec.callee = HexBytes(callee, sizeof(callee));
+  else
+    rec.callee = "<unknown>";
+
+  uint8_t selector[4];
+  if (event.args[2] >= sizeof(selector) &&
+      process.ReadMemory(event.args[1], selector, sizeof(selector), err) ==
+          sizeof(selector) && !err.Fail())
+    rec.selector = HexBytes(selector, sizeof(selector));
+
+  uint8_t value[32];
+  if (event.id == kHostCallContract &&
+      process.ReadMemory(event.args[3], value, sizeof(value), err) ==
+          sizeof(value) && !err.Fail()) {
+    // Big-endian U256
+    llvm::APInt api(256, 0);
+    for (uint8_t b : value)
+      api = api.shl(8) | llvm::APInt(256, b);
+    llvm::SmallString<80> buffer;
+    api.toString(buffer, /*Radix=*/10, /*Signed=*/false);
+    rec.value = buffer.c_str();
+  }
+
+  g_contract_call_stack.push_back(g_contract_calls.size());
+  g_contract_calls.push_back(std::move(rec));
+}
+
+static bool StartContractTracing(lldb::SBTarget &target) {
+  // Each registered contract's entrypoint; any module if none are registered
+  lldb::SBFileSpecList modules;
+  for (const auto &[addr, info] : g_contract_registry) {
+    if (info.module.IsValid())
+      modules.Append(info.module.GetFileSpec());
+    else if (info.lazy)
+      // Resolves once the contract is first entered and its module loaded
+      modules.Append(lldb::SBFileSpec(info.library_path.c_str(), true));
+  }
+
+  g_entrypoint_bp = target.BreakpointCreateByName("user_entrypoint", modules,
+                                                  lldb::SBFileSpecList());
+  if (!g_entrypoint_bp.IsValid())
+    return false;
+  g_entrypoint_bp.SetCallback(ContractEntryCallback, nullptr);
+  g_entrypoint_bp.SetAutoContinue(true);
+
+  g_contract_call_listener = AddHostCallListener(
+      target, kHostCategoryCall, /*want_returns=*/true, ContractCallHostHandler);
+  if (g_contract_call_listener < 0) {
+    target.BreakpointDelete(g_entrypoint_bp.GetID());
+    g_entrypoint_bp = lldb::SBBreakpoint();
+    return false;
+  }
+  g_contracts_only = true;
+  return true;
+}
+
+static void StopContractTracing(lldb::SBTarget &target) {
+  if (!g_contracts_only)
+    return;
+  if (target.IsValid()) {
+    RemoveHostCallListener(target, g_contract_call_listener);
+    if (g_entrypoint_bp.IsValid())
+      target.BreakpointDelete(g_entrypoint_bp.GetID());
+    for (auto &[pc, bp] : g_entrypoint_return_bps)
+      target.BreakpointDelete(bp.GetID());
+  }
+  g_contract_call_listener = -1;
+  g_entrypoint_bp = lldb::SBBreakpoint();
+  g_entrypoint_return_bps.clear();
+  g_entrypoint_cfa = LLDB_INVALID_ADDRESS;
+  g_contracts_only = false;
+}
+
+// Caller must hold g_trace_mutex.
+static void EmitContractCallsJSON(JSONWriter &out) {
+  if (g_contract_calls.empty())
+    return;
+
+  out.Printf(",\n  \"contract_calls\": [\n");
+  for (size_t i = 0; i < g_contract_calls.size(); ++i) {
+    const auto &c = g_contract_calls[i];
+    out.Printf("    { \"call_id\": %zu, \"parent_call_id\": %zu, \"depth\": %u, "
+               "\"kind\": \"%s\", \"caller\": \"%s\", \"callee\": \"%s\", "
+               "\"selector\": \"%s\", \"value\": \"%s\", \"reverted\": %s }%s\n",
+               c.call_id, c.parent_call_id, c.depth, c.kind,
+               JsonEscape(c.caller).c_str(), JsonEscape(c.callee).c_str(),
+               c.selector.c_str(), c.value.c_str(),
+               c.reverted ? "true" : "false",
+               i + 1 < g_contract_calls.size() ? "," : "");
+  }
+  out.Printf("  ]");
+}
+
+// -----------------------------------------------------------------------------
+// Host-side profiles ("calltrace start --storage", "--host-io", "--alloc").
+//
+// Host calls made while the breakpoint tracer runs are attributed to the
+// innermost traced call whose frame encloses them: the top of the shadow
+// stack once the frames below the host call's CFA are popped. Inline tracing
+// links calls as they are hit, so that is known at the host call. With
+// workers, linking waits for "calltrace stop"; the event takes a hit sequence
+// number instead and is resolved there, between the hits around it.
+
+static const size_t kDeferredCallId = SIZE_MAX;
+
+static size_t AttributeHostEvent(lldb::addr_t cfa, uint64_t &seq) {
+  if (g_trace_workers.empty())
+    return EnclosingCallId(g_thread_call_stack, cfa);
+  seq = g_next_hit_seq.fetch_add(1, std::memory_order_relaxed);
+  return kDeferredCallId;
+}
+
+enum StorageOp : uint8_t { kStorageLoad, kStorageStore, kStorageFlush };
+
+struct StorageAccess {
+  size_t call_id;
+  uint64_t seq = 0;   // Hit order, while call_id is deferred
+  lldb::addr_t cfa;
+  StorageOp op;
+  bool repeated = false; // Load of a slot already loaded or written
+  const std::string *contract = nullptr;
+  uint8_t key[32];
+  uint8_t value[32];
+};
+
+struct StorageSlotStats {
+  const std::string *contract = nullptr;
+  const uint8_t *key = nullptr; // Into the slot string keying the stats
+  size_t loads = 0;
+  size_t stores = 0;
+  size_t repeated_loads = 0;
+};
+
+// Guarded by g_trace_mutex
+static std::vector<StorageAccess> g_storage_accesses;
+// (contract, slot) -> stats; a slot is known once loaded or written
+static std::unordered_map<std::string, StorageSlotStats> g_storage_slots;
+static std::unordered_set<std::string> g_storage_known;
+static int g_storage_load_listener = -1;
+static int g_storage_write_listener = -1;
+
+static void StorageHostHandler(lldb::SBProcess &process, lldb::SBThread &thread,
+                               const HostCallEvent &event) {
+  StorageAccess access;
+  switch (event.id) {
+  case kHostStorageLoadBytes32:
+    // (key, dest): dest is filled in on return
+    if (!event.is_return)
+      return;
+    access.op = kStorageLoad;
+    break;
+  case kHostStorageCacheBytes32:
+  case kHostStorageStoreBytes32:
+    access.op = kStorageStore; // (key, value)
+    break;
+  case kHostStorageFlushCache:
+    access.op = kStorageFlush; // (clear)
+    break;
+  default:
+    return;
+  }
+
+  lldb::SBError err;
+  if (access.op != kStorageFlush &&
+      (process.ReadMemory(event.args[0], access.key, 32, err) != 32 ||
+       process.ReadMemory(event.args[1], access.value, 32, err) != 32))
+    return;
+
+  // Entries stop in the host function, returns back in its caller
+  lldb::SBFrame caller = thread.GetFrameAtIndex(event.is_return ? 0 : 1);
+  lldb::SBTarget target = process.GetTarget();
+  if (caller.IsValid())
+    access.contract = LookupContractByPC(target, caller.GetPC());
+  access.cfa = event.cfa;
+  access.call_id = AttributeHostEvent(event.cfa, access.seq);
+
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  if (access.op == kStorageFlush) {
+    // flush_cache(clear = true) drops the host's cached values too
+    if (event.args[0] & 1)
+      g_storage_known.clear();
+  } else {
+    std::string slot = access.contract ? *access.contract : std::string();
+    slot.append(reinterpret_cast<const char *>(access.key), 32);
+    auto it = g_storage_slots.find(slot);
+    if (it == g_storage_slots.end()) {
+      it = g_storage_slots.emplace(slot, StorageSlotStats{access.contract})
+               .first;
+      it->second.key = reinterpret_cast<const uint8_t *>(it->first.data()) +
+                       it->first.size() - 32;
+    }
+    bool known = !g_storage_known.insert(slot).second;
+    if (access.op == kStorageLoad) {
+      ++it->second.loads;
+      access.repeated = known;
+      it->second.repeated_loads += known;
+    } else {
+      ++it->second.stores;
+    }
+  }
+  g_storage_accesses.push_back(access);
+}
+
+static bool StartStorageTracing(lldb::SBTarget &target) {
+  g_storage_load_listener =
+      AddHostCallListener(target, kHostCategoryStorageLoad,
+                          /*want_returns=*/true, StorageHostHandler);
+  g_storage_write_listener =
+      AddHostCallListener(target, kHostCategoryStorageWrite,
+                          /*want_returns=*/false, StorageHostHandler);
+  return g_storage_load_listener >= 0 && g_storage_write_listener >= 0;
+}
+
+static void StopStorageTracing(lldb::SBTarget &target) {
+  if (target.IsValid()) {
+    if (g_storage_load_listener >= 0)
+      RemoveHostCallListener(target, g_storage_load_listener);
+    if (g_storage_write_listener >= 0)
+      RemoveHostCallListener(target, g_storage_write_listener);
+  }
+  g_storage_load_listener = g_storage_write_listener = -1;
+}
+
+// One call of any hooked host function, for the per-call I/O counters
+struct HostIoEvent {
+  size_t call_id;
+  uint64_t seq = 0;
+  lldb::addr_t cfa;
+  HostFunctionId id;
+  uint64_t bytes;
+};
+
+struct HostIoCount {
+  size_t calls = 0;
+  uint64_t bytes = 0;
+};
+
+// Guarded by g_trace_mutex
+static std::vector<HostIoEvent> g_host_io_events;
+static int g_host_io_listener = -1;
+static int g_host_io_entry_listener = -1;
+// Per thread, the length the innermost contract entry was called with, which
+// is what its read_args copies
+static std::unordered_map<lldb::tid_t, uint64_t> g_entrypoint_args_len;
+
+static void HostIoEntryHandler(lldb::SBProcess &process, lldb::SBThread &thread,
+                               const HostCallEvent &event) {
+  g_entrypoint_args_len[event.tid] = event.args[0];
+}
+
+// Entries only: the byte count is known from the arguments, and the host
+// function was resolved from the breakpoint location's cached address
+static void HostIoHandler(lldb::SBProcess &process, lldb::SBThread &thread,
+                          const HostCallEvent &event) {
+  const HostFunctionInfo &info = g_host_functions[event.id];
+  HostIoEvent io;
+  io.id = event.id;
+  io.cfa = event.cfa;
+  io.bytes = info.fixed_bytes;
+  if (info.length_arg >= 0)
+    io.bytes += static_cast<uint32_t>(event.args[info.length_arg]);
+  if (event.id == kHostReadArgs)
+    if (auto it = g_entrypoint_args_len.find(event.tid);
+        it != g_entrypoint_args_len.end())
+      io.bytes += it->second;
+  io.call_id = AttributeHostEvent(event.cfa, io.seq);
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  g_host_io_events.push_back(io);
+}
+
+static bool StartHostIoTracing(lldb::SBTarget &target) {
+  g_entrypoint_args_len.clear();
+  g_host_io_listener = AddHostCallListener(
+      target, kHostCategoryAll, /*want_returns=*/false, HostIoHandler);
+  // Without it read_args counts 0 bytes; not a reason to fail
+  g_host_io_entry_listener = AddHostCallListener(
+      target, kHostCategoryEntry, /*want_returns=*/false, HostIoEntryHandler);
+  return g_host_io_listener >= 0;
+}
+
+static void StopHostIoTracing(lldb::SBTarget &target) {
+  if (target.IsValid() && g_host_io_listener >= 0)
+    RemoveHostCallListener(target, g_host_io_listener);
+  if (target.IsValid() && g_host_io_entry_listener >= 0)
+    RemoveHostCallListener(target, g_host_io_entry_listener);
+  g_host_io_listener = g_host_io_entry_listener = -1;
+}
+
+// Heap profile. Aggregated as the allocator calls happen, so it needs the
+// call id at the call: inline linking only.
+struct AllocStats {
+  size_t allocs = 0;
+  size_t frees = 0;
+  uint64_t bytes = 0;       // Allocated by this call
+  uint64_t freed = 0;       // Freed by this call, whoever allocated it
+  int64_t live = 0;         // Of this call's allocations, still live
+  int64_t peak_live = 0;
+  size_t leaked = 0;        // Filled in at stop
+  uint64_t leaked_bytes = 0;
+};
+
+struct LiveAllocation {
+  uint64_t size;
+  size_t call_id;
+};
+
+// Guarded by g_trace_mutex
+static std::unordered_map<size_t, AllocStats> g_alloc_by_call;
+static std::unordered_map<uint64_t, LiveAllocation> g_live_allocations;
+static uint64_t g_live_bytes = 0;
+static uint64_t g_peak_live_bytes = 0;
+static bool g_alloc_leaks_counted = false;
+static int g_alloc_listener = -1;
+static int g_free_listener = -1;
+
+static void RecordFree(uint64_t ptr, size_t call_id) {
+  auto it = g_live_allocations.find(ptr);
+  if (it == g_live_allocations.end())
+    return; // Allocated before tracing started
+  AllocStats &owner = g_alloc_by_call[it->second.call_id];
+  owner.live -= static_cast<int64_t>(it->second.size);
+  g_live_bytes -= it->second.size;
+  AllocStats &stats = g_alloc_by_call[call_id];
+  ++stats.frees;
+  stats.freed += it->second.size;
+  g_live_allocations.erase(it);
+}
+
+static void RecordAlloc(uint64_t ptr, uint64_t size, size_t call_id) {
+  AllocStats &stats = g_alloc_by_call[call_id];
+  ++stats.allocs;
+  stats.bytes += size;
+  stats.live += static_cast<int64_t>(size);
+  stats.peak_live = std::max(stats.peak_live, stats.live);
+  g_live_bytes += size;
+  g_peak_live_bytes = std::max(g_peak_live_bytes, g_live_bytes);
+  g_live_allocations[ptr] = {size, call_id};
+}
+
+static void AllocHostHandler(lldb::SBProcess &process, lldb::SBThread &thread,
+                             const HostCallEvent &event) {
+  // Allocations finish on return, frees are complete on entry
+  if (event.is_return == (event.id == kHostRustDealloc))
+    return;
+  // Every module links its own shims; with contracts registered, only theirs
+  // count, not the replay host's
+  if (!g_contract_registry.empty()) {
+    lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+    lldb::SBTarget target = process.GetTarget();
+    if (!frame.IsValid() || !LookupContractByPC(target, frame.GetPC()))
+      return;
+  }
+
+  uint64_t seq = 0;
+  size_t call_id = AttributeHostEvent(event.cfa, seq);
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  switch (event.id) {
+  case kHostRustAlloc:
+  case kHostRustAllocZeroed:
+    if (event.ret)
+      RecordAlloc(event.ret, event.args[0], call_id);
+    break;
+  case kHostRustRealloc:
+    // A failed realloc leaves the old block alone
+    if (event.ret) {
+      RecordFree(event.args[0], call_id);
+      RecordAlloc(event.ret, event.args[3], call_id);
+    }
+    break;
+  case kHostRustDealloc:
+    RecordFree(event.args[0], call_id);
+    break;
+  default:
+    break;
+  }
+}
+
+static bool StartAllocTracing(lldb::SBTarget &target) {
+  g_alloc_listener = AddHostCallListener(
+      target, kHostCategoryAlloc, /*want_returns=*/true, AllocHostHandler);
+  g_free_listener = AddHostCallListener(
+      target, kHostCategoryFree, /*want_returns=*/false, AllocHostHandler);
+  return g_alloc_listener >= 0 && g_free_listener >= 0;
+}
+
+static void StopAllocTracing(lldb::SBTarget &target) {
+  if (target.IsValid()) {
+    if (g_alloc_listener >= 0)
+      RemoveHostCallListener(target, g_alloc_listener);
+    if (g_free_listener >= 0)
+      RemoveHostCallListener(target, g_free_listener);
+  }
+  g_alloc_listener = g_free_listener = -1;
+}
+
+// Whatever is still live when tracing stops was never freed by the traced
+// run; charged to the call that allocated it
+static void CountAllocLeaks() {
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  if (g_alloc_leaks_counted)
+    return;
+  for (const auto &[ptr, live] : g_live_allocations) {
+    AllocStats &stats = g_alloc_by_call[live.call_id];
+    ++stats.leaked;
+    stats.leaked_bytes += live.size;
+  }
+  g_alloc_leaks_counted = true;
+}
+
+// call id -> (parent id, function), for walking call paths. Caller must hold
+// g_trace_mutex.
+using CallParents =
+    std::unordered_map<size_t, std::pair<size_t, std::string_view>>;
+
+static CallParents IndexCallParents() {
+  CallParents calls;
+  calls.reserve(g_trace_data.size());
+  for (size_t i = 0; i < g_trace_data.size(); ++i)
+    calls.emplace(g_trace_data.call_id(i),
+                  std::make_pair(g_trace_data.parent_id(i),
+                                 g_trace_data.function(i)));
+  return calls;
+}
+
+// Call ids from the root down to `call_id`
+static void CallChain(const CallParents &calls, size_t call_id,
+                      std::vector<size_t> &chain) {
+  chain.clear();
+  for (size_t id = call_id; id;) {
+    auto it = calls.find(id);
+    if (it == calls.end() || chain.size() > calls.size())
+      break;
+    chain.push_back(id);
+    id = it->second.first;
+  }
+  std::reverse(chain.begin(), chain.end());
+}
+
+// Functions along `chain`, ';'-joined as in folded stacks
+static std::string CallPathString(const CallParents &calls,
+                                  const std::vector<size_t> &chain) {
+  std::string path;
+  for (size_t id : chain) {
+    if (!path.empty())
+      path += ';';
+    path += calls.at(id).second;
+  }
+  return path;
+}
+
+// Caller must hold g_trace_mutex.
+static void EmitCallAllocJSON(JSONWriter &out, const AllocStats &a) {
+  out.Printf(",\n      \"alloc\": { \"allocs\": %zu, \"frees\": %zu, "
+             "\"bytes\": %llu, \"freed\": %llu, \"peak_live\": %lld, "
+             "\"leaked\": %zu, \"leaked_bytes\": %llu }",
+             a.allocs, a.frees, static_cast<unsigned long long>(a.bytes),
+             static_cast<unsigned long long>(a.freed),
+             static_cast<long long>(a.peak_live), a.leaked,
+             static_cast<unsigned long long>(a.leaked_bytes));
+}
+
+// Totals, and the calls rolled up by call path (root to call, ';'-joined)
+// with the heaviest allocators first. Caller must hold g_trace_mutex.
+static void EmitAllocSummaryJSON(JSONWriter &out) {
+  if (g_alloc_by_call.empty())
+    return;
+
+  CallParents calls = IndexCallParents();
+  AllocStats total;
+  std::unordered_map<std::string, AllocStats> paths;
+  std::vector<size_t> chain;
+  for (const auto &[call_id, a] : g_alloc_by_call) {
+    total.allocs += a.allocs;
+    total.frees += a.frees;
+    total.bytes += a.bytes;
+    total.leaked += a.leaked;
+    total.leaked_bytes += a.leaked_bytes;
+
+    CallChain(calls, call_id, chain);
+    std::string path = CallPathString(calls, chain);
+    if (path.empty())
+      path = "<outside traced calls>";
+    AllocStats &p = paths[path];
+    p.allocs += a.allocs;
+    p.frees += a.frees;
+    p.bytes += a.bytes;
+    p.peak_live = std::max(p.peak_live, a.peak_live);
+    p.leaked += a.leaked;
+    p.leaked_bytes += a.leaked_bytes;
+  }
+
+  const size_t kTopPaths = 20;
+  std::vector<const std::pair<const std::string, AllocStats> *> top;
+  top.reserve(paths.size());
+  for (const auto &entry : paths)
+    top.push_back(&entry);
+  size_t shown = std::min(top.size(), kTopPaths);
+  std::partial_sort(top.begin(), top.begin() + shown, top.end(),
+                    [](const auto *a, const auto *b) {
+                      return a->second.bytes > b->second.bytes;
+                    });
+
+  out.Printf(",\n  \"alloc_summary\": {\n");
+  out.Printf("    \"allocs\": %zu, \"frees\": %zu, \"bytes\": %llu, "
+             "\"peak_live_bytes\": %llu, \"leaked\": %zu, "
+             "\"leaked_bytes\": %llu,\n",
+             total.allocs, total.frees,
+             static_cast<unsigned long long>(total.bytes),
+             static_cast<unsigned long long>(g_peak_live_bytes), total.leaked,
+             static_cast<unsigned long long>(total.leaked_bytes));
+  out.Printf("    \"paths\": [\n");
+  for (size_t i = 0; i < shown; ++i) {
+    const AllocStats &a = top[i]->second;
+    out.Printf("      { \"path\": \"%s\", \"allocs\": %zu, \"bytes\": %llu, "
+               "\"peak_live\": %lld, \"leaked\": %zu, \"leaked_bytes\": %llu }%s\n",
+               JsonEscape(top[i]->first).c_str(), a.allocs,
+               static_cast<unsigned long long>(a.bytes),
+               static_cast<long long>(a.peak_live), a.leaked,
+               static_cast<unsigned long long>(a.leaked_bytes),
+               i + 1 < shown ? "," : "");
+  }
+  out.Printf("    ]\n  }");
+}
+
+static void ClearHostProfiles() {
+  g_storage_accesses.clear();
+  g_storage_slots.clear();
+  g_storage_known.clear();
+  g_host_io_events.clear();
+  g_alloc_by_call.clear();
+  g_live_allocations.clear();
+  g_live_bytes = g_peak_live_bytes = 0;
+  g_alloc_leaks_counted = false;
+}
+
+static void CollectDeferredHostEvents(std::vector<DeferredHostEvent> &events) {
+  for (StorageAccess &access : g_storage_accesses)
+    if (access.call_id == kDeferredCallId)
+      events.push_back({access.seq, access.cfa, &access.call_id});
+  for (HostIoEvent &io : g_host_io_events)
+    if (io.call_id == kDeferredCallId)
+      events.push_back({io.seq, io.cfa, &io.call_id});
+}
+
+// (call id, host function) -> counters, so each call's rows are adjacent.
+// Caller must hold g_trace_mutex.
+static std::map<std::pair<size_t, HostFunctionId>, HostIoCount>
+CountHostIoByCall() {
+  std::map<std::pair<size_t, HostFunctionId>, HostIoCount> counts;
+  for (const HostIoEvent &io : g_host_io_events) {
+    HostIoCount &c = counts[{io.call_id, io.id}];
+    ++c.calls;
+    c.bytes += io.bytes;
+  }
+  return counts;
+}
+
+// Per host function over the whole run, busiest first. Caller must hold
+// g_trace_mutex.
+static std::vector<std::pair<HostFunctionId, HostIoCount>> CountHostIo() {
+  HostIoCount totals[kHostFunctionCount];
+  for (const HostIoEvent &io : g_host_io_events) {
+    ++totals[io.id].calls;
+    totals[io.id].bytes += io.bytes;
+  }
+  std::vector<std::pair<HostFunctionId, HostIoCount>> rows;
+  for (uint8_t i = 0; i < kHostFunctionCount; ++i)
+    if (totals[i].calls)
+      rows.push_back({static_cast<HostFunctionId>(i), totals[i]});
+  std::stable_sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+    return a.second.calls > b.second.calls;
+  });
+  return rows;
+}
+
+// Host I/O rows of the call `it` starts at. Caller must hold g_trace_mutex.
+static void EmitCallHostIoJSON(
+    JSONWriter &out,
+    std::map<std::pair<size_t, HostFunctionId>, HostIoCount>::const_iterator it,
+    std::map<std::pair<size_t, HostFunctionId>, HostIoCount>::const_iterator end) {
+  size_t call_id = it->first.first;
+  out.Printf(",\n      \"host_io\": [\n");
+  while (it != end && it->first.first == call_id) {
+    out.Printf("        { \"function\": \"%s\", \"calls\": %zu, "
+               "\"bytes\": %llu }",
+               g_host_functions[it->first.second].name, it->second.calls,
+               static_cast<unsigned long long>(it->second.bytes));
+    ++it;
+    out.Printf("%s\n",
+               it != end && it->first.first == call_id ? "," : "");
+  }
+  out.Printf("      ]");
+}
+
+// Caller must hold g_trace_mutex.
+static void EmitHostIoSummaryJSON(JSONWriter &out) {
+  if (g_host_io_events.empty())
+    return;
+  auto rows = CountHostIo();
+  out.Printf(",\n  \"host_io_summary\": [\n");
+  for (size_t i = 0; i < rows.size(); ++i)
+    out.Printf("    { \"function\": \"%s\", \"calls\": %zu, \"bytes\": %llu }%s\n",
+               g_host_functions[rows[i].first].name, rows[i].second.calls,
+               static_cast<unsigned long long>(rows[i].second.bytes),
+               i + 1 < rows.size() ? "," : "");
+  out.Printf("  ]");
+}
+
+static void PrintHostIoTable(lldb::SBCommandReturnObject &result) {
+  std::lock_guard<std::mutex> lk(g_trace_mutex);
+  if (g_host_io_events.empty())
+    return;
+  size_t unattributed = 0;
+  for (const HostIoEvent &io : g_host_io_events)
+    unattributed += io.call_id == 0;
+  result.Printf("\nHost I/O (%zu host calls, %zu outside traced calls)\n",
+                g_host_io_events.size(), unattributed);
+  result.Printf("  %-26s %10s %14s\n", "function", "calls", "bytes");
+  for (const auto &[id, count] : CountHostIo())
+    result.Printf("  %-26s %10zu %14llu\n", g_host_functions[id].name,
+                  count.calls, static_cast<unsigned long long>(count.bytes));
+}
+
+static const char *const kStorageOpNames[] = {"load", "store", "flush"};
+
+// Storage accesses of one call, in order. Caller must hold g_trace_mutex.
+static void EmitCallStorageJSON(JSONWriter &out,
+                                const std::vector<size_t> &accesses) {
+  out.Printf(",\n      \"storage\": [\n");
+  for (size_t i = 0; i < accesses.size(); ++i) {
+    const StorageAccess &a = g_storage_accesses[accesses[i]];
+    out.Printf("        { \"op\": \"%s\"", kStorageOpNames[a.op]);
+    if (a.op != kStorageFlush)
+      out.Printf(", \"slot\": \"%s\", \"value\": \"%s\"",
+                 HexBytes(a.key, 32).c_str(), HexBytes(a.value, 32).c_str());
+    if (a.repeated)
+      out.Printf(", \"repeated\": true");
+    out.Printf(" }%s\n", i + 1 < accesses.size() ? "," : "");
+  }
+  out.Printf("      ]");
+}
+
+// Totals and the most accessed slots. Caller must hold g_trace_mutex.
+static void EmitStorageSummaryJSON(JSONWriter &out) {
+  if (g_storage_accesses.empty())
+    return;
 
-    lldb::StateType state = process.GetState();
+  size_t loads = 0, stores = 0, repeated = 0, flushes = 0;
+  for (const StorageAccess &a : g_storage_accesses) {
+    loads += a.op == kStorageLoad;
+    stores += a.op == kStorageStore;
+    flushes += a.op == kStorageFlush;
+    repeated += a.repeated;
+  }
 
-    // Process exited or crashed
-    if (state == lldb::eStateCrashed || state == lldb::eStateExited) {
-        int exit_status = process.GetExitStatus();
-        if (exit_status != 0) {
-            status.is_error = true;
-            status.error_message = "Process exited with status " + std::to_string(exit_status);
-        }
-    }
+  const size_t kHotSlots = 20;
+  std::vector<const StorageSlotStats *> hot;
+  hot.reserve(g_storage_slots.size());
+  for (const auto &[slot, stats] : g_storage_slots)
+    hot.push_back(&stats);
+  auto hotter = [](const StorageSlotStats *a, const StorageSlotStats *b) {
+    if (a->loads + a->stores != b->loads + b->stores)
+      return a->loads + a->stores > b->loads + b->stores;
+    return a->repeated_loads > b->repeated_loads;
+  };
+  size_t shown = std::min(hot.size(), kHotSlots);
+  std::partial_sort(hot.begin(), hot.begin() + shown, hot.end(), hotter);
+
+  out.Printf(",\n  \"storage_summary\": {\n");
+  out.Printf("    \"loads\": %zu, \"stores\": %zu, \"repeated_loads\": %zu, "
+             "\"flushes\": %zu, \"slots\": %zu,\n",
+             loads, stores, repeated, flushes, g_storage_slots.size());
+  out.Printf("    \"hot_slots\": [\n");
+  for (size_t i = 0; i < shown; ++i) {
+    const StorageSlotStats &s = *hot[i];
+    out.Printf("      { \"slot\": \"%s\", ", HexBytes(s.key, 32).c_str());
+    if (s.contract)
+      out.Printf("\"contract\": \"%s\", ", JsonEscape(*s.contract).c_str());
+    out.Printf("\"loads\": %zu, \"stores\": %zu, \"repeated_loads\": %zu }%s\n",
+               s.loads, s.stores, s.repeated_loads, i + 1 < shown ? "," : "");
+  }
+  out.Printf("    ]\n  }");
+}
 
-    // Process stopped (maybe panic/assert)
-    if (state == lldb::eStateStopped) {
-        lldb::SBThread thread = process.GetSelectedThread();
-        if (thread.IsValid()) {
-            lldb::StopReason stop_reason = thread.GetStopReason();
+// -----------------------------------------------------------------------------
+// Stack usage. Each record keeps the SP of its hit; the stack grows down, so
+// the distance to the nearest ancestor's SP is what that ancestor (and any
+// untraced frames between them) used to reach this call, plus this call's own
+// frame. The distance to the outermost ancestor's SP is the stack the path
+// needs below its root.
+
+struct StackUsage {
+  uint64_t frame_bytes = 0; // Below the nearest ancestor with a known SP
+  uint64_t depth = 0;       // Below the outermost ancestor with a known SP
+};
 
-            if (stop_reason == lldb::eStopReasonSignal) {
-                uint64_t signal_num = thread.GetStopReasonDataAtIndex(0);
-                if (signal_num == 6) { // SIGABRT
-                    IsAssertOrPanic(thread, status);
-                } else {
-                    status.is_error = true;
-                    status.error_message = "Stopped by signal " + std::to_string(signal_num);
-                }
-            } else if (stop_reason == lldb::eStopReasonException) {
-                status.is_error = true;
-                status.error_message = "Exception occurred";
-            } else if (stop_reason == lldb::eStopReasonBreakpoint) {
-                IsAssertOrPanic(thread, status);
-            }
-        }
+// One entry per record, in record order. Parents precede their children, so
+// one pass suffices. Caller must hold g_trace_mutex.
+static std::vector<StackUsage> ComputeStackUsage() {
+  struct Base {
+    uint64_t sp;   // Nearest known SP on the path, 0 if none yet
+    uint64_t root; // Outermost known SP on the path
+  };
+  std::vector<StackUsage> usage(g_trace_data.size());
+  std::unordered_map<size_t, Base> bases;
+  bases.reserve(g_trace_data.size());
+  for (size_t i = 0; i < g_trace_data.size(); ++i) {
+    size_t call_id = g_trace_data.call_id(i);
+    uint64_t sp = g_trace_data.sp(i);
+    Base parent{0, 0};
+    if (auto it = bases.find(g_trace_data.parent_id(i)); it != bases.end())
+      parent = it->second;
+    if (!sp) {
+      bases[call_id] = parent;
+      continue;
+    }
+    // An ancestor below us is a stale frame-pointer match, not a caller
+    if (parent.sp && parent.sp >= sp) {
+      usage[i].frame_bytes = parent.sp - sp;
+      usage[i].depth = parent.root - sp;
+      bases[call_id] = {sp, parent.root};
+    } else {
+      bases[call_id] = {sp, sp};
     }
+  }
+  return usage;
+}
 
-    return status;
+// The deepest call paths, one entry per distinct path, with the bytes each
+// call on it added. Caller must hold g_trace_mutex.
+static void EmitStackSummaryJSON(JSONWriter &out,
+                                 const std::vector<StackUsage> &usage) {
+  const size_t kTopChains = 10;
+  std::vector<size_t> order;
+  for (size_t i = 0; i < usage.size(); ++i)
+    if (usage[i].depth)
+      order.push_back(i);
+  if (order.empty())
+    return;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return usage[a].depth > usage[b].depth;
+  });
+
+  CallParents calls = IndexCallParents();
+  std::unordered_map<size_t, size_t> index_of;
+  index_of.reserve(g_trace_data.size());
+  for (size_t i = 0; i < g_trace_data.size(); ++i)
+    index_of.emplace(g_trace_data.call_id(i), i);
+
+  out.Printf(",\n  \"stack_summary\": {\n");
+  out.Printf("    \"max_depth\": %llu,\n",
+             static_cast<unsigned long long>(usage[order[0]].depth));
+  out.Printf("    \"chains\": [\n");
+  std::unordered_set<std::string> seen;
+  std::vector<size_t> chain;
+  size_t shown = 0;
+  for (size_t i : order) {
+    if (shown == kTopChains)
+      break;
+    CallChain(calls, g_trace_data.call_id(i), chain);
+    std::string path = CallPathString(calls, chain);
+    if (!seen.insert(path).second)
+      continue;
+    out.Printf("%s      { \"depth\": %llu, \"path\": \"%s\", \"frame_bytes\": [",
+               shown ? ",\n" : "",
+               static_cast<unsigned long long>(usage[i].depth),
+               JsonEscape(path).c_str());
+    for (size_t j = 0; j < chain.size(); ++j)
+      out.Printf("%s%llu", j ? ", " : "",
+                 static_cast<unsigned long long>(
+                     usage[index_of.at(chain[j])].frame_bytes));
+    out.Printf("] }");
+    ++shown;
+  }
+  out.Printf("\n    ]\n  }");
 }
 
 // -----------------------------------------------------------------------------
@@ -1331,17 +3857,17 @@ static bool IsErrorCall(const CallRecord &r, const ExecutionStatus &exec_status)
 
   // Match by function name (partial match since function names may have hash suffixes)
   if (!exec_status.error_function.empty()) {
-    if (r.function.find(exec_status.error_function) != std::string::npos ||
+    if (r.function.find(exec_status.error_function) != std::string_view::npos ||
         exec_status.error_function.find(r.function) != std::string::npos) {
       return true;
     }
     // Also try matching the base function name (without module path)
     size_t last_colon = r.function.rfind("::");
-    if (last_colon != std::string::npos) {
-      std::string base_name = r.function.substr(last_colon + 2);
+    if (last_colon != std::string_view::npos) {
+      std::string_view base_name = r.function.substr(last_colon + 2);
       // Remove hash suffix if present
       size_t hash_pos = base_name.rfind("::h");
-      if (hash_pos != std::string::npos) {
+      if (hash_pos != std::string_view::npos) {
         base_name = base_name.substr(0, hash_pos);
       }
       if (exec_status.error_function.find(base_name) != std::string::npos) {
@@ -1353,12 +3879,11 @@ static bool IsErrorCall(const CallRecord &r, const ExecutionStatus &exec_status)
   return false;
 }
 
-static void PrintJSON(lldb::SBCommandReturnObject &result, const ExecutionStatus &exec_status) {
-  std::lock_guard<std::mutex> lock(g_trace_mutex);
-
-  result.Printf("{\n");
-  result.Printf("  \"status\": \"%s\",\n", exec_status.is_error ? "error" : "success");
-  result.Printf("  \"calls\": [\n");
+// Caller must hold g_trace_mutex.
+static void EmitTraceJSON(JSONWriter &out, const ExecutionStatus &exec_status) {
+  out.Printf("{\n");
+  out.Printf("  \"status\": \"%s\",\n", exec_status.is_error ? "error" : "success");
+  out.Printf("  \"calls\": [\n");
 
   // Find which call is the error call (last matching call, since errors bubble up)
   size_t error_call_idx = SIZE_MAX;
@@ -1375,51 +3900,93 @@ static void PrintJSON(lldb::SBCommandReturnObject &result, const ExecutionStatus
     }
   }
 
+  // Host-side events by the call they belong to
+  std::unordered_map<size_t, std::vector<size_t>> storage_by_call;
+  for (size_t i = 0; i < g_storage_accesses.size(); ++i)
+    storage_by_call[g_storage_accesses[i].call_id].push_back(i);
+  auto host_io_by_call = CountHostIoByCall();
+  std::vector<StackUsage> stack_usage = ComputeStackUsage();
+
   for (size_t i = 0; i < g_trace_data.size(); ++i) {
-    const auto &r = g_trace_data[i];
+    CallRecord r = g_trace_data[i];
     std::string esc_func = JsonEscape(r.function);
     std::string esc_file = JsonEscape(r.file);
     bool is_error_call = (i == error_call_idx);
 
-    result.Printf("    {\n");
-    result.Printf("      \"call_id\": %zu,\n", r.call_id);
-    result.Printf("      \"parent_call_id\": %zu,\n", r.parent_call_id);
-    result.Printf("      \"function\": \"%s\",\n", esc_func.c_str());
-    result.Printf("      \"file\": \"%s\",\n", esc_file.c_str());
-    result.Printf("      \"line\": %u,\n", r.line);
-
-    result.Printf("      \"args\": [\n");
+    out.Printf("    {\n");
+    out.Printf("      \"call_id\": %zu,\n", r.call_id);
+    out.Printf("      \"parent_call_id\": %zu,\n", r.parent_call_id);
+    out.Printf("      \"function\": \"%s\",\n", esc_func.c_str());
+    out.Printf("      \"file\": \"%s\",\n", esc_file.c_str());
+    out.Printf("      \"line\": %u,\n", r.line);
+    if (r.sp)
+      out.Printf("      \"stack_bytes\": %llu,\n      \"stack_depth\": %llu,\n",
+                 static_cast<unsigned long long>(stack_usage[i].frame_bytes),
+                 static_cast<unsigned long long>(stack_usage[i].depth));
+    if (!r.contract.empty())
+      out.Printf("      \"contract\": \"%s\",\n", JsonEscape(r.contract).c_str());
+
+    out.Printf("      \"args\": [\n");
     for (size_t j = 0; j < r.args.size(); ++j) {
       const auto &arg = r.args[j];
       std::string esc_name  = JsonEscape(arg.name);
       std::string esc_type  = JsonEscape(arg.type);
-      std::string esc_value = JsonEscape(arg.value);
 
-      result.Printf("        { \"name\": \"%s\", \"type\": \"%s\", \"value\": \"%s\" }",
-                    esc_name.c_str(), esc_type.c_str(), esc_value.c_str());
+      out.Printf("        { \"name\": \"%s\", \"type\": \"%s\", \"value_id\": %u }",
+                 esc_name.c_str(), esc_type.c_str(), arg.value_id);
       if (j + 1 < r.args.size())
-        result.Printf(",");
-      result.Printf("\n");
+        out.Printf(",");
+      out.Printf("\n");
     }
-    result.Printf("      ]");
+    out.Printf("      ]");
+    if (auto it = storage_by_call.find(r.call_id); it != storage_by_call.end())
+      EmitCallStorageJSON(out, it->second);
+    if (auto it = host_io_by_call.lower_bound({r.call_id, HostFunctionId()});
+        it != host_io_by_call.end() && it->first.first == r.call_id)
+      EmitCallHostIoJSON(out, it, host_io_by_call.end());
+    if (auto it = g_alloc_by_call.find(r.call_id); it != g_alloc_by_call.end())
+      EmitCallAllocJSON(out, it->second);
 
     // Add error info if this is the error call
     if (is_error_call) {
-      result.Printf(",\n");
-      result.Printf("      \"error\": true,\n");
+      out.Printf(",\n");
+      out.Printf("      \"error\": true,\n");
       std::string esc_msg = JsonEscape(exec_status.error_message);
-      result.Printf("      \"error_message\": \"%s\"\n", esc_msg.c_str());
+      out.Printf("      \"error_message\": \"%s\"\n", esc_msg.c_str());
     } else {
-      result.Printf("\n");
+      out.Printf("\n");
     }
 
-    result.Printf("    }");
+    out.Printf("    }");
     if (i + 1 < g_trace_data.size())
-      result.Printf(",");
-    result.Printf("\n");
+      out.Printf(",");
+    out.Printf("\n");
   }
-  result.Printf("  ]\n");
-  result.Printf("}\n");
+  out.Printf("  ]");
+
+  // Argument values, each emitted once and referenced by value_id
+  std::vector<std::string_view> values = g_value_pool.Snapshot();
+  out.Printf(",\n  \"values\": [\n");
+  for (size_t i = 0; i < values.size(); ++i)
+    out.Printf("    \"%s\"%s\n", JsonEscape(values[i]).c_str(),
+               i + 1 < values.size() ? "," : "");
+  out.Printf("  ]");
+
+  // Optional sections, each prefixed by the separator it needs
+  EmitContractCallsJSON(out);
+  EmitStorageSummaryJSON(out);
+  EmitHostIoSummaryJSON(out);
+  EmitAllocSummaryJSON(out);
+  EmitStackSummaryJSON(out, stack_usage);
+
+  out.Printf("\n}\n");
+}
+
+static void PrintJSON(lldb::SBCommandReturnObject &result, const ExecutionStatus &exec_status) {
+  std::lock_guard<std::mutex> lock(g_trace_mutex);
+  JSONWriter out;
+  out.result = &result;
+  EmitTraceJSON(out, exec_status);
 }
 
 // -----------------------------------------------------------------------------
@@ -1434,88 +4001,105 @@ static void WriteJSONToFile(const char *path, const ExecutionStatus &exec_status
     return;
   }
 
-  std::fprintf(fp, "{\n");
-  std::fprintf(fp, "  \"status\": \"%s\",\n", exec_status.is_error ? "error" : "success");
-  std::fprintf(fp, "  \"calls\": [\n");
-
-  // Find which call is the error call (last matching call)
-  size_t error_call_idx = SIZE_MAX;
-  if (exec_status.is_error) {
-    for (size_t i = g_trace_data.size(); i > 0; --i) {
-      if (IsErrorCall(g_trace_data[i - 1], exec_status)) {
-        error_call_idx = i - 1;
-        break;
-      }
-    }
-    // If no match found, mark the last call as the error
-    if (error_call_idx == SIZE_MAX && !g_trace_data.empty()) {
-      error_call_idx = g_trace_data.size() - 1;
-    }
-  }
-
-  for (size_t i = 0; i < g_trace_data.size(); ++i) {
-    const auto &r = g_trace_data[i];
-    std::string esc_func = JsonEscape(r.function);
-    std::string esc_file = JsonEscape(r.file);
-    bool is_error_call = (i == error_call_idx);
-
-    std::fprintf(fp, "    {\n");
-    std::fprintf(fp, "      \"call_id\": %zu,\n", r.call_id);
-    std::fprintf(fp, "      \"parent_call_id\": %zu,\n", r.parent_call_id);
-    std::fprintf(fp, "      \"function\": \"%s\",\n", esc_func.c_str());
-    std::fprintf(fp, "      \"file\": \"%s\",\n", esc_file.c_str());
-    std::fprintf(fp, "      \"line\": %u,\n", r.line);
-
-    std::fprintf(fp, "      \"args\": [\n");
-    for (size_t j = 0; j < r.args.size(); ++j) {
-      const auto &arg = r.args[j];
-      std::string esc_name  = JsonEscape(arg.name);
-      std::string esc_type  = JsonEscape(arg.type);
-      std::string esc_value = JsonEscape(arg.value);
-
-      std::fprintf(fp, "        { \"name\": \"%s\", \"type\": \"%s\", \"value\": \"%s\" }",
-                   esc_name.c_str(), esc_type.c_str(), esc_value.c_str());
-      if (j + 1 < r.args.size())
-        std::fprintf(fp, ",");
-      std::fprintf(fp, "\n");
-    }
-    std::fprintf(fp, "      ]");
-
-    // Add error info if this is the error call
-    if (is_error_call) {
-      std::fprintf(fp, ",\n");
-      std::fprintf(fp, "      \"error\": true,\n");
-      std::string esc_msg = JsonEscape(exec_status.error_message);
-      std::fprintf(fp, "      \"error_message\": \"%s\"\n", esc_msg.c_str());
-    } else {
-      std::fprintf(fp, "\n");
-    }
-
-    std::fprintf(fp, "    }");
-    if (i + 1 < g_trace_data.size())
-      std::fprintf(fp, ",");
-    std::fprintf(fp, "\n");
-  }
-  std::fprintf(fp, "  ]\n");
-  std::fprintf(fp, "}\n");
+  JSONWriter out;
+  out.fp = fp;
+  EmitTraceJSON(out, exec_status);
   std::fclose(fp);
 }
 
+bool ParseInteger(const char *text, long &out) {
+  if (!text || !*text)
+    return false;
+  char *end = nullptr;
+  errno = 0;
+  out = std::strtol(text, &end, 10);
+  return errno == 0 && end != text && *end == '\0';
+}
+
 // -----------------------------------------------------------------------------
-// Subcommand "calltrace start [regex]"
+// Subcommand "calltrace start [--contracts-only] [--no-stack-snapshot]
+//                              [--workers N] [--huge-pages] [--storage]
+//                              [--host-io] [--alloc]
+//                              [--fast | --probes] [--fast-ring N] [regex]"
 bool CallTraceStartCommand::DoExecute(lldb::SBDebugger debugger, char **command,
                                       lldb::SBCommandReturnObject &result) {
+  // A previous run that was never stopped still owns its workers; its hits
+  // are discarded with the rest of the old trace
+  lldb::SBTarget previous_target = debugger.GetSelectedTarget();
+  StopTraceWorkers(/*link=*/false);
+  StopFastTrace(debugger, previous_target, /*link=*/false);
+
   // Clear previous trace data
   {
     std::lock_guard<std::mutex> lock(g_trace_mutex);
     g_trace_data.clear();
+    g_value_pool.Clear();
+    g_contract_calls.clear();
+    g_contract_call_stack.clear();
+    ClearHostProfiles();
     g_execution_status = ExecutionStatus(); // Reset to success state
   }
   g_panic_detected.store(false);
+  g_debug_trace = std::getenv("DEBUG_TRACE") != nullptr;
+  CompileCapturePolicies();
+  g_frame_classifier.Compile(g_frame_patterns);
 
   std::string regex = ".*"; // default
-  if (command && command[0])
-    regex = command[0];
+  bool contracts_only = false;
+  bool fast = false;
+  bool probes = false;
+  bool storage = false;
+  bool host_io = false;
+  bool alloc = false;
+  uint32_t fast_ring = kDefaultFastTraceRing;
+  unsigned workers = 0;
+  g_use_stack_snapshot = true;
+  g_trace_huge_pages = false;
+  for (int i = 0; command && command[i]; ++i) {
+    if (std::strcmp(command[i], "--contracts-only") == 0) {
+      contracts_only = true;
+    } else if (std::strcmp(command[i], "--no-stack-snapshot") == 0) {
+      g_use_stack_snapshot = false;
+    } else if (std::strcmp(command[i], "--huge-pages") == 0) {
+      g_trace_huge_pages = true;
+    } else if (std::strcmp(command[i], "--fast") == 0) {
+      fast = true;
+    } else if (std::strcmp(command[i], "--probes") == 0) {
+      fast = probes = true;
+    } else if (std::strcmp(command[i], "--storage") == 0) {
+      storage = true;
+    } else if (std::strcmp(command[i], "--host-io") == 0) {
+      host_io = true;
+    } else if (std::strcmp(command[i], "--alloc") == 0) {
+      alloc = true;
+    } else if (std::strcmp(command[i], "--fast-ring") == 0) {
+      long value = -1;
+      if (command[i + 1] && !ParseInteger(command[++i], value))
+        value = -1;
+      if (value < 1024 || value > (1l << 28) || (value & (value - 1))) {
+        result.Printf("--fast-ring expects a power of two between 1024 and "
+                      "2^28 events\n");
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+      fast_ring = static_cast<uint32_t>(value);
+    } else if (std::strcmp(command[i], "--workers") == 0) {
+      long value = -1;
+      if (command[i + 1] && !ParseInteger(command[++i], value))
+        value = -1;
+      if (value < 0 || value > kMaxTraceWorkers) {
+        result.Printf("--workers expects a count between 0 and %u\n",
+                      kMaxTraceWorkers);
+        result.SetStatus(lldb::eReturnStatusFailed);
+        return false;
+      }
+      workers = static_cast<unsigned>(value);
+    } else {
+      regex = command[i];
+    }
+  }
+  // The old records were cleared above, so their arguments can go
+  ResetTraceArenas(workers);
 
   lldb::SBCommandInterpreter ci = debugger.GetCommandInterpreter();
   lldb::SBDebugger real_dbg =
@@ -1529,6 +4113,82 @@ bool CallTraceStartCommand::DoExecute(lldb::SBDebugger debugger, char **command,
     return false;
   }
 
+  StopContractTracing(target);
+  StopStorageTracing(target);
+  StopHostIoTracing(target);
+  StopAllocTracing(target);
+  if ((storage || host_io || alloc) && (contracts_only || fast)) {
+    result.Printf("%s attributes host calls to breakpoint-traced calls; it "
+                  "cannot be combined with --contracts-only, --fast or "
+                  "--probes\n",
+                  storage ? "--storage" : host_io ? "--host-io" : "--alloc");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+  if (alloc && workers) {
+    // The profile is aggregated as it goes and needs each call id right away
+    result.Printf("--alloc cannot be combined with --workers\n");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+  if (contracts_only) {
+    if (!StartContractTracing(target)) {
+      result.Printf("Failed to hook cross-contract calls\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    result.Printf("calltrace: Tracing cross-contract calls only\n");
+    result.Printf("Entrypoint breakpoint ID: %d\n", g_entrypoint_bp.GetID());
+    result.Printf("Run/continue to collect calls.\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (fast) {
+    // The runtime has to be preloaded, so the process must not exist yet
+    lldb::SBProcess process = target.GetProcess();
+    if (process.IsValid() && (process.GetState() == lldb::eStateStopped ||
+                              process.GetState() == lldb::eStateRunning)) {
+      result.Printf("calltrace start %s must run before the process is "
+                    "launched\n",
+                    probes ? "--probes" : "--fast");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    std::string error;
+    if (!g_fast_trace.Start(target, fast_ring, error)) {
+      result.Printf("Failed to create the fast-trace ring: %s\n",
+                    error.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    if (probes && !StartProbes(target, regex, g_fast_trace, error)) {
+      g_fast_trace.Stop();
+      g_fast_trace.TakeEvents();
+      result.Printf("calltrace start --probes: %s\n", error.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    std::string runtime = DefaultFastTraceRuntime();
+    SetFastTraceEnvironment(debugger, runtime);
+    g_fast_trace_regex = regex;
+
+    result.Printf("calltrace: %s functions matching '%s'\n",
+                  probes ? "Probing" : "Fast tracing", regex.c_str());
+    result.Printf("Ring %s (%u events), runtime %s\n", g_fast_trace.name().c_str(),
+                  fast_ring, runtime.c_str());
+    if (probes)
+      result.Printf("Matching functions are patched at the first call into "
+                    "any of them, or when their module loads later; calls "
+                    "stop the process only until then.\n");
+    else
+      result.Printf("Only code built with entry hooks (-Z instrument-mcount, "
+                    "-finstrument-functions) is traced.\n");
+    result.Printf("Launch the process to collect calls.\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
   // Create breakpoint from regex
   lldb::SBBreakpoint bp = target.BreakpointCreateByRegex(regex.c_str());
   if (!bp.IsValid()) {
@@ -1537,11 +4197,32 @@ bool CallTraceStartCommand::DoExecute(lldb::SBDebugger debugger, char **command,
     return false;
   }
 
+  if ((storage && !StartStorageTracing(target)) ||
+      (host_io && !StartHostIoTracing(target)) ||
+      (alloc && !StartAllocTracing(target))) {
+    StopStorageTracing(target);
+    StopHostIoTracing(target);
+    StopAllocTracing(target);
+    target.BreakpointDelete(bp.GetID());
+    result.Printf("Failed to hook the host functions\n");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
   // Set the callback
   bp.SetCallback(BreakpointHitCallback, nullptr);
   bp.SetAutoContinue(true); // do not stop at break
+  StartTraceWorkers(workers);
 
   result.Printf("calltrace: Tracing functions matching '%s'\n", regex.c_str());
+  if (workers)
+    result.Printf("Decoding on %u worker threads\n", workers);
+  if (storage)
+    result.Printf("Recording storage loads and stores per call\n");
+  if (host_io)
+    result.Printf("Counting host function calls and bytes per call\n");
+  if (alloc)
+    result.Printf("Profiling heap allocations per call\n");
   result.Printf("Breakpoint ID: %d\n", bp.GetID());
   result.Printf("Run/continue to collect calls.\n");
 
@@ -1553,12 +4234,29 @@ bool CallTraceStartCommand::DoExecute(lldb::SBDebugger debugger, char **command,
 // Subcommand "calltrace stop" – prints JSON & writes file
 bool CallTraceStopCommand::DoExecute(lldb::SBDebugger debugger, char **command,
                                      lldb::SBCommandReturnObject &result) {
+  lldb::SBTarget target = debugger.GetSelectedTarget();
+  // Link the worker-decoded hits first: the panic detection below looks at
+  // the last recorded call
+  StopTraceWorkers(/*link=*/true);
+  if (uint64_t dropped =
+          StopFastTrace(debugger, target, /*link=*/true, &result))
+    result.Printf("warning: %llu fast-trace events dropped (ring full); "
+                  "raise --fast-ring\n",
+                  static_cast<unsigned long long>(dropped));
+
   // Get execution status (detect panics/crashes)
   ExecutionStatus exec_status = GetExecutionStatus(debugger);
 
+  StopContractTracing(target);
+  StopStorageTracing(target);
+  StopHostIoTracing(target);
+  StopAllocTracing(target);
+  CountAllocLeaks();
+
   result.Printf("\n--- LLDB Function Trace (JSON) ---\n");
   PrintJSON(result, exec_status);
   result.Printf("----------------------------------\n");
+  PrintHostIoTable(result);
 
   const char *out_path = "/tmp/lldb_function_trace.json";
   WriteJSONToFile(out_path, exec_status);
@@ -1568,6 +4266,296 @@ bool CallTraceStopCommand::DoExecute(lldb::SBDebugger debugger, char **command,
   return true;
 }
 
+// -----------------------------------------------------------------------------
+// Subcommand "calltrace classify" – frame classification patterns
+//
+//   calltrace classify add symbol|path prefix|substring <text> [class]
+//   calltrace classify remove <index>
+//   calltrace classify list
+//   calltrace classify reset
+//
+// [class] is runtime (default), router, panic or abort. Runtime and router
+// frames are never reported as callers or user frames; panic and abort frames
+// mark the execution as failed. Changes apply from the next "calltrace start".
+static const char *const kFrameClassNames[] = {"runtime", "router", "panic",
+                                               "abort"};
+
+static void PrintFramePattern(lldb::SBCommandReturnObject &result, size_t index,
+                              const FramePattern &p) {
+  std::string classes;
+  for (uint32_t i = 0; i < std::size(kFrameClassNames); ++i) {
+    if (!(p.classes & (1u << i)))
+      continue;
+    if (!classes.empty())
+      classes += ",";
+    classes += kFrameClassNames[i];
+  }
+  result.Printf("#%zu %s %s '%s': %s\n", index,
+                p.target == kMatchSymbol ? "symbol" : "path",
+                p.kind == kMatchPrefix ? "prefix" : "substring", p.text.c_str(),
+                classes.c_str());
+}
+
+bool CallTraceClassifyCommand::DoExecute(lldb::SBDebugger debugger,
+                                         char **command,
+                                         lldb::SBCommandReturnObject &result) {
+  std::string sub = command && command[0] ? command[0] : "list";
+
+  if (sub == "list") {
+    for (size_t i = 0; i < g_frame_patterns.size(); ++i)
+      PrintFramePattern(result, i, g_frame_patterns[i]);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "reset") {
+    g_frame_patterns = DefaultFramePatterns();
+    result.Printf("Frame patterns reset to the defaults\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "remove") {
+    long index = -1;
+    if (!command[1] || !ParseInteger(command[1], index) || index < 0 || static_cast<size_t>(index) >= g_frame_patterns.size()) {
+      result.Printf("Usage: calltrace classify remove <index>\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    g_frame_patterns.erase(g_frame_patterns.begin() + index);
+    result.Printf("Removed frame pattern #%ld\n", index);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "add") {
+    FramePattern p{"", kMatchSymbol, kMatchPrefix, kFrameRuntime};
+    bool ok = command[1] && command[2] && command[3] && *command[3];
+    if (ok) {
+      ok = (std::strcmp(command[1], "symbol") == 0 ||
+            std::strcmp(command[1], "path") == 0) &&
+           (std::strcmp(command[2], "prefix") == 0 ||
+            std::strcmp(command[2], "substring") == 0);
+      p.target = std::strcmp(command[1], "path") == 0 ? kMatchPath : kMatchSymbol;
+      p.kind = std::strcmp(command[2], "substring") == 0 ? kMatchSubstring
+                                                         : kMatchPrefix;
+      p.text = command[3];
+    }
+    if (ok && command[4]) {
+      ok = false;
+      for (uint32_t i = 0; i < std::size(kFrameClassNames); ++i) {
+        if (std::strcmp(command[4], kFrameClassNames[i]) == 0) {
+          p.classes = 1u << i;
+          ok = true;
+        }
+      }
+    }
+    if (!ok) {
+      result.Printf("Usage: calltrace classify add symbol|path prefix|substring "
+                    "<text> [runtime|router|panic|abort]\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    g_frame_patterns.push_back(p);
+    result.Printf("Added frame pattern ");
+    PrintFramePattern(result, g_frame_patterns.size() - 1, p);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  result.Printf("Unknown subcommand '%s' (expected add, remove, list or reset)\n",
+                sub.c_str());
+  result.SetStatus(lldb::eReturnStatusFailed);
+  return false;
+}
+
+// -----------------------------------------------------------------------------
+// Subcommand "calltrace mem" – memory held by the current trace, per column
+bool CallTraceMemCommand::DoExecute(lldb::SBDebugger debugger, char **command,
+                                    lldb::SBCommandReturnObject &result) {
+  std::vector<TraceStore::ColumnUsage> usage;
+  size_t records;
+  {
+    std::lock_guard<std::mutex> lk(g_trace_mutex);
+    records = g_trace_data.size();
+    usage = g_trace_data.MemoryUsage();
+  }
+  // Workers grow their arenas without a lock; read them once joined
+  bool workers_running = !g_trace_workers.empty();
+  if (!workers_running) {
+    TraceStore::ColumnUsage arena{"argument arena", 0, 0};
+    for (const auto &a : g_trace_arenas) {
+      arena.used += a->BytesUsed();
+      arena.reserved += a->BytesReserved();
+    }
+    usage.push_back(arena);
+  }
+  TraceStore::ColumnUsage values{"value pool", 0, 0};
+  g_value_pool.MemoryUsage(values.used, values.reserved);
+  usage.push_back(values);
+
+  result.Printf("%zu records, %zu distinct argument values%s\n", records,
+                g_value_pool.size(),
+                workers_running ? " (worker hits and the argument arena are "
+                                  "added at stop)"
+                                : "");
+  result.Printf("  %-16s %14s %14s %12s\n", "column", "used", "reserved",
+                "per record");
+  TraceStore::ColumnUsage total{"total", 0, 0};
+  for (const auto &column : usage) {
+    total.used += column.used;
+    total.reserved += column.reserved;
+  }
+  usage.push_back(total);
+  for (const auto &column : usage)
+    result.Printf("  %-16s %14zu %14zu %12.1f\n", column.name, column.used,
+                  column.reserved,
+                  records ? static_cast<double>(column.used) / records : 0.0);
+
+  result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Subcommand "calltrace policy" – argument capture policies
+//
+//   calltrace policy add function|type <regex> <mode> [limits]
+//   calltrace policy default <mode> [limits]
+//   calltrace policy list
+//   calltrace policy clear
+//
+// <mode> is none, type-only, shallow or full; [limits] are --max-depth N,
+// --max-children N, --max-bytes N and --include-self. Changes apply from the
+// next "calltrace start".
+static bool ParseCaptureMode(const char *text, CaptureMode &mode) {
+  for (uint8_t i = 0; i < 4; ++i) {
+    if (std::strcmp(text, kCaptureModeNames[i]) == 0) {
+      mode = static_cast<CaptureMode>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool ParseCapturePolicy(char **args, CapturePolicy &policy,
+                               lldb::SBCommandReturnObject &result) {
+  if (!args[0] || !ParseCaptureMode(args[0], policy.mode)) {
+    result.Printf("Expected a mode: none, type-only, shallow or full\n");
+    return false;
+  }
+  for (int i = 1; args[i]; ++i) {
+    std::string opt = args[i];
+    if (opt == "--include-self") {
+      policy.include_self = true;
+      continue;
+    }
+    if (!args[i + 1]) {
+      result.Printf("Missing value for %s\n", opt.c_str());
+      return false;
+    }
+    long value;
+    if (!ParseInteger(args[++i], value) || value < 0) {
+      result.Printf("Invalid value for %s: %s\n", opt.c_str(), args[i]);
+      return false;
+    }
+    if (opt == "--max-depth")
+      policy.max_depth = static_cast<int>(value);
+    else if (opt == "--max-children")
+      policy.max_children = static_cast<uint32_t>(value);
+    else if (opt == "--max-bytes")
+      policy.max_bytes = static_cast<size_t>(value);
+    else {
+      result.Printf("Unknown option: %s\n", opt.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+static void PrintCapturePolicy(lldb::SBCommandReturnObject &result,
+                               const CapturePolicy &p) {
+  result.Printf("%s (max-depth %d, max-children %u, max-bytes %zu%s)\n",
+                kCaptureModeNames[p.mode], p.max_depth, p.max_children,
+                p.max_bytes, p.include_self ? ", include-self" : "");
+}
+
+bool CallTracePolicyCommand::DoExecute(lldb::SBDebugger debugger, char **command,
+                                       lldb::SBCommandReturnObject &result) {
+  std::string sub = command && command[0] ? command[0] : "list";
+
+  if (sub == "list") {
+    result.Printf("default: ");
+    PrintCapturePolicy(result, g_default_policy);
+    for (size_t i = 0; i < g_policy_rules.size(); ++i) {
+      const CapturePolicyRule &rule = g_policy_rules[i];
+      result.Printf("#%zu %s '%s': ", i, rule.match_type ? "type" : "function",
+                    rule.pattern.c_str());
+      PrintCapturePolicy(result, rule.policy);
+    }
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "clear") {
+    g_policy_rules.clear();
+    g_default_policy = CapturePolicy();
+    result.Printf("Capture policies reset\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "default") {
+    CapturePolicy policy;
+    if (!ParseCapturePolicy(command + 1, policy, result)) {
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    g_default_policy = policy;
+    result.Printf("Default capture policy: ");
+    PrintCapturePolicy(result, policy);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "add") {
+    if (!command[1] || !command[2] ||
+        (std::strcmp(command[1], "function") != 0 &&
+         std::strcmp(command[1], "type") != 0)) {
+      result.Printf("Usage: calltrace policy add function|type <regex> <mode> "
+                    "[--max-depth N] [--max-children N] [--max-bytes N] "
+                    "[--include-self]\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    CapturePolicyRule rule;
+    rule.match_type = std::strcmp(command[1], "type") == 0;
+    rule.pattern = command[2];
+    try {
+      std::regex check(rule.pattern);
+    } catch (const std::regex_error &e) {
+      result.Printf("Invalid regex '%s': %s\n", rule.pattern.c_str(), e.what());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    if (!ParseCapturePolicy(command + 3, rule.policy, result)) {
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    g_policy_rules.push_back(rule);
+    result.Printf("Added %s policy #%zu for '%s': ",
+                  rule.match_type ? "type" : "function",
+                  g_policy_rules.size() - 1, rule.pattern.c_str());
+    PrintCapturePolicy(result, rule.policy);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  result.Printf("Unknown subcommand '%s' (expected add, default, list or clear)\n",
+                sub.c_str());
+  result.SetStatus(lldb::eReturnStatusFailed);
+  return false;
+}
+
 // -----------------------------------------------------------------------------
 // Command "format-enable" - enables pretty printing for contract types
 bool FormatEnableCommand::DoExecute(lldb::SBDebugger debugger, char **command,
@@ -1622,6 +4610,8 @@ bool FormatEnableCommand::DoExecute(lldb::SBDebugger debugger, char **command,
 // Plugin entry point: register "calltrace" multiword command + subcommands.
 
 bool RegisterWalnutCommands(lldb::SBCommandInterpreter &interpreter) {
+  g_frame_classifier.Compile(g_frame_patterns);
+
   // Create multiword command: "calltrace"
   lldb::SBCommand calltrace_cmd = interpreter.AddMultiwordCommand(
       "calltrace", "Function call tracing commands");
@@ -1634,7 +4624,10 @@ bool RegisterWalnutCommands(lldb::SBCommandInterpreter &interpreter) {
   {
     auto *start_iface = new CallTraceStartCommand();
     lldb::SBCommand start_cmd = calltrace_cmd.AddCommand(
-        "start", start_iface, "Start tracing: calltrace start [regex]");
+        "start", start_iface,
+        "Start tracing: calltrace start [--contracts-only] [--no-stack-snapshot] "
+        "[--workers N] [--huge-pages] [--storage] [--host-io] [--alloc] "
+        "[--fast | --probes] [--fast-ring N] [regex]");
     if (!start_cmd.IsValid()) {
       std::fprintf(stderr, "Failed to register 'calltrace start'\n");
       return false;
@@ -1652,6 +4645,82 @@ bool RegisterWalnutCommands(lldb::SBCommandInterpreter &interpreter) {
     }
   }
 
+  // Subcommand: "calltrace policy"
+  {
+    auto *policy_iface = new CallTracePolicyCommand();
+    lldb::SBCommand policy_cmd = calltrace_cmd.AddCommand(
+        "policy", policy_iface,
+        "Argument capture policies: calltrace policy add|default|list|clear");
+    if (!policy_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'calltrace policy'\n");
+      return false;
+    }
+  }
+
+  // Subcommand: "calltrace classify"
+  {
+    auto *classify_iface = new CallTraceClassifyCommand();
+    lldb::SBCommand classify_cmd = calltrace_cmd.AddCommand(
+        "classify", classify_iface,
+        "Frame classification patterns: calltrace classify add|remove|list|reset");
+    if (!classify_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'calltrace classify'\n");
+      return false;
+    }
+  }
+
+  // Subcommand: "calltrace mem"
+  {
+    auto *mem_iface = new CallTraceMemCommand();
+    lldb::SBCommand mem_cmd = calltrace_cmd.AddCommand(
+        "mem", mem_iface,
+        "Show the memory held by the current trace, per column (calltrace mem).");
+    if (!mem_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'calltrace mem'\n");
+      return false;
+    }
+  }
+
+  // Subcommand: "calltrace coverage"
+  {
+    auto *coverage_iface = new CallTraceCoverageCommand();
+    lldb::SBCommand coverage_cmd = calltrace_cmd.AddCommand(
+        "coverage", coverage_iface,
+        "Function coverage with one-shot breakpoints: calltrace coverage "
+        "start|stop|show|export|merge|clear");
+    if (!coverage_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'calltrace coverage'\n");
+      return false;
+    }
+  }
+
+  // Subcommand: "calltrace linecov"
+  {
+    auto *linecov_iface = new CallTraceLineCovCommand();
+    lldb::SBCommand linecov_cmd = calltrace_cmd.AddCommand(
+        "linecov", linecov_iface,
+        "Line coverage and hit counts over the line table: calltrace linecov "
+        "start|stop|show|export|merge|clear");
+    if (!linecov_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'calltrace linecov'\n");
+      return false;
+    }
+  }
+
+  // Subcommand: "calltrace sample"
+  {
+    auto *sample_iface = new CallTraceSampleCommand();
+    lldb::SBCommand sample_cmd = calltrace_cmd.AddCommand(
+        "sample", sample_iface,
+        "Sampling profiler: calltrace sample [--hz N] [--depth D] "
+        "[--duration S] [--user-only] | show [N] | export folded|pprof [path] "
+        "| clear");
+    if (!sample_cmd.IsValid()) {
+      std::fprintf(stderr, "Failed to register 'calltrace sample'\n");
+      return false;
+    }
+  }
+
   // Add format-enable command
   {
     auto *format_iface = new FormatEnableCommand();
@@ -1,6 +1,9 @@
 #pragma once
 
 #include <lldb/API/SBCommandInterpreter.h>
+#include <cstdio>
+#include <string>
+#include <string_view>
 
 class CallTraceStartCommand : public lldb::SBCommandPluginInterface {
 public:
@@ -14,10 +17,54 @@ public:
                  lldb::SBCommandReturnObject &result) override;
 };
 
+class CallTracePolicyCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
+
+class CallTraceClassifyCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
+
+class CallTraceMemCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
+
 class FormatEnableCommand : public lldb::SBCommandPluginInterface {
 public:
   bool DoExecute(lldb::SBDebugger debugger, char **command,
                  lldb::SBCommandReturnObject &result) override;
 };
 
+// The frames FindUserFrame stops at: line info, and neither the function nor
+// its source file classified as runtime
+bool IsUserFrame(lldb::SBFrame &frame);
+
+// Rust symbol names. "::" inside generic arguments does not separate path
+// components.
+std::string_view StripRustHash(std::string_view name); // Drops "::h<hex>"
+std::string_view LastPathComponent(std::string_view name);
+// The meaningful tail of a function name: "function" or "Type::method"
+std::string ExtractBaseName(std::string_view fn);
+
+// Output sink shared by the console and file exporters
+struct JSONWriter {
+  lldb::SBCommandReturnObject *result = nullptr;
+  FILE *fp = nullptr;
+
+  void Printf(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Escape a string for safe inclusion in JSON
+std::string JsonEscape(std::string_view s);
+
+// A whole base-10 command argument; false on empty input, trailing characters
+// ("1k") or overflow
+bool ParseInteger(const char *text, long &out);
+
 bool RegisterWalnutCommands(lldb::SBCommandInterpreter &interpreter);
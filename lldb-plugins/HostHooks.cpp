@@ -0,0 +1,330 @@
+//
+// stylusdb
+//
+// Internal breakpoints on the Stylus host I/O entry points. A single entry
+// breakpoint covers every hooked host function; the owning function of each
+// location is resolved once and cached by address, so a hit costs one hash
+// lookup before the listeners run. Returns are caught with one breakpoint per
+// distinct return address and matched against a per-thread shadow stack.
+//
+
+#include "HostHooks.h"
+
+#include <lldb/API/SBAddress.h>
+#include <lldb/API/SBBreakpoint.h>
+#include <lldb/API/SBBreakpointLocation.h>
+#include <lldb/API/SBCommandInterpreter.h>
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBDebugger.h>
+#include <lldb/API/SBFileSpecList.h>
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBSymbol.h>
+#include <lldb/API/SBValue.h>
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Signatures as in stylus_sdk::hostio; lengths are the requested ones
+const HostFunctionInfo g_host_functions[kHostFunctionCount] = {
+    // (contract, calldata, calldata_len, value, gas, return_data_len)
+    {"call_contract", kHostCategoryCall, 20 + 32, 2},
+    {"delegate_call_contract", kHostCategoryCall, 20, 2},
+    {"static_call_contract", kHostCategoryCall, 20, 2},
+    {"storage_load_bytes32", kHostCategoryStorageLoad, 64, -1},
+    {"storage_cache_bytes32", kHostCategoryStorageWrite, 64, -1},
+    {"storage_store_bytes32", kHostCategoryStorageWrite, 64, -1},
+    {"storage_flush_cache", kHostCategoryStorageWrite, 0, -1},
+    // Takes no length: listeners credit the one user_entrypoint was called
+    // with
+    {"read_args", kHostCategoryIo, 0, -1},
+    {"write_result", kHostCategoryIo, 0, 1},
+    {"read_return_data", kHostCategoryIo, 0, 2},
+    {"return_data_size", kHostCategoryIo, 0, -1},
+    {"create1", kHostCategoryIo, 32 + 20, 1},
+    {"create2", kHostCategoryIo, 32 + 32 + 20, 1},
+    {"emit_log", kHostCategoryIo, 0, 1},
+    {"native_keccak256", kHostCategoryIo, 32, 1},
+    {"account_balance", kHostCategoryIo, 20 + 32, -1},
+    {"account_code", kHostCategoryIo, 20, 2},
+    {"account_code_size", kHostCategoryIo, 20, -1},
+    {"account_codehash", kHostCategoryIo, 20 + 32, -1},
+    {"block_basefee", kHostCategoryIo, 32, -1},
+    {"block_coinbase", kHostCategoryIo, 20, -1},
+    {"block_gas_limit", kHostCategoryIo, 0, -1},
+    {"block_number", kHostCategoryIo, 0, -1},
+    {"block_timestamp", kHostCategoryIo, 0, -1},
+    {"chainid", kHostCategoryIo, 0, -1},
+    {"contract_address", kHostCategoryIo, 20, -1},
+    {"evm_gas_left", kHostCategoryIo, 0, -1},
+    {"evm_ink_left", kHostCategoryIo, 0, -1},
+    {"msg_reentrant", kHostCategoryIo, 0, -1},
+    {"msg_sender", kHostCategoryIo, 20, -1},
+    {"msg_value", kHostCategoryIo, 32, -1},
+    {"tx_gas_price", kHostCategoryIo, 32, -1},
+    {"tx_ink_price", kHostCategoryIo, 0, -1},
+    {"tx_origin", kHostCategoryIo, 20, -1},
+    {"pay_for_memory_grow", kHostCategoryIo, 0, -1},
+    {"transient_load_bytes32", kHostCategoryIo, 64, -1},
+    {"transient_store_bytes32", kHostCategoryIo, 64, -1},
+    // (value, by[, modulus]): 32-byte operands, the result overwrites value
+    {"math_div", kHostCategoryIo, 64, -1},
+    {"math_mod", kHostCategoryIo, 64, -1},
+    {"math_pow", kHostCategoryIo, 64, -1},
+    {"math_add_mod", kHostCategoryIo, 96, -1},
+    {"math_mul_mod", kHostCategoryIo, 96, -1},
+    {"exit_early", kHostCategoryIo, 0, -1},
+    // (size, align), (ptr, old_size, align, new_size), (ptr, size, align)
+    {"__rust_alloc", kHostCategoryAlloc, 0, -1},
+    {"__rust_alloc_zeroed", kHostCategoryAlloc, 0, -1},
+    {"__rust_realloc", kHostCategoryAlloc, 0, -1},
+    {"__rust_dealloc", kHostCategoryFree, 0, -1},
+    // (args_len)
+    {"user_entrypoint", kHostCategoryEntry, 0, -1},
+};
+
+struct HostCallListener {
+  int id;
+  uint32_t category_mask;
+  bool want_returns;
+  HostCallHandler handler;
+};
+
+struct PendingReturn {
+  lldb::addr_t return_pc;
+  HostCallEvent event;
+};
+
+static std::vector<HostCallListener> g_listeners;
+static int g_next_listener_id = 1;
+static uint32_t g_hooked_categories = 0;
+static lldb::SBBreakpoint g_entry_bp;
+// Entry breakpoint location address -> host function, filled on first hit
+static std::unordered_map<lldb::addr_t, HostFunctionId> g_location_ids;
+// Return address -> breakpoint planted there
+static std::unordered_map<lldb::addr_t, lldb::SBBreakpoint> g_return_bps;
+// Per-thread stack of host calls still waiting for their return
+static std::unordered_map<lldb::tid_t, std::vector<PendingReturn>> g_pending_returns;
+static const char *g_return_register = "rax";
+
+static const char *const kArgRegisters[6] = {"arg1", "arg2", "arg3",
+                                             "arg4", "arg5", "arg6"};
+
+uint64_t ReadRegisterValue(lldb::SBFrame &frame, const char *name) {
+  lldb::SBValue reg = frame.FindRegister(name);
+  return reg.IsValid() ? reg.GetValueAsUnsigned(0) : 0;
+}
+
+const char *ReturnRegisterName(lldb::SBTarget &target) {
+  const char *triple = target.GetTriple();
+  if (triple && (std::strncmp(triple, "aarch64", 7) == 0 ||
+                 std::strncmp(triple, "arm64", 5) == 0))
+    return "x0";
+  return "rax";
+}
+
+static bool ResolveHostFunction(lldb::SBBreakpointLocation &location,
+                                HostFunctionId &id) {
+  lldb::addr_t addr = location.GetLoadAddress();
+  auto it = g_location_ids.find(addr);
+  if (it != g_location_ids.end()) {
+    id = it->second;
+    return true;
+  }
+
+  lldb::SBSymbol symbol = location.GetAddress().GetSymbol();
+  const char *name = symbol.IsValid() ? symbol.GetName() : nullptr;
+  if (!name)
+    return false;
+  for (uint8_t i = 0; i < kHostFunctionCount; ++i) {
+    if (std::strcmp(name, g_host_functions[i].name) == 0) {
+      id = static_cast<HostFunctionId>(i);
+      g_location_ids.emplace(addr, id);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void Dispatch(lldb::SBProcess &process, lldb::SBThread &thread,
+                     const HostCallEvent &event) {
+  uint32_t category = g_host_functions[event.id].category;
+  // Index loop: a handler may register further listeners
+  for (size_t i = 0; i < g_listeners.size(); ++i) {
+    const HostCallListener &l = g_listeners[i];
+    if (!(l.category_mask & category))
+      continue;
+    if (event.is_return && !l.want_returns)
+      continue;
+    l.handler(process, thread, event);
+  }
+}
+
+static bool HostReturnCallback(void *baton, lldb::SBProcess &process,
+                               lldb::SBThread &thread,
+                               lldb::SBBreakpointLocation &location) {
+  auto it = g_pending_returns.find(thread.GetThreadID());
+  if (it == g_pending_returns.end() || it->second.empty())
+    return false;
+
+  lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+  if (!frame.IsValid())
+    return false;
+  lldb::addr_t pc = frame.GetPC();
+  lldb::addr_t sp = frame.GetSP();
+
+  // After the return, SP is back at the host frame's CFA. Anything at or
+  // below SP has returned: the call returning here plus any frames that were
+  // unwound past without passing through their own return address.
+  std::vector<PendingReturn> &stack = it->second;
+  while (!stack.empty() && stack.back().event.cfa <= sp) {
+    PendingReturn pending = stack.back();
+    stack.pop_back();
+    pending.event.is_return = true;
+    if (pending.return_pc == pc)
+      pending.event.ret = ReadRegisterValue(frame, g_return_register);
+    Dispatch(process, thread, pending.event);
+  }
+  return false;
+}
+
+static void EnsureReturnBreakpoint(lldb::SBTarget target,
+                                   lldb::addr_t return_pc) {
+  if (g_return_bps.count(return_pc))
+    return;
+  lldb::SBBreakpoint bp = target.BreakpointCreateByAddress(return_pc);
+  if (!bp.IsValid())
+    return;
+  bp.SetCallback(HostReturnCallback, nullptr);
+  bp.SetAutoContinue(true);
+  bp.AddName("stylusdb-host-hook");
+  g_return_bps.emplace(return_pc, bp);
+}
+
+static bool HostEntryCallback(void *baton, lldb::SBProcess &process,
+                              lldb::SBThread &thread,
+                              lldb::SBBreakpointLocation &location) {
+  HostFunctionId id;
+  if (!ResolveHostFunction(location, id))
+    return false;
+
+  lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+  if (!frame.IsValid())
+    return false;
+
+  HostCallEvent event{};
+  event.id = id;
+  event.is_return = false;
+  event.tid = thread.GetThreadID();
+  event.cfa = frame.GetCFA();
+  for (int i = 0; i < 6; ++i)
+    event.args[i] = ReadRegisterValue(frame, kArgRegisters[i]);
+
+  Dispatch(process, thread, event);
+
+  uint32_t category = g_host_functions[id].category;
+  bool want_returns = false;
+  for (const auto &l : g_listeners)
+    want_returns |= l.want_returns && (l.category_mask & category);
+  if (!want_returns)
+    return false;
+
+  lldb::SBFrame caller = thread.GetFrameAtIndex(1);
+  if (!caller.IsValid())
+    return false;
+  lldb::addr_t return_pc = caller.GetPC();
+  EnsureReturnBreakpoint(process.GetTarget(), return_pc);
+  g_pending_returns[event.tid].push_back({return_pc, event});
+  return false;
+}
+
+// Entry hooks must stop on the first instruction: past the prologue the
+// argument registers may have been reused and SP has moved. The SB API has no
+// per-breakpoint switch, but the resolver latches target.skip-prologue when
+// the breakpoint is created, so the setting is turned off just for that and
+// then put back.
+static lldb::SBBreakpoint
+CreateEntryBreakpoint(lldb::SBTarget &target,
+                      std::vector<const char *> &names) {
+  lldb::SBCommandInterpreter ci = target.GetDebugger().GetCommandInterpreter();
+  lldb::SBCommandReturnObject shown;
+  ci.HandleCommand("settings show target.skip-prologue", shown);
+  const char *output = shown.GetOutput();
+  bool skip_prologue = !(output && std::strstr(output, "= false"));
+
+  lldb::SBCommandReturnObject ignored;
+  if (skip_prologue)
+    ci.HandleCommand("settings set target.skip-prologue false", ignored);
+  // Full-name match only: the exported C symbols, not SDK wrappers that happen
+  // to share the base name.
+  lldb::SBBreakpoint bp = target.BreakpointCreateByNames(
+      names.data(), names.size(), lldb::eFunctionNameTypeFull,
+      lldb::SBFileSpecList(), lldb::SBFileSpecList());
+  if (skip_prologue)
+    ci.HandleCommand("settings set target.skip-prologue true", ignored);
+  return bp;
+}
+
+static void UpdateEntryBreakpoint(lldb::SBTarget &target) {
+  uint32_t categories = 0;
+  for (const auto &l : g_listeners)
+    categories |= l.category_mask;
+  if (categories == g_hooked_categories && g_entry_bp.IsValid())
+    return;
+
+  if (g_entry_bp.IsValid())
+    target.BreakpointDelete(g_entry_bp.GetID());
+  g_entry_bp = lldb::SBBreakpoint();
+  g_location_ids.clear();
+  g_hooked_categories = categories;
+  if (!categories)
+    return;
+
+  std::vector<const char *> names;
+  for (const auto &fn : g_host_functions)
+    if (fn.category & categories)
+      names.push_back(fn.name);
+
+  g_entry_bp = CreateEntryBreakpoint(target, names);
+  if (!g_entry_bp.IsValid())
+    return;
+  g_entry_bp.SetCallback(HostEntryCallback, nullptr);
+  g_entry_bp.SetAutoContinue(true);
+  g_entry_bp.AddName("stylusdb-host-hook");
+}
+
+int AddHostCallListener(lldb::SBTarget &target, uint32_t category_mask,
+                        bool want_returns, HostCallHandler handler) {
+  if (!target.IsValid() || !handler || !category_mask)
+    return -1;
+
+  g_return_register = ReturnRegisterName(target);
+  int id = g_next_listener_id++;
+  g_listeners.push_back({id, category_mask, want_returns, handler});
+  UpdateEntryBreakpoint(target);
+  if (!g_entry_bp.IsValid()) {
+    g_listeners.pop_back();
+    return -1;
+  }
+  return id;
+}
+
+void RemoveHostCallListener(lldb::SBTarget &target, int listener_id) {
+  for (auto it = g_listeners.begin(); it != g_listeners.end(); ++it) {
+    if (it->id == listener_id) {
+      g_listeners.erase(it);
+      break;
+    }
+  }
+  UpdateEntryBreakpoint(target);
+
+  bool any_returns = false;
+  for (const auto &l : g_listeners)
+    any_returns |= l.want_returns;
+  if (!any_returns) {
+    for (auto &[pc, bp] : g_return_bps)
+      target.BreakpointDelete(bp.GetID());
+    g_return_bps.clear();
+    g_pending_returns.clear();
+  }
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBThread.h>
+
+#include <cstdint>
+
+// Stylus host I/O entry points (the "vm_hooks" imports of stylus_sdk::hostio).
+// The native replay host exports them as plain C symbols, so one internal
+// breakpoint per entry point observes every contract -> host transition.
+// The Rust allocator shims ride along: they are plain C symbols too, and
+// profiling them needs the same entry/return plumbing. So does the contracts'
+// user_entrypoint, whose argument is the length read_args copies.
+enum HostFunctionId : uint8_t {
+  kHostCallContract,
+  kHostDelegateCallContract,
+  kHostStaticCallContract,
+  kHostStorageLoadBytes32,
+  kHostStorageCacheBytes32,
+  kHostStorageStoreBytes32, // Pre-cache SDKs write through directly
+  kHostStorageFlushCache,
+  kHostReadArgs,
+  kHostWriteResult,
+  kHostReadReturnData,
+  kHostReturnDataSize,
+  kHostCreate1,
+  kHostCreate2,
+  kHostEmitLog,
+  kHostNativeKeccak256,
+  kHostAccountBalance,
+  kHostAccountCode,
+  kHostAccountCodeSize,
+  kHostAccountCodehash,
+  kHostBlockBasefee,
+  kHostBlockCoinbase,
+  kHostBlockGasLimit,
+  kHostBlockNumber,
+  kHostBlockTimestamp,
+  kHostChainid,
+  kHostContractAddress,
+  kHostEvmGasLeft,
+  kHostEvmInkLeft,
+  kHostMsgReentrant,
+  kHostMsgSender,
+  kHostMsgValue,
+  kHostTxGasPrice,
+  kHostTxInkPrice,
+  kHostTxOrigin,
+  kHostPayForMemoryGrow,
+  kHostTransientLoadBytes32,
+  kHostTransientStoreBytes32,
+  kHostMathDiv,
+  kHostMathMod,
+  kHostMathPow,
+  kHostMathAddMod,
+  kHostMathMulMod,
+  kHostExitEarly,
+  kHostRustAlloc,
+  kHostRustAllocZeroed,
+  kHostRustRealloc,
+  kHostRustDealloc,
+  kHostUserEntrypoint,
+  kHostFunctionCount
+};
+
+enum HostCategory : uint32_t {
+  kHostCategoryCall = 1u << 0,         // Cross-contract calls
+  kHostCategoryStorageLoad = 1u << 1,  // Slot reads; the value is out on return
+  kHostCategoryStorageWrite = 1u << 2, // Slot writes and cache flushes
+  kHostCategoryIo = 1u << 3,           // Everything else
+  kHostCategoryAll = (1u << 4) - 1,    // Every Stylus host function
+  kHostCategoryAlloc = 1u << 4,        // Allocations; the pointer is returned
+  kHostCategoryFree = 1u << 5,
+  kHostCategoryEntry = 1u << 6,        // Contract entrypoints
+};
+
+struct HostFunctionInfo {
+  const char *name;
+  uint32_t category;
+  // Bytes a call moves across the host boundary: fixed-size operands (keys,
+  // addresses, words) plus the value of argument `length_arg`, if any
+  uint16_t fixed_bytes;
+  int8_t length_arg;
+};
+
+extern const HostFunctionInfo g_host_functions[kHostFunctionCount];
+
+// One entry into (or return from) a hooked host function. Arguments are the
+// integer argument registers captured at entry; returns carry them along so
+// listeners can read output buffers the callee filled in.
+struct HostCallEvent {
+  HostFunctionId id;
+  bool is_return;
+  lldb::tid_t tid;
+  lldb::addr_t cfa;     // Canonical frame address of the host call
+  uint64_t args[6];
+  uint64_t ret;         // Return register (returns only)
+};
+
+using HostCallHandler = void (*)(lldb::SBProcess &process,
+                                 lldb::SBThread &thread,
+                                 const HostCallEvent &event);
+
+// Registers a listener for every host function in `category_mask`. The entry
+// breakpoint is (re)created to cover the union of all listeners' categories;
+// return breakpoints are only planted when some listener asked for returns.
+// Returns a listener id for RemoveHostCallListener, or -1 on failure.
+int AddHostCallListener(lldb::SBTarget &target, uint32_t category_mask,
+                        bool want_returns, HostCallHandler handler);
+void RemoveHostCallListener(lldb::SBTarget &target, int listener_id);
+
+// Register helpers shared by the hook listeners.
+uint64_t ReadRegisterValue(lldb::SBFrame &frame, const char *name);
+const char *ReturnRegisterName(lldb::SBTarget &target);
@@ -0,0 +1,588 @@
+//
+// stylusdb
+//
+// Trampoline probes. Each traced function's entry is overwritten with a jump
+// (a near jump when the trampoline is in range, an absolute one otherwise) to
+// a trampoline that saves the argument registers, calls
+// stylusdb_fasttrace_probe(function, cfa) in the preloaded runtime, restores
+// the registers, runs the instructions the jump displaced and jumps back.
+//
+// Patching needs the process stopped, so functions are discovered and patched
+// from a breakpoint over the traced set: its first hit, once the contract is
+// loaded, patches every resolved function. A prologue is only relocated when
+// none of the displaced instructions is pc-relative or a branch, nothing in
+// the function branches into the middle of it and no thread is executing it;
+// a function a thread is inside of is patched on its next entry instead.
+// Everything else keeps its breakpoint, whose hits are recorded into the same
+// ring so the call tree stays in one piece.
+//
+
+#include "ProbeEngine.h"
+#include "ContractCommands.h"
+#include "FastTrace.h"
+
+#include <lldb/API/SBAddress.h>
+#include <lldb/API/SBBreakpoint.h>
+#include <lldb/API/SBBreakpointLocation.h>
+#include <lldb/API/SBError.h>
+#include <lldb/API/SBFileSpec.h>
+#include <lldb/API/SBFileSpecList.h>
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBFunction.h>
+#include <lldb/API/SBInstruction.h>
+#include <lldb/API/SBInstructionList.h>
+#include <lldb/API/SBModule.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBSymbol.h>
+#include <lldb/API/SBThread.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+enum ProbeArch { kProbeArchNone, kProbeArchX86_64, kProbeArchAArch64 };
+
+enum ProbeStatus : uint8_t {
+  kProbePatched,
+  kProbeDeferred,
+  kProbeFallback,
+};
+
+struct ProbedFunction {
+  ProbeStatus status = kProbeFallback;
+  lldb::addr_t trampoline = LLDB_INVALID_ADDRESS;
+  std::vector<uint8_t> original; // Bytes the jump replaced
+  std::vector<lldb::break_id_t> locations; // Discovery locations in the function
+  lldb::SBBreakpoint entry_bp;             // Deferred: breakpoint on the entry
+};
+
+struct TrampolineChunk {
+  lldb::addr_t base;
+  size_t used;
+};
+
+static const size_t kTrampolineChunk = 64 * 1024;
+// Upper bound for one trampoline on either architecture
+static const size_t kTrampolineSize = 256;
+static const char *const kProbeEntrySymbol = "stylusdb_fasttrace_probe";
+
+static ProbeArch g_probe_arch = kProbeArchNone;
+static FastTraceConsumer *g_probe_ring = nullptr;
+static lldb::SBBreakpoint g_probe_bp;
+static lldb::addr_t g_probe_entry = LLDB_INVALID_ADDRESS;
+// Function start -> probe state
+static std::unordered_map<lldb::addr_t, ProbedFunction> g_probed;
+static std::unordered_set<lldb::break_id_t> g_probe_locations_seen;
+// Discovery locations at the last scan; they only change as modules load
+static size_t g_probe_locations_scanned = 0;
+static bool g_probe_entry_missing = false;
+static std::vector<TrampolineChunk> g_trampoline_chunks;
+
+static ProbeArch ArchForTarget(lldb::SBTarget &target) {
+  const char *triple = target.GetTriple();
+  if (!triple || !std::strstr(triple, "linux"))
+    return kProbeArchNone;
+  if (std::strncmp(triple, "x86_64", 6) == 0)
+    return kProbeArchX86_64;
+  if (std::strncmp(triple, "aarch64", 7) == 0 ||
+      std::strncmp(triple, "arm64", 5) == 0)
+    return kProbeArchAArch64;
+  return kProbeArchNone;
+}
+
+static lldb::addr_t FunctionStart(lldb::SBTarget &target,
+                                  lldb::SBBreakpointLocation &location) {
+  lldb::SBAddress addr = location.GetAddress();
+  lldb::SBFunction function = addr.GetFunction();
+  if (function.IsValid())
+    return function.GetStartAddress().GetLoadAddress(target);
+  lldb::SBSymbol symbol = addr.GetSymbol();
+  if (symbol.IsValid())
+    return symbol.GetStartAddress().GetLoadAddress(target);
+  return LLDB_INVALID_ADDRESS;
+}
+
+// Modules never probed, whatever the regex: the runtime the trampolines call
+// and the libc, loader and vdso code it runs on. A probe there would re-enter
+// itself.
+static bool IsProbeExcludedModule(const lldb::SBModule &module) {
+  const char *filename = module.GetFileSpec().GetFilename();
+  if (!filename)
+    return false;
+  for (const char *prefix : {"libstylusdb_fasttrace", "libc.so", "libc-",
+                             "ld-linux", "ld-musl", "linux-vdso", "linux-gate",
+                             "[vdso]"})
+    if (std::strncmp(filename, prefix, std::strlen(prefix)) == 0)
+      return true;
+  return false;
+}
+
+static lldb::addr_t FindProbeEntry(lldb::SBTarget &target) {
+  uint32_t num_modules = target.GetNumModules();
+  for (uint32_t i = 0; i < num_modules; ++i) {
+    lldb::SBModule module = target.GetModuleAtIndex(i);
+    lldb::SBSymbol symbol = module.FindSymbol(kProbeEntrySymbol);
+    if (symbol.IsValid())
+      return symbol.GetStartAddress().GetLoadAddress(target);
+  }
+  return LLDB_INVALID_ADDRESS;
+}
+
+static lldb::addr_t AllocateTrampoline(lldb::SBProcess &process) {
+  if (g_trampoline_chunks.empty() ||
+      g_trampoline_chunks.back().used + kTrampolineSize > kTrampolineChunk) {
+    lldb::SBError error;
+    lldb::addr_t base = process.AllocateMemory(
+        kTrampolineChunk, lldb::ePermissionsReadable | lldb::ePermissionsExecutable,
+        error);
+    if (error.Fail() || base == LLDB_INVALID_ADDRESS)
+      return LLDB_INVALID_ADDRESS;
+    g_trampoline_chunks.push_back({base, 0});
+  }
+  TrampolineChunk &chunk = g_trampoline_chunks.back();
+  lldb::addr_t addr = chunk.base + chunk.used;
+  chunk.used += kTrampolineSize;
+  return addr;
+}
+
+// Bytes the jump to `trampoline` takes at `start`
+static size_t PatchSize(lldb::addr_t start, lldb::addr_t trampoline) {
+  int64_t distance = static_cast<int64_t>(trampoline - start);
+  if (g_probe_arch == kProbeArchX86_64)
+    return distance - 5 >= INT32_MIN && distance - 5 <= INT32_MAX ? 5 : 14;
+  return distance >= -(1ll << 27) && distance < (1ll << 27) ? 4 : 16;
+}
+
+// Instructions that depend on where they execute, or transfer control
+static bool IsRelocatable(lldb::SBTarget &target, lldb::SBInstruction &inst) {
+  if (inst.DoesBranch())
+    return false;
+  const char *mnemonic_c = inst.GetMnemonic(target);
+  const char *operands_c = inst.GetOperands(target);
+  std::string mnemonic = mnemonic_c ? mnemonic_c : "";
+  std::string operands = operands_c ? operands_c : "";
+  if (g_probe_arch == kProbeArchX86_64)
+    return operands.find("rip") == std::string::npos && mnemonic != "ret" &&
+           mnemonic != "int3";
+
+  if (mnemonic == "adr" || mnemonic == "adrp" || mnemonic == "b" ||
+      mnemonic == "bl" || mnemonic.compare(0, 2, "b.") == 0 ||
+      mnemonic == "cbz" || mnemonic == "cbnz" || mnemonic == "tbz" ||
+      mnemonic == "tbnz" || mnemonic == "ret")
+    return false;
+  // Literal loads have a label operand instead of a [base, offset] one
+  if ((mnemonic == "ldr" || mnemonic == "ldrsw" || mnemonic == "prfm") &&
+      operands.find('[') == std::string::npos)
+    return false;
+  return true;
+}
+
+// Length of the whole instructions covering `need` bytes from `start`, or 0
+// when they cannot be moved
+static size_t RelocatablePrologue(lldb::SBTarget &target, lldb::addr_t start,
+                                  size_t need) {
+  lldb::SBAddress addr = target.ResolveLoadAddress(start);
+  lldb::SBFunction function = addr.GetFunction();
+  lldb::addr_t end = LLDB_INVALID_ADDRESS;
+  if (function.IsValid())
+    end = function.GetEndAddress().GetLoadAddress(target);
+  else if (lldb::SBSymbol symbol = addr.GetSymbol(); symbol.IsValid())
+    end = symbol.GetEndAddress().GetLoadAddress(target);
+  if (end == LLDB_INVALID_ADDRESS || end - start < need)
+    return 0;
+
+  lldb::SBInstructionList prologue = target.ReadInstructions(addr, 16);
+  size_t len = 0;
+  for (uint32_t i = 0; i < prologue.GetSize() && len < need; ++i) {
+    lldb::SBInstruction inst = prologue.GetInstructionAtIndex(i);
+    if (!inst.IsValid() || !IsRelocatable(target, inst))
+      return 0;
+    len += inst.GetByteSize();
+  }
+  if (len < need || end - start < len)
+    return 0;
+
+  // Nothing may branch back into the displaced instructions
+  if (function.IsValid()) {
+    lldb::SBInstructionList body = function.GetInstructions(target);
+    for (uint32_t i = 0; i < body.GetSize(); ++i) {
+      lldb::SBInstruction inst = body.GetInstructionAtIndex(i);
+      if (!inst.DoesBranch())
+        continue;
+      const char *operands = inst.GetOperands(target);
+      const char *hex = operands ? std::strstr(operands, "0x") : nullptr;
+      if (!hex)
+        continue;
+      lldb::addr_t dest = std::strtoull(hex, nullptr, 16);
+      if (dest > start && dest < start + len)
+        return 0;
+    }
+  }
+  return len;
+}
+
+static void Emit(std::vector<uint8_t> &out, std::initializer_list<uint8_t> bytes) {
+  out.insert(out.end(), bytes);
+}
+
+static void EmitLE(std::vector<uint8_t> &out, uint64_t value, int size) {
+  for (int i = 0; i < size; ++i)
+    out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+}
+
+static void EmitX86Trampoline(std::vector<uint8_t> &out, uint64_t fn,
+                              const std::vector<uint8_t> &displaced,
+                              uint64_t resume) {
+  // Argument registers, rax (vector count of variadic calls) and the scratch
+  // registers: 9 pushes leave rsp 16-byte aligned
+  Emit(out, {0x50, 0x57, 0x56, 0x52, 0x51, 0x41, 0x50, 0x41, 0x51, 0x41,
+             0x52, 0x41, 0x53});
+  Emit(out, {0x48, 0x81, 0xEC}); // sub rsp, 128
+  EmitLE(out, 128, 4);
+  for (uint8_t n = 0; n < 8; ++n) // movdqu [rsp + 16n], xmmN
+    Emit(out, {0xF3, 0x0F, 0x7F, static_cast<uint8_t>(0x44 | n << 3), 0x24,
+               static_cast<uint8_t>(n * 16)});
+  Emit(out, {0x48, 0x8D, 0xB4, 0x24}); // lea rsi, [rsp + 208]: the CFA
+  EmitLE(out, 128 + 72 + 8, 4);
+  Emit(out, {0x48, 0xBF}); // movabs rdi, fn
+  EmitLE(out, fn, 8);
+  Emit(out, {0x48, 0xB8}); // movabs rax, probe
+  EmitLE(out, g_probe_entry, 8);
+  Emit(out, {0xFF, 0xD0}); // call rax
+  for (uint8_t n = 0; n < 8; ++n) // movdqu xmmN, [rsp + 16n]
+    Emit(out, {0xF3, 0x0F, 0x6F, static_cast<uint8_t>(0x44 | n << 3), 0x24,
+               static_cast<uint8_t>(n * 16)});
+  Emit(out, {0x48, 0x81, 0xC4}); // add rsp, 128
+  EmitLE(out, 128, 4);
+  Emit(out, {0x41, 0x5B, 0x41, 0x5A, 0x41, 0x59, 0x41, 0x58, 0x59, 0x5A,
+             0x5E, 0x5F, 0x58});
+  out.insert(out.end(), displaced.begin(), displaced.end());
+  Emit(out, {0xFF, 0x25, 0, 0, 0, 0}); // jmp [rip]
+  EmitLE(out, resume, 8);
+}
+
+// AArch64 encodings used below; immediates are already scaled
+static uint32_t A64Pair(uint32_t op, int rt, int rt2, int rn, int imm7) {
+  return op | (static_cast<uint32_t>(imm7) & 0x7f) << 15 | rt2 << 10 |
+         rn << 5 | rt;
+}
+static const uint32_t kA64StpPre = 0xA9800000;
+static const uint32_t kA64Stp = 0xA9000000;
+static const uint32_t kA64Ldp = 0xA9400000;
+static const uint32_t kA64LdpPost = 0xA8C00000;
+static const uint32_t kA64StpQ = 0xAD000000;
+static const uint32_t kA64LdpQ = 0xAD400000;
+static const uint32_t kA64BlrX16 = 0xD63F0200;
+static const uint32_t kA64BrX16 = 0xD61F0200;
+static const int kSp = 31;
+
+static void EmitA64Trampoline(std::vector<uint8_t> &out, uint64_t fn,
+                              const std::vector<uint8_t> &displaced,
+                              uint64_t resume) {
+  std::vector<uint32_t> code;
+  // x29/x30, x0-x8 and q0-q7 in a 224-byte frame
+  code.push_back(A64Pair(kA64StpPre, 29, 30, kSp, -224 / 8));
+  for (int r = 0; r < 8; r += 2)
+    code.push_back(A64Pair(kA64Stp, r, r + 1, kSp, (16 + 8 * r) / 8));
+  code.push_back(0xF9000000 | (80 / 8) << 10 | kSp << 5 | 8); // str x8
+  for (int q = 0; q < 8; q += 2)
+    code.push_back(A64Pair(kA64StpQ, q, q + 1, kSp, (96 + 16 * q) / 16));
+  size_t load_fn = code.size();
+  code.push_back(0); // ldr x0, =fn
+  code.push_back(0x91000000 | 224 << 10 | kSp << 5 | 1); // add x1, sp, #224
+  size_t load_probe = code.size();
+  code.push_back(0); // ldr x16, =probe
+  code.push_back(kA64BlrX16);
+  for (int q = 6; q >= 0; q -= 2)
+    code.push_back(A64Pair(kA64LdpQ, q, q + 1, kSp, (96 + 16 * q) / 16));
+  code.push_back(0xF9400000 | (80 / 8) << 10 | kSp << 5 | 8); // ldr x8
+  for (int r = 6; r >= 0; r -= 2)
+    code.push_back(A64Pair(kA64Ldp, r, r + 1, kSp, (16 + 8 * r) / 8));
+  code.push_back(A64Pair(kA64LdpPost, 29, 30, kSp, 224 / 8));
+  for (size_t i = 0; i + 4 <= displaced.size(); i += 4) {
+    uint32_t inst;
+    std::memcpy(&inst, &displaced[i], 4);
+    code.push_back(inst);
+  }
+  size_t load_resume = code.size();
+  code.push_back(0); // ldr x16, =resume
+  code.push_back(kA64BrX16);
+  if (code.size() % 2)
+    code.push_back(0xD503201F); // nop: align the literals
+
+  // ldr (literal) x<rt>, literal `index` of the pool
+  auto ldr_literal = [&](size_t at, int rt, size_t index) {
+    size_t offset = (code.size() + 2 * index - at) * 4;
+    code[at] = 0x58000000 | static_cast<uint32_t>(offset / 4) << 5 | rt;
+  };
+  ldr_literal(load_fn, 0, 0);
+  ldr_literal(load_probe, 16, 1);
+  ldr_literal(load_resume, 16, 2);
+
+  for (uint32_t inst : code)
+    EmitLE(out, inst, 4);
+  EmitLE(out, fn, 8);
+  EmitLE(out, g_probe_entry, 8);
+  EmitLE(out, resume, 8);
+}
+
+static std::vector<uint8_t> EmitPatch(lldb::addr_t start,
+                                      lldb::addr_t trampoline, size_t size) {
+  std::vector<uint8_t> patch;
+  int64_t distance = static_cast<int64_t>(trampoline - start);
+  if (g_probe_arch == kProbeArchX86_64) {
+    if (size == 5) {
+      patch.push_back(0xE9); // jmp rel32
+      EmitLE(patch, static_cast<uint64_t>(distance - 5), 4);
+    } else {
+      Emit(patch, {0xFF, 0x25, 0, 0, 0, 0}); // jmp [rip]
+      EmitLE(patch, trampoline, 8);
+    }
+  } else if (size == 4) {
+    EmitLE(patch, 0x14000000 | (static_cast<uint64_t>(distance / 4) & 0x3ffffff),
+           4); // b
+  } else {
+    EmitLE(patch, 0x58000050, 4); // ldr x16, #8
+    EmitLE(patch, kA64BrX16, 4);
+    EmitLE(patch, trampoline, 8);
+  }
+  return patch;
+}
+
+// Tries to patch the function at `start`. `pcs` are the stopped threads'
+// program counters; a thread inside the displaced range defers the patch.
+static ProbeStatus PatchFunction(lldb::SBProcess &process, lldb::addr_t start,
+                                 const std::vector<lldb::addr_t> &pcs,
+                                 ProbedFunction &fn) {
+  if (g_probe_entry == LLDB_INVALID_ADDRESS)
+    return kProbeFallback;
+  lldb::SBTarget target = process.GetTarget();
+  if (fn.trampoline == LLDB_INVALID_ADDRESS)
+    fn.trampoline = AllocateTrampoline(process);
+  if (fn.trampoline == LLDB_INVALID_ADDRESS)
+    return kProbeFallback;
+
+  size_t patch_size = PatchSize(start, fn.trampoline);
+  size_t len = RelocatablePrologue(target, start, patch_size);
+  if (!len)
+    return kProbeFallback;
+  for (lldb::addr_t pc : pcs)
+    if (pc > start && pc < start + len)
+      return kProbeDeferred;
+
+  // Breakpoint sites in the range read back as the original bytes
+  std::vector<uint8_t> displaced(len);
+  lldb::SBError error;
+  if (process.ReadMemory(start, displaced.data(), len, error) != len)
+    return kProbeFallback;
+
+  std::vector<uint8_t> trampoline;
+  if (g_probe_arch == kProbeArchX86_64)
+    EmitX86Trampoline(trampoline, start, displaced, start + len);
+  else
+    EmitA64Trampoline(trampoline, start, displaced, start + len);
+  if (trampoline.size() > kTrampolineSize ||
+      process.WriteMemory(fn.trampoline, trampoline.data(), trampoline.size(),
+                          error) != trampoline.size())
+    return kProbeFallback;
+
+  std::vector<uint8_t> patch = EmitPatch(start, fn.trampoline, patch_size);
+  fn.original.assign(displaced.begin(), displaced.begin() + patch.size());
+  if (process.WriteMemory(start, patch.data(), patch.size(), error) !=
+      patch.size())
+    return kProbeFallback;
+  return kProbePatched;
+}
+
+static std::vector<lldb::addr_t> ThreadPCs(lldb::SBProcess &process) {
+  std::vector<lldb::addr_t> pcs;
+  uint32_t num_threads = process.GetNumThreads();
+  for (uint32_t i = 0; i < num_threads; ++i) {
+    lldb::SBThread thread = process.GetThreadAtIndex(i);
+    lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+    if (frame.IsValid())
+      pcs.push_back(frame.GetPC());
+  }
+  return pcs;
+}
+
+// A patched function needs none of its discovery locations any more
+static void RetireLocations(ProbedFunction &fn) {
+  for (lldb::break_id_t id : fn.locations) {
+    lldb::SBBreakpointLocation location = g_probe_bp.FindLocationByID(id);
+    if (location.IsValid())
+      location.SetEnabled(false);
+  }
+}
+
+static bool ProbeEntryCallback(void *baton, lldb::SBProcess &process,
+                               lldb::SBThread &thread,
+                               lldb::SBBreakpointLocation &location);
+
+// Patches every discovery location not looked at yet: on the first hit, all
+// matching functions loaded so far; later, those of modules loaded since
+static void InstallProbes(lldb::SBProcess &process) {
+  size_t count = g_probe_bp.GetNumLocations();
+  if (count == g_probe_locations_scanned)
+    return;
+  g_probe_locations_scanned = count;
+
+  lldb::SBTarget target = process.GetTarget();
+  if (g_probe_entry == LLDB_INVALID_ADDRESS) {
+    g_probe_entry = FindProbeEntry(target);
+    g_probe_entry_missing = g_probe_entry == LLDB_INVALID_ADDRESS;
+  }
+
+  std::vector<lldb::addr_t> pcs = ThreadPCs(process);
+  for (size_t i = 0; i < count; ++i) {
+    lldb::SBBreakpointLocation location =
+        g_probe_bp.GetLocationAtIndex(static_cast<uint32_t>(i));
+    if (!location.IsValid() ||
+        !g_probe_locations_seen.insert(location.GetID()).second)
+      continue;
+    if (IsProbeExcludedModule(location.GetAddress().GetModule())) {
+      location.SetEnabled(false);
+      continue;
+    }
+    lldb::addr_t start = FunctionStart(target, location);
+    if (start == LLDB_INVALID_ADDRESS)
+      continue;
+
+    auto [it, inserted] = g_probed.try_emplace(start);
+    ProbedFunction &fn = it->second;
+    fn.locations.push_back(location.GetID());
+    if (!inserted) {
+      if (fn.status == kProbePatched)
+        location.SetEnabled(false);
+      continue;
+    }
+
+    fn.status = PatchFunction(process, start, pcs, fn);
+    if (fn.status == kProbePatched) {
+      RetireLocations(fn);
+    } else if (fn.status == kProbeDeferred) {
+      fn.entry_bp = target.BreakpointCreateByAddress(start);
+      if (fn.entry_bp.IsValid()) {
+        fn.entry_bp.SetCallback(ProbeEntryCallback, nullptr);
+        fn.entry_bp.SetAutoContinue(true);
+        fn.entry_bp.AddName("stylusdb-probe");
+      } else {
+        fn.status = kProbeFallback;
+      }
+    }
+  }
+}
+
+// Deferred functions: stopped on the entry itself, where it is safe to patch.
+// Resuming at the entry then goes through the trampoline, which logs the call.
+static bool ProbeEntryCallback(void *baton, lldb::SBProcess &process,
+                               lldb::SBThread &thread,
+                               lldb::SBBreakpointLocation &location) {
+  lldb::addr_t start = location.GetLoadAddress();
+  auto it = g_probed.find(start);
+  if (it == g_probed.end() || it->second.status != kProbeDeferred)
+    return false;
+  ProbedFunction &fn = it->second;
+  fn.status = PatchFunction(process, start, ThreadPCs(process), fn);
+  if (fn.status == kProbeDeferred)
+    return false; // Another thread is still inside; try on the next entry
+  location.SetEnabled(false);
+  if (fn.status == kProbePatched)
+    RetireLocations(fn);
+  return false;
+}
+
+// Discovery breakpoint. The call that hit it did not go through a
+// trampoline, so it is recorded here.
+static bool ProbeDiscoveryCallback(void *baton, lldb::SBProcess &process,
+                                   lldb::SBThread &thread,
+                                   lldb::SBBreakpointLocation &location) {
+  lldb::SBTarget target = process.GetTarget();
+  lldb::SBFrame frame = thread.GetFrameAtIndex(0);
+  lldb::addr_t start = FunctionStart(target, location);
+  if (frame.IsValid() && start != LLDB_INVALID_ADDRESS)
+    g_probe_ring->Push(start, frame.GetCFA(),
+                       static_cast<uint32_t>(thread.GetThreadID()));
+  InstallProbes(process);
+  return false;
+}
+
+bool StartProbes(lldb::SBTarget &target, const std::string &regex,
+                 FastTraceConsumer &ring, std::string &error) {
+  StopProbes(target);
+  g_probe_arch = ArchForTarget(target);
+  if (g_probe_arch == kProbeArchNone) {
+    error = "probes need an x86-64 or AArch64 Linux target";
+    return false;
+  }
+  // The registered contracts' libraries, or the executable when none are
+  // registered; never every module
+  lldb::SBFileSpecList modules;
+  for (const auto &[addr, info] : g_contract_registry) {
+    if (info.module.IsValid())
+      modules.Append(info.module.GetFileSpec());
+    else if (info.lazy)
+      modules.Append(lldb::SBFileSpec(info.library_path.c_str(), true));
+  }
+  if (g_contract_registry.empty())
+    modules.Append(target.GetExecutable());
+  g_probe_bp = target.BreakpointCreateByRegex(regex.c_str(), modules,
+                                              lldb::SBFileSpecList());
+  if (!g_probe_bp.IsValid()) {
+    error = "failed to create breakpoint for regex: " + regex;
+    return false;
+  }
+  g_probe_bp.SetCallback(ProbeDiscoveryCallback, nullptr);
+  g_probe_bp.SetAutoContinue(true);
+  g_probe_bp.AddName("stylusdb-probe");
+  g_probe_ring = &ring;
+  return true;
+}
+
+ProbeStats StopProbes(lldb::SBTarget &target) {
+  ProbeStats stats;
+  lldb::SBProcess process =
+      target.IsValid() ? target.GetProcess() : lldb::SBProcess();
+  bool alive = process.IsValid() && process.GetState() == lldb::eStateStopped;
+
+  for (auto &[start, fn] : g_probed) {
+    switch (fn.status) {
+    case kProbePatched:
+      ++stats.patched;
+      if (alive) {
+        lldb::SBError error;
+        process.WriteMemory(start, fn.original.data(), fn.original.size(),
+                            error);
+      }
+      break;
+    case kProbeDeferred:
+      ++stats.deferred;
+      break;
+    case kProbeFallback:
+      ++stats.fallback;
+      break;
+    }
+    if (fn.entry_bp.IsValid() && target.IsValid())
+      target.BreakpointDelete(fn.entry_bp.GetID());
+  }
+  // A thread may still be inside a trampoline; only a stopped process with
+  // every prologue restored could tell, so the memory is left to the process
+  g_trampoline_chunks.clear();
+
+  if (g_probe_bp.IsValid() && target.IsValid())
+    target.BreakpointDelete(g_probe_bp.GetID());
+  g_probe_bp = lldb::SBBreakpoint();
+  g_probed.clear();
+  g_probe_locations_seen.clear();
+  g_probe_locations_scanned = 0;
+  stats.no_runtime = g_probe_entry_missing;
+  g_probe_entry_missing = false;
+  g_probe_entry = LLDB_INVALID_ADDRESS;
+  g_probe_ring = nullptr;
+  return stats;
+}
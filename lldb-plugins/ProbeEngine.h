@@ -0,0 +1,30 @@
+#pragma once
+
+#include <lldb/API/SBTarget.h>
+
+#include <cstddef>
+#include <string>
+
+class FastTraceConsumer;
+
+struct ProbeStats {
+  size_t patched = 0;  // Entries jump to a trampoline
+  size_t deferred = 0; // Waiting for their next entry to be patched
+  size_t fallback = 0; // Prologue not relocatable: entries still trap
+  bool no_runtime = false; // The runtime's probe entry was not found
+};
+
+// Dynamic entry probes for x86-64 and AArch64 Linux. Functions matching
+// `regex` in the registered contracts' libraries (the executable when none
+// are registered) are discovered through a breakpoint; once their module is loaded
+// the first instructions of each are copied into a trampoline in the
+// inferior and replaced by a jump to it. The trampoline calls the fast-trace
+// runtime's probe entry, which logs into `ring`, runs the relocated
+// instructions and jumps back. The process never stops for a patched
+// function. Requires the runtime preloaded as for "calltrace start --fast".
+bool StartProbes(lldb::SBTarget &target, const std::string &regex,
+                 FastTraceConsumer &ring, std::string &error);
+
+// Restores every patched prologue if the process is still around, frees the
+// trampolines and removes the probe breakpoints.
+ProbeStats StopProbes(lldb::SBTarget &target);
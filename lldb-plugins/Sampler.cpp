@@ -0,0 +1,533 @@
+//
+// stylusdb
+//
+// Sampling profiler for "calltrace sample". No breakpoints: the inferior runs
+// freely and a timer thread interrupts it at the requested rate. Each stop
+// captures a bounded backtrace of every thread, aggregated by stack, and the
+// process is resumed. The overhead is a function of the sample rate only, not
+// of how many calls the replay makes.
+//
+
+#include "Sampler.h"
+#include "FunctionCallTrace.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <lldb/API/SBCommandReturnObject.h>
+#include <lldb/API/SBDebugger.h>
+#include <lldb/API/SBFileSpec.h>
+#include <lldb/API/SBFrame.h>
+#include <lldb/API/SBLineEntry.h>
+#include <lldb/API/SBProcess.h>
+#include <lldb/API/SBTarget.h>
+#include <lldb/API/SBThread.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+static const char *const kDefaultFoldedPath = "/tmp/lldb_profile.folded";
+static const char *const kDefaultPprofPath = "/tmp/lldb_profile.pb";
+static const uint32_t kDefaultSampleDepth = 64;
+
+// A distinct frame: function plus source position. Names and files are
+// interned in SampleProfile::strings.
+struct SampleFrame {
+  uint32_t name;
+  uint32_t file;
+  uint32_t line;
+
+  bool operator==(const SampleFrame &other) const {
+    return name == other.name && file == other.file && line == other.line;
+  }
+};
+
+struct SampleFrameHash {
+  size_t operator()(const SampleFrame &f) const {
+    return (static_cast<size_t>(f.name) * 0x9e3779b97f4a7c15ull) ^
+           (static_cast<size_t>(f.file) << 32) ^ f.line;
+  }
+};
+
+struct SampleProfile {
+  std::vector<std::string> strings{""}; // pprof wants "" at index 0
+  std::unordered_map<std::string, uint32_t> string_ids{{"", 0}};
+  std::vector<SampleFrame> frames;
+  std::unordered_map<SampleFrame, uint32_t, SampleFrameHash> frame_ids;
+  // Stack of frame ids, leaf first -> samples
+  std::map<std::vector<uint32_t>, uint64_t> stacks;
+  uint64_t samples = 0;
+  uint64_t period_ns = 0;
+  uint64_t duration_ns = 0;
+  int64_t start_ns = 0;
+
+  uint32_t String(std::string_view s) {
+    auto [it, inserted] = string_ids.emplace(
+        std::string(s), static_cast<uint32_t>(strings.size()));
+    if (inserted)
+      strings.push_back(it->first);
+    return it->second;
+  }
+
+  uint32_t Frame(const SampleFrame &f) {
+    auto [it, inserted] =
+        frame_ids.emplace(f, static_cast<uint32_t>(frames.size()));
+    if (inserted)
+      frames.push_back(f);
+    return it->second;
+  }
+};
+
+static SampleProfile g_profile;
+
+static void SampleThread(lldb::SBThread &thread, uint32_t depth, bool user_only,
+                         std::vector<uint32_t> &stack) {
+  stack.clear();
+  uint32_t n = std::min(thread.GetNumFrames(), depth);
+  char pc_name[32];
+  for (uint32_t i = 0; i < n; ++i) {
+    lldb::SBFrame frame = thread.GetFrameAtIndex(i);
+    if (!frame.IsValid())
+      break;
+    if (user_only && !IsUserFrame(frame))
+      continue;
+
+    const char *name = frame.GetFunctionName();
+    if (!name) {
+      std::snprintf(pc_name, sizeof(pc_name), "0x%llx",
+                    static_cast<unsigned long long>(frame.GetPC()));
+      name = pc_name;
+    }
+    SampleFrame f{g_profile.String(name), 0, 0};
+    lldb::SBLineEntry entry = frame.GetLineEntry();
+    if (entry.IsValid()) {
+      lldb::SBFileSpec fs = entry.GetFileSpec();
+      const char *directory = fs.GetDirectory();
+      const char *filename = fs.GetFilename();
+      if (filename)
+        f.file = g_profile.String(directory ? std::string(directory) + "/" +
+                                                  filename
+                                            : std::string(filename));
+      f.line = entry.GetLine();
+    }
+    stack.push_back(g_profile.Frame(f));
+  }
+}
+
+// Interrupts the inferior once per period, measured from each resume, so time
+// spent taking a sample is not charged to the next one.
+struct SampleTimer {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool running = false;   // Inferior resumed and no interrupt sent yet
+  bool fired = false;     // The last stop was ours
+  bool done = false;
+  std::chrono::steady_clock::time_point resumed;
+
+  void Run(lldb::SBProcess process, std::chrono::nanoseconds period) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!done) {
+      cv.wait(lock, [&] { return done || running; });
+      if (done)
+        break;
+      if (cv.wait_until(lock, resumed + period,
+                        [&] { return done || !running; }))
+        continue;
+      // Sent under the lock: once the sampler has taken it after a stop, no
+      // interrupt for that run can still be on its way
+      running = false;
+      fired = true;
+      process.SendAsyncInterrupt();
+    }
+  }
+};
+
+// Whether the process stopped only because it was interrupted: every thread
+// stopped for no reason or for the SIGSTOP/SIGINT an interrupt shows up as.
+// A breakpoint, watchpoint, crash or other signal on any thread is not ours.
+static bool IsInterruptStop(lldb::SBProcess &process) {
+  uint32_t num_threads = process.GetNumThreads();
+  for (uint32_t t = 0; t < num_threads; ++t) {
+    lldb::SBThread thread = process.GetThreadAtIndex(t);
+    if (!thread.IsValid())
+      continue;
+    switch (thread.GetStopReason()) {
+    case lldb::eStopReasonInvalid:
+    case lldb::eStopReasonNone:
+      break;
+    case lldb::eStopReasonSignal: {
+      uint64_t signo = thread.GetStopReasonDataAtIndex(0);
+      if (signo != SIGSTOP && signo != SIGINT)
+        return false;
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool RunSampler(lldb::SBDebugger &debugger, lldb::SBProcess &process,
+                       uint32_t hz, uint32_t depth, double duration,
+                       bool user_only, lldb::SBCommandReturnObject &result) {
+  auto period = std::chrono::nanoseconds(1000000000ull / hz);
+  g_profile.period_ns = period.count();
+  auto start = std::chrono::steady_clock::now();
+  if (!g_profile.start_ns)
+    g_profile.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch())
+                             .count();
+
+  // Synchronous mode: Continue() returns once the inferior stops again,
+  // whether for our interrupt, a breakpoint, a crash or an exit
+  bool async = debugger.GetAsync();
+  debugger.SetAsync(false);
+
+  SampleTimer timer;
+  std::thread timer_thread([&] { timer.Run(process, period); });
+
+  std::vector<uint32_t> stack;
+  uint64_t taken = 0;
+  const char *reason = "duration elapsed";
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(timer.mutex);
+      timer.running = true;
+      timer.fired = false;
+      timer.resumed = std::chrono::steady_clock::now();
+    }
+    timer.cv.notify_all();
+    process.Continue();
+    bool fired;
+    {
+      std::lock_guard<std::mutex> lock(timer.mutex);
+      timer.running = false;
+      fired = timer.fired;
+    }
+    timer.cv.notify_all();
+
+    lldb::StateType state = process.GetState();
+    if (state == lldb::eStateExited) {
+      reason = "process exited";
+      break;
+    }
+    if (state != lldb::eStateStopped) {
+      reason = "process is no longer running";
+      break;
+    }
+    // A stop we did not ask for (breakpoint, signal, Ctrl-C) is not sampled;
+    // it ends the session and leaves the process there for the user. That
+    // includes one that raced the timer: the interrupt reaches a process
+    // that is already stopped, and is dropped.
+    if (!fired || !IsInterruptStop(process)) {
+      reason = "process stopped";
+      break;
+    }
+
+    uint32_t num_threads = process.GetNumThreads();
+    for (uint32_t t = 0; t < num_threads; ++t) {
+      lldb::SBThread thread = process.GetThreadAtIndex(t);
+      if (!thread.IsValid())
+        continue;
+      SampleThread(thread, depth, user_only, stack);
+      if (stack.empty())
+        continue;
+      ++g_profile.stacks[stack];
+      ++g_profile.samples;
+      ++taken;
+    }
+
+    if (duration > 0 &&
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+                .count() >= duration)
+      break;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(timer.mutex);
+    timer.done = true;
+  }
+  timer.cv.notify_all();
+  timer_thread.join();
+  debugger.SetAsync(async);
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  g_profile.duration_ns +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+  result.Printf("calltrace: %llu samples in %.2fs at %u Hz (%s)\n",
+                static_cast<unsigned long long>(taken),
+                std::chrono::duration<double>(elapsed).count(), hz, reason);
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Export
+
+static bool WriteFolded(const char *path, std::string &error) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_Text);
+  if (ec) {
+    error = ec.message();
+    return false;
+  }
+  // One line per stack, root first: "a;b;c <count>"
+  for (const auto &[stack, count] : g_profile.stacks) {
+    for (size_t i = stack.size(); i-- > 0;) {
+      os << g_profile.strings[g_profile.frames[stack[i]].name];
+      if (i)
+        os << ";";
+    }
+    os << " " << count << "\n";
+  }
+  return true;
+}
+
+// Just enough of the protobuf wire format for profile.proto
+class ProtoWriter {
+public:
+  void Varint(uint64_t v) {
+    while (v >= 0x80) {
+      m_buf.push_back(static_cast<char>(v | 0x80));
+      v >>= 7;
+    }
+    m_buf.push_back(static_cast<char>(v));
+  }
+  void UInt(uint32_t field, uint64_t v) {
+    Varint(field << 3);
+    Varint(v);
+  }
+  void Bytes(uint32_t field, std::string_view bytes) {
+    Varint((field << 3) | 2);
+    Varint(bytes.size());
+    m_buf.append(bytes.data(), bytes.size());
+  }
+  void Message(uint32_t field, const ProtoWriter &msg) { Bytes(field, msg.m_buf); }
+  void Packed(uint32_t field, const std::vector<uint64_t> &values) {
+    ProtoWriter packed;
+    for (uint64_t v : values)
+      packed.Varint(v);
+    Bytes(field, packed.m_buf);
+  }
+  const std::string &str() const { return m_buf; }
+
+private:
+  std::string m_buf;
+};
+
+static void ValueType(ProtoWriter &out, uint32_t field, uint32_t type,
+                      uint32_t unit) {
+  ProtoWriter vt;
+  vt.UInt(1, type);
+  vt.UInt(2, unit);
+  out.Message(field, vt);
+}
+
+// Uncompressed profile.proto; pprof accepts it as is, gzip is optional
+static bool WritePprof(const char *path, std::string &error) {
+  std::error_code ec;
+  llvm::raw_fd_ostream os(path, ec, llvm::sys::fs::OF_None);
+  if (ec) {
+    error = ec.message();
+    return false;
+  }
+
+  // Intern every string before the table is written
+  uint32_t samples = g_profile.String("samples");
+  uint32_t count = g_profile.String("count");
+  uint32_t cpu = g_profile.String("cpu");
+  uint32_t nanoseconds = g_profile.String("nanoseconds");
+
+  ProtoWriter profile;
+  ValueType(profile, 1, samples, count);
+  ValueType(profile, 1, cpu, nanoseconds);
+
+  for (const auto &[stack, n] : g_profile.stacks) {
+    ProtoWriter sample;
+    std::vector<uint64_t> locations;
+    locations.reserve(stack.size());
+    for (uint32_t id : stack)
+      locations.push_back(id + 1);
+    sample.Packed(1, locations);
+    sample.Packed(2, {n, n * g_profile.period_ns});
+    profile.Message(2, sample);
+  }
+
+  // One location per distinct frame; functions by (name, file)
+  std::map<std::pair<uint32_t, uint32_t>, uint64_t> function_ids;
+  std::vector<std::pair<uint32_t, uint32_t>> functions;
+  for (size_t i = 0; i < g_profile.frames.size(); ++i) {
+    const SampleFrame &f = g_profile.frames[i];
+    auto [it, inserted] =
+        function_ids.emplace(std::make_pair(f.name, f.file), functions.size() + 1);
+    if (inserted)
+      functions.push_back({f.name, f.file});
+
+    ProtoWriter line;
+    line.UInt(1, it->second);
+    line.UInt(2, f.line);
+    ProtoWriter location;
+    location.UInt(1, i + 1);
+    location.Message(4, line);
+    profile.Message(4, location);
+  }
+  for (size_t i = 0; i < functions.size(); ++i) {
+    ProtoWriter function;
+    function.UInt(1, i + 1);
+    function.UInt(2, functions[i].first);
+    function.UInt(3, functions[i].first);
+    function.UInt(4, functions[i].second);
+    profile.Message(5, function);
+  }
+  for (const auto &s : g_profile.strings)
+    profile.Bytes(6, s);
+
+  profile.UInt(9, g_profile.start_ns);
+  profile.UInt(10, g_profile.duration_ns);
+  ValueType(profile, 11, cpu, nanoseconds);
+  profile.UInt(12, g_profile.period_ns);
+
+  os << profile.str();
+  return true;
+}
+
+// -----------------------------------------------------------------------------
+// Subcommand "calltrace sample"
+
+static void PrintTopFunctions(lldb::SBCommandReturnObject &result,
+                              size_t limit) {
+  // Self samples: the leaf frame of each stack
+  std::unordered_map<uint32_t, uint64_t> self;
+  for (const auto &[stack, count] : g_profile.stacks)
+    self[g_profile.frames[stack.front()].name] += count;
+  std::vector<std::pair<uint64_t, uint32_t>> sorted;
+  for (const auto &[name, count] : self)
+    sorted.push_back({count, name});
+  std::sort(sorted.rbegin(), sorted.rend());
+
+  result.Printf("%llu samples, %zu distinct stacks\n",
+                static_cast<unsigned long long>(g_profile.samples),
+                g_profile.stacks.size());
+  for (size_t i = 0; i < sorted.size() && i < limit; ++i)
+    result.Printf("  %6.2f%%  %8llu  %s\n",
+                  100.0 * sorted[i].first / g_profile.samples,
+                  static_cast<unsigned long long>(sorted[i].first),
+                  g_profile.strings[sorted[i].second].c_str());
+}
+
+bool CallTraceSampleCommand::DoExecute(lldb::SBDebugger debugger, char **command,
+                                       lldb::SBCommandReturnObject &result) {
+  std::string sub = command && command[0] ? command[0] : "";
+
+  if (sub == "show") {
+    long limit = 20;
+    if (command[1] && (!ParseInteger(command[1], limit) || limit <= 0)) {
+      result.Printf("Usage: calltrace sample show [count]\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    PrintTopFunctions(result, static_cast<size_t>(limit));
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "export") {
+    std::string format = command[1] ? command[1] : "";
+    if (format != "folded" && format != "pprof") {
+      result.Printf("Usage: calltrace sample export folded|pprof [path]\n");
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    const char *path = command[2] ? command[2]
+                                  : (format == "folded" ? kDefaultFoldedPath
+                                                        : kDefaultPprofPath);
+    std::string error;
+    bool ok = format == "folded" ? WriteFolded(path, error)
+                                 : WritePprof(path, error);
+    if (!ok) {
+      result.Printf("Failed to write %s: %s\n", path, error.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    result.Printf("Profile written to %s\n", path);
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  if (sub == "clear") {
+    g_profile = SampleProfile();
+    result.Printf("Profile cleared\n");
+    result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+    return true;
+  }
+
+  uint32_t hz = 1000;
+  uint32_t depth = kDefaultSampleDepth;
+  double duration = 0;
+  bool user_only = false;
+  for (int i = 0; command && command[i]; ++i) {
+    std::string opt = command[i];
+    if (opt == "--user-only") {
+      user_only = true;
+      continue;
+    }
+    if (!command[i + 1]) {
+      result.Printf("Missing value for %s\n", opt.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    const char *value = command[++i];
+    long number = 0;
+    bool valid;
+    if (opt == "--hz") {
+      valid = ParseInteger(value, number) && number >= 1 && number <= 100000;
+      hz = static_cast<uint32_t>(number);
+    } else if (opt == "--depth") {
+      valid = ParseInteger(value, number) && number >= 1 &&
+              number <= std::numeric_limits<uint32_t>::max();
+      depth = static_cast<uint32_t>(number);
+    } else if (opt == "--duration") {
+      char *end = nullptr;
+      duration = std::strtod(value, &end);
+      valid = end != value && *end == '\0' && duration >= 0;
+    } else {
+      result.Printf("Unknown option: %s\n", opt.c_str());
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+    if (!valid) {
+      result.Printf("Invalid value for %s: %s (--hz must be in 1..100000, "
+                    "--depth at least 1, --duration seconds >= 0)\n",
+                    opt.c_str(), value);
+      result.SetStatus(lldb::eReturnStatusFailed);
+      return false;
+    }
+  }
+
+  lldb::SBTarget target = debugger.GetSelectedTarget();
+  lldb::SBProcess process =
+      target.IsValid() ? target.GetProcess() : lldb::SBProcess();
+  if (!process.IsValid() || process.GetState() != lldb::eStateStopped) {
+    result.Printf("Need a stopped process to sample; launch it with "
+                  "`process launch --stop-at-entry` first.\n");
+    result.SetStatus(lldb::eReturnStatusFailed);
+    return false;
+  }
+
+  RunSampler(debugger, process, hz, depth, duration, user_only, result);
+  PrintTopFunctions(result, 10);
+  result.SetStatus(lldb::eReturnStatusSuccessFinishResult);
+  return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <lldb/API/SBCommandInterpreter.h>
+
+// Command: "calltrace sample [--hz N] [--depth D] [--duration S] [--user-only]"
+//          "calltrace sample show [N] | export folded|pprof [path] | clear"
+class CallTraceSampleCommand : public lldb::SBCommandPluginInterface {
+public:
+  bool DoExecute(lldb::SBDebugger debugger, char **command,
+                 lldb::SBCommandReturnObject &result) override;
+};
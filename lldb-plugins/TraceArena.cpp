@@ -0,0 +1,95 @@
+//
+// stylusdb
+//
+// Page-backed monotonic arena for call trace storage. Pages are mapped
+// directly rather than taken from malloc so they can be backed by huge pages
+// and handed back as a whole.
+//
+
+#include "TraceArena.h"
+
+#include <sys/mman.h>
+
+#include <cstring>
+#include <new>
+
+static char *MapPage(size_t size, bool huge) {
+  void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (huge)
+    p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+  if (p == MAP_FAILED) {
+    p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+             -1, 0);
+    if (p == MAP_FAILED)
+      throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (huge)
+      madvise(p, size, MADV_HUGEPAGE);
+#endif
+  }
+  return static_cast<char *>(p);
+}
+
+void *TraceArena::Allocate(size_t size, size_t align) {
+  uintptr_t p = (reinterpret_cast<uintptr_t>(m_cursor) + align - 1) & ~(align - 1);
+  if (!m_cursor || p + size > reinterpret_cast<uintptr_t>(m_end)) {
+    NextPage(size + align);
+    p = (reinterpret_cast<uintptr_t>(m_cursor) + align - 1) & ~(align - 1);
+  }
+  m_cursor = reinterpret_cast<char *>(p + size);
+  return reinterpret_cast<void *>(p);
+}
+
+std::string_view TraceArena::Copy(std::string_view s) {
+  if (s.empty())
+    return {};
+  char *p = static_cast<char *>(Allocate(s.size(), 1));
+  std::memcpy(p, s.data(), s.size());
+  return {p, s.size()};
+}
+
+void TraceArena::NextPage(size_t min_size) {
+  size_t next = 0;
+  if (m_cursor) {
+    m_used_before += m_cursor - m_pages[m_current].base;
+    next = m_current + 1;
+  }
+  // Reuse the page left from an earlier trace unless the request outgrows it
+  if (next == m_pages.size() || m_pages[next].size < min_size) {
+    size_t size = (min_size + kPageSize - 1) / kPageSize * kPageSize;
+    m_pages.insert(m_pages.begin() + next, {MapPage(size, m_huge_pages), size});
+  }
+  m_current = next;
+  m_cursor = m_pages[next].base;
+  m_end = m_cursor + m_pages[next].size;
+}
+
+void TraceArena::Reset() {
+  m_current = 0;
+  m_used_before = 0;
+  m_cursor = nullptr;
+  m_end = nullptr;
+}
+
+void TraceArena::Release() {
+  for (const Page &page : m_pages)
+    munmap(page.base, page.size);
+  m_pages.clear();
+  Reset();
+}
+
+size_t TraceArena::BytesUsed() const {
+  if (!m_cursor)
+    return 0;
+  return m_used_before + (m_cursor - m_pages[m_current].base);
+}
+
+size_t TraceArena::BytesReserved() const {
+  size_t total = 0;
+  for (const Page &page : m_pages)
+    total += page.size;
+  return total;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Monotonic allocator for trace data. Memory comes from large pages and is
+// never freed piecemeal: Reset() rewinds to the first page in O(1) and keeps
+// the pages for the next trace, Release() returns them to the system. Not
+// thread-safe; each decoding thread owns its own arena.
+class TraceArena {
+public:
+  static constexpr size_t kPageSize = 2 * 1024 * 1024;
+
+  TraceArena() = default;
+  TraceArena(const TraceArena &) = delete;
+  TraceArena &operator=(const TraceArena &) = delete;
+  ~TraceArena() { Release(); }
+
+  void *Allocate(size_t size, size_t align);
+
+  template <typename T> T *AllocateArray(size_t count) {
+    return static_cast<T *>(Allocate(count * sizeof(T), alignof(T)));
+  }
+
+  // The copy stays valid until the next Reset()
+  std::string_view Copy(std::string_view s);
+
+  void Reset();
+  void Release();
+
+  // Back pages mapped from now on with huge pages: explicit ones where the
+  // system has them reserved, transparent ones otherwise
+  void SetUseHugePages(bool enable) { m_huge_pages = enable; }
+
+  size_t BytesUsed() const;
+  size_t BytesReserved() const;
+
+private:
+  struct Page {
+    char *base;
+    size_t size;
+  };
+
+  void NextPage(size_t min_size);
+
+  std::vector<Page> m_pages;
+  size_t m_current = 0;     // Page being filled, valid when m_cursor is set
+  size_t m_used_before = 0; // Bytes used in the pages before m_current
+  char *m_cursor = nullptr;
+  char *m_end = nullptr;
+  bool m_huge_pages = false;
+};
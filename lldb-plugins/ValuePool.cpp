@@ -0,0 +1,58 @@
+//
+// stylusdb
+//
+// Hash-consed storage for formatted argument values. Loop-heavy traces repeat
+// the same self pointers, host structs, senders and token ids thousands of
+// times; each distinct string is kept once in a shard's arena.
+//
+
+#include "ValuePool.h"
+
+#include <functional>
+
+uint32_t ValuePool::Intern(std::string_view value) {
+  size_t hash = std::hash<std::string_view>()(value);
+  // The shard's map hashes again with the same function and buckets on the
+  // low bits, so pick the shard from higher ones
+  Shard &shard = m_shards[(hash >> 7) % kShardCount];
+  std::lock_guard<std::mutex> lk(shard.mutex);
+  auto it = shard.index.find(value);
+  if (it != shard.index.end())
+    return it->second;
+  uint32_t id = m_next_id.fetch_add(1, std::memory_order_relaxed);
+  shard.index.emplace(shard.arena.Copy(value), id);
+  return id;
+}
+
+std::vector<std::string_view> ValuePool::Snapshot() const {
+  std::vector<std::string_view> values(size());
+  for (const Shard &shard : m_shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    for (const auto &[value, id] : shard.index)
+      values[id] = value;
+  }
+  return values;
+}
+
+void ValuePool::Clear() {
+  for (Shard &shard : m_shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    shard.index.clear();
+    shard.arena.Reset();
+  }
+  m_next_id.store(0);
+}
+
+void ValuePool::MemoryUsage(size_t &used, size_t &reserved) const {
+  used = reserved = 0;
+  for (const Shard &shard : m_shards) {
+    std::lock_guard<std::mutex> lk(shard.mutex);
+    // Buckets plus one node (entry, next pointer, cached hash) per value
+    size_t index = shard.index.bucket_count() * sizeof(void *) +
+                   shard.index.size() *
+                       (sizeof(std::pair<const std::string_view, uint32_t>) +
+                        2 * sizeof(void *));
+    used += shard.arena.BytesUsed() + index;
+    reserved += shard.arena.BytesReserved() + index;
+  }
+}
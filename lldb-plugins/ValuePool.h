@@ -0,0 +1,42 @@
+#pragma once
+
+#include "TraceArena.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Formatted argument values, stored once per distinct content. Records hold
+// the 32-bit id Intern() returns; ids are dense and in first-seen order. The
+// pool is split into shards by content hash so the breakpoint callback and
+// the trace workers rarely contend.
+class ValuePool {
+public:
+  uint32_t Intern(std::string_view value);
+
+  // Values indexed by id. Must not race with Intern().
+  std::vector<std::string_view> Snapshot() const;
+
+  size_t size() const { return m_next_id.load(std::memory_order_relaxed); }
+
+  // Drops every value; ids restart at 0
+  void Clear();
+
+  // Approximate bytes held by the values and their indexes
+  void MemoryUsage(size_t &used, size_t &reserved) const;
+
+private:
+  static constexpr size_t kShardCount = 16;
+
+  struct Shard {
+    mutable std::mutex mutex;
+    TraceArena arena;
+    std::unordered_map<std::string_view, uint32_t> index;
+  };
+
+  Shard m_shards[kShardCount];
+  std::atomic<uint32_t> m_next_id{0};
+};
@@ -43,6 +43,15 @@ def decode_selector(sel: str) -> str:
     return sig
 
 
+def resolve_arg_values(call_list, values):
+    """Replace each argument's value_id with its entry in the values table"""
+    for c in call_list:
+        for arg in c.get("args", []):
+            vid = arg.get("value_id")
+            if vid is not None and 0 <= vid < len(values):
+                arg["value"] = values[vid]
+
+
 def build_call_tree(call_list):
     """Build a tree representation of the function call trace"""
     tree, roots = defaultdict(list), []
@@ -243,6 +252,35 @@ def print_solidity_calls(sol_calls):
         print()
 
 
+def print_contract_call_node(call, tree, is_last=False, prefix=""):
+    """Print a cross-contract call node recorded by `calltrace start --contracts-only`"""
+    branch = "└─ " if is_last else "├─ "
+    newp   = prefix + ("  " if is_last else "│ ")
+    kind   = call.get("kind", "call_contract")
+    callee = call.get("callee", "<unknown>")
+    sel    = call.get("selector", "")
+    value  = call.get("value", "")
+
+    line = f"{prefix}{branch}{Fore.GREEN}#{call['call_id']}{Style.RESET_ALL} "
+    if kind == "entry":
+        line += f"{Fore.BLUE}{callee}{Style.RESET_ALL}"
+    else:
+        line += (f"{Fore.CYAN}{kind}{Style.RESET_ALL} "
+                 f"{Fore.GREEN}{call.get('caller', '')}{Style.RESET_ALL} → "
+                 f"{Fore.BLUE}{callee}{Style.RESET_ALL}")
+    if sel:
+        line += f" ({sel} <-> {Fore.MAGENTA}{decode_selector(sel)}{Style.RESET_ALL})"
+    if value and value != "0":
+        line += f" value={value}"
+    if call.get("reverted"):
+        line += f" {Fore.RED}✗ REVERTED{Style.RESET_ALL}"
+    print(line)
+
+    children = tree.get(call["call_id"], [])
+    for i, ch in enumerate(children):
+        print_contract_call_node(ch, tree, i == len(children) - 1, newp)
+
+
 def main():
     colorama.init(autoreset=True)
     if len(sys.argv) < 2:
@@ -257,6 +295,7 @@ def main():
     walnut_json = json.load(open(walnut_file))
     status = walnut_json.get("status", "success")
     walnut = walnut_json.get("calls", [])
+    resolve_arg_values(walnut, walnut_json.get("values", []))
 
     # Print error summary if status is error
     if status == "error":
@@ -293,5 +332,12 @@ def main():
     for i, root in enumerate(roots):
         print_call_node(root, tree, sol_function_map, 0, i==len(roots)-1, "")
 
+    contract_calls = walnut_json.get("contract_calls", [])
+    if contract_calls:
+        croots, ctree = build_call_tree(contract_calls)
+        print(f"{Fore.CYAN}=== CONTRACT CALL TREE ==={Style.RESET_ALL}")
+        for i, root in enumerate(croots):
+            print_contract_call_node(root, ctree, i == len(croots) - 1, "")
+
 if __name__ == "__main__":
     main()
@@ -309,6 +309,17 @@ SBError Driver::ProcessArgs(const opt::InputArgList &args, bool &exiting) {
       m_option_data.m_repl_options = arg_value;
   }
 
+  for (auto *arg : args.filtered(OPT_contract)) {
+    std::string value = arg->getValue();
+    if (value.find('=') == std::string::npos) {
+      error.SetErrorStringWithFormat(
+          "invalid value for --contract: '%s' (expected <address>=<library>)",
+          value.c_str());
+      return error;
+    }
+    m_option_data.m_contracts.push_back(std::move(value));
+  }
+
   // We need to process the options below together as their relative order
   // matters.
   for (auto *arg : args.filtered(OPT_source_on_crash, OPT_one_line_on_crash,
@@ -524,6 +535,15 @@ int Driver::MainLoop() {
                              m_option_data.m_process_pid);
     }
 
+    // Register every --contract in one command so the libraries load in
+    // parallel.
+    if (!m_option_data.m_contracts.empty()) {
+      commands_stream.Printf("stylus-contract add-many");
+      for (const auto &contract : m_option_data.m_contracts)
+        commands_stream.Printf(" %s", EscapeString(contract).c_str());
+      commands_stream.Printf("\n");
+    }
+
     WriteCommandsForSourcing(eCommandPlacementAfterFile, commands_stream);
   } else if (!m_option_data.m_after_file_commands.empty()) {
     // We're in repl mode and after-file-load commands were specified.